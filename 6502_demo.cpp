@@ -82,19 +82,63 @@
 #include <sstream>
 #include <cstdint>
 #include <iterator>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstring>
 
 #include "Bus.h"
 #include "olc6502.h"
+#include "Rewind.h"
+#include "Loader.h"
+#include "Assembler.h"
+#include "Symbols.h"
+#include "InputJournal.h"
+#include "Via6522.h"
+#include "Acia6551.h"
+#include "BankController.h"
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
 
 
 
+// --banks: an image file cut into nSize byte banks, shown one at a time
+// in a window at nAddr, with the bank chosen by writing to nReg
+struct BANKS
+{
+	std::string sImage;
+	uint16_t nAddr = 0;
+	uint32_t nSize = 0;
+	uint16_t nReg = 0;
+};
+
+bool AttachBanks(BankController &banks, Bus &bus, const BANKS &b)
+{
+	banks.ConnectBus(&bus);
+	if (!banks.Open(b.sImage, b.nSize)) {
+		std::cerr << "Error opening banks: " << banks.Error() << std::endl;
+		return false;
+	}
+	if (banks.AddWindow(b.nAddr, b.nSize) < 0) {
+		std::cerr << "Bank window must be whole pages within 64K" << std::endl;
+		return false;
+	}
+	banks.MapRegisters(b.nReg);
+	return true;
+}
+
+
+
 class Demo_olc6502 : public olc::PixelGameEngine
 {
 public:
-	Demo_olc6502() { sAppName = "olc6502 Demonstration"; }
+	Demo_olc6502() { sAppName = std::string("olc6502 Demonstration - ") + olc6502::VariantName(); }
 
 	float KeyDownTime;	// for continuous stepping on holding space key
 
@@ -105,9 +149,32 @@ public:
 	};
 	LoopData Loop;
 
+	bool bRunning;		// free running until a breakpoint is hit (G key)
+
+	// Free running happens flat out on its own thread, so the window keeps
+	// its frame rate however fast the emulation goes. While it runs, the
+	// only thing drawn is memory, and that comes from a copy the runner
+	// publishes between slices, under snap_lock, never from the bus it is
+	// writing. A byte can be a moment stale, but it is shown properly the
+	// next frame.
+	std::thread runner;
+	std::atomic<bool> bStopRunner{ false };		// asks the runner to finish
+	std::atomic<bool> bRunnerDone{ false };		// the runner hit a breakpoint
+
+	std::mutex snap_lock;
+	std::array<uint8_t, 64 * 1024> snap_mem;	// memory as of the last slice
+	std::array<uint32_t, 256> snap_gen;			// generations of snap_mem's pages
+
 	Bus nes;
+	Rewind rewind;
+	InputJournal journal;
+	std::string sJournalFile;			// where to save the session's input journal, if anywhere
 	std::map<uint16_t, std::string> mapAsm;
-	std::vector<uint8_t> prog_buf;		// buffer to hold the program (before being loaded into nes.ram)
+	Symbols symbols;					// names for the disassembly and call stack, if loaded
+	Via6522 via;						// only on the bus with --via
+	Acia6551 acia;						// only on the bus with --acia
+	int nAcia = -1;
+	BankController banks;				// only on the bus with --banks
 
 	std::string hex(uint32_t n, uint8_t d)
 	{
@@ -126,23 +193,191 @@ public:
 	};
 
 
-	void DrawRam(int x, int y, uint16_t nAddr, int nRows, int nColumns)
+	// Memory Panels ===================================================
+	// The upper panel is zero page, the lower one can be scrolled through
+	// all of memory with the cursor keys, PGUP/PGDN or the mouse wheel.
+	// Each panel is rendered into its own sprite, and drawing it is just
+	// copying that. A row is rendered again only when the write generation
+	// of its page has moved and its bytes differ from those shown, or when
+	// its highlight runs out. Bytes that changed stay yellow for HOT_FRAMES
+	// frames, so the writes of a running program can be followed.
+	static const uint32_t HOT_FRAMES = 30;
+
+	struct RamPanel
+	{
+		uint16_t nAddr = 0x0000;
+		int nRows = 0, nColumns = 0;
+		std::unique_ptr<olc::Sprite> sprite;
+		std::vector<uint8_t>  shown;		// The bytes as rendered
+		std::vector<uint32_t> hot;			// Frame each byte's highlight ends
+		std::vector<uint32_t> row_hot;		// Frame a row's highlights all end, 0 if none
+		std::array<uint32_t, 256> seen_gen;	// Page generations last looked at
+	};
+
+	RamPanel ramZeroPage, ramBrowser;
+	uint32_t nFrame = 0;
+
+	void InitRamPanel(RamPanel &p, uint16_t nAddr, int nRows, int nColumns)
 	{
-		int nRamX = x, nRamY = y;
+		std::unique_lock<std::mutex> lock(snap_lock, std::defer_lock);
+		if (bRunning)
+			lock.lock();
+
+		p.nAddr = nAddr;
+		p.nRows = nRows;
+		p.nColumns = nColumns;
+		if (!p.sprite || p.sprite->width != (7 + nColumns * 4) * 8 || p.sprite->height != nRows * 10)
+			p.sprite.reset(new olc::Sprite((7 + nColumns * 4) * 8, nRows * 10));
+		p.shown.assign(nRows * nColumns, 0x00);
+		p.hot.assign(nRows * nColumns, 0);
+		p.row_hot.assign(nRows, 0);
+		p.seen_gen = bRunning ? snap_gen : nes.page_gen;
+
+		PeekMemory(nAddr, p.shown.data(), nRows * nColumns);
 		for (int row = 0; row < nRows; row++)
+			RenderRamRow(p, row);
+	}
+
+	// Moves a panel by a number of rows, wrapping around memory
+	void ScrollRamPanel(RamPanel &p, int nRows)
+	{
+		InitRamPanel(p, (uint16_t)(p.nAddr + nRows * p.nColumns), p.nRows, p.nColumns);
+	}
+
+	// Copies memory without going through the bus a byte at a time: each
+	// page's part comes straight from its host memory, and only a device
+	// page is peeked the slow way. While running it comes from the runner's
+	// copy instead, with snap_lock held by the caller
+	void PeekMemory(uint16_t nAddr, uint8_t *data, int n)
+	{
+		for (int i = 0; i < n; )
+		{
+			uint16_t a = (uint16_t)(nAddr + i);
+			int nRun = std::min(n - i, 0x100 - (a & 0xFF));
+			if (bRunning)
+				memcpy(data + i, &snap_mem[a], nRun);
+			else if (const uint8_t *page = nes.page[a >> 8])
+				memcpy(data + i, page + (a & 0xFF), nRun);
+			else
+				for (int j = 0; j < nRun; j++)
+					data[i + j] = nes.peek((uint16_t)(a + j));
+			i += nRun;
+		}
+	}
+
+	// On the runner's thread, between slices. Pages whose generation moved
+	// are copied, and device pages, which change without being written,
+	// are peeked and given a new generation if they did
+	void PublishMemory()
+	{
+		std::lock_guard<std::mutex> lock(snap_lock);
+		for (int p = 0; p < 256; p++)
+		{
+			if (const uint8_t *page = nes.page[p])
+			{
+				if (snap_gen[p] != nes.page_gen[p])
+				{
+					memcpy(&snap_mem[p << 8], page, 0x100);
+					snap_gen[p] = nes.page_gen[p];
+				}
+			}
+			else
+			{
+				uint8_t value[256];
+				for (int i = 0; i < 256; i++)
+					value[i] = nes.peek((uint16_t)((p << 8) + i));
+				if (memcmp(value, &snap_mem[p << 8], 256) != 0)
+				{
+					memcpy(&snap_mem[p << 8], value, 256);
+					snap_gen[p]++;
+				}
+			}
+		}
+	}
+
+	void RenderRamRow(RamPanel &p, int row)
+	{
+		SetDrawTarget(p.sprite.get());
+
+		int y = row * 10;
+		int i = row * p.nColumns;
+		FillRect(0, y, p.sprite->width, 10, olc::DARK_BLUE);
+
+		std::string sOffset = "$" + hex(p.nAddr + i, 4) + ":";
+		std::string sASCII = " ";
+		for (int col = 0; col < p.nColumns; col++)
+		{
+			sOffset += " " + hex(p.shown[i + col], 2);
+			sASCII.append(1, ascii(p.shown[i + col]));
+		}
+		DrawString(0, y, sOffset + sASCII);
+
+		// Then the recent writes over the top
+		p.row_hot[row] = 0;
+		for (int col = 0; col < p.nColumns; col++)
+		{
+			if (p.hot[i + col] <= nFrame)
+				continue;
+			int x = (7 + col * 3) * 8;
+			FillRect(x, y, 16, 8, olc::DARK_BLUE);
+			DrawString(x, y, hex(p.shown[i + col], 2), olc::YELLOW);
+			p.row_hot[row] = std::max(p.row_hot[row], p.hot[i + col]);
+		}
+
+		SetDrawTarget(nullptr);
+	}
+
+	void DrawRam(int x, int y, RamPanel &p)
+	{
+		std::unique_lock<std::mutex> lock(snap_lock, std::defer_lock);
+		if (bRunning)
+			lock.lock();
+		const std::array<uint32_t, 256> &gen = bRunning ? snap_gen : nes.page_gen;
+
+		for (int row = 0; row < p.nRows; row++)
 		{
-			std::string sOffset = "$" + hex(nAddr, 4) + ":";
-			std::string sASCII = " ";
-			for (int col = 0; col < nColumns; col++)
+			int i = row * p.nColumns;
+			uint16_t nStart = (uint16_t)(p.nAddr + i);
+			uint16_t nEnd = (uint16_t)(nStart + p.nColumns - 1);
+
+			// A device's registers change without being written, so its
+			// pages are always looked at. The runner's copy gives them a
+			// generation of their own
+			bool bDirty = false;
+			for (int page = nStart >> 8; page <= (nEnd >> 8); page++)
+				bDirty |= gen[page] != p.seen_gen[page] || (!bRunning && nes.page[page] == nullptr);
+
+			bool bRender = p.row_hot[row] != 0 && p.row_hot[row] <= nFrame;
+			if (bDirty)
 			{
-				int value = nes.read(nAddr, true);
-				sOffset += " " + hex(value, 2);
-				sASCII.append (1, ascii(value));
-				nAddr += 1;
+				uint8_t value[256];
+				memcpy(value, &p.shown[i], p.nColumns);
+				PeekMemory(nStart, value, p.nColumns);
+				if (memcmp(value, &p.shown[i], p.nColumns) != 0)
+				{
+					for (int col = 0; col < p.nColumns; col++)
+					{
+						if (value[col] != p.shown[i + col])
+						{
+							p.shown[i + col] = value[col];
+							p.hot[i + col] = nFrame + HOT_FRAMES;
+						}
+					}
+					bRender = true;
+				}
 			}
-			DrawString(nRamX, nRamY, sOffset + sASCII);
-			nRamY += 10;
+
+			if (bRender)
+				RenderRamRow(p, row);
 		}
+
+		// Rows can share a page, so it is only marked seen once all are done.
+		// The browser can wrap past $FFFF back to zero page
+		int nPages = ((p.nAddr & 0xFF) + p.nRows * p.nColumns + 0xFF) >> 8;
+		for (int page = 0; page < nPages; page++)
+			p.seen_gen[((p.nAddr >> 8) + page) & 0xFF] = gen[((p.nAddr >> 8) + page) & 0xFF];
+
+		DrawSprite(x, y, p.sprite.get());
 	}
 
 	void DrawCpu(int x, int y)
@@ -162,6 +397,32 @@ public:
 		DrawString(x , y + 30, "X: $" +  hex(nes.cpu.x, 2) + "  [" + std::to_string(nes.cpu.x) + "]");
 		DrawString(x , y + 40, "Y: $" +  hex(nes.cpu.y, 2) + "  [" + std::to_string(nes.cpu.y) + "]");
 		DrawString(x , y + 50, "Stack P: $" + hex(nes.cpu.stkp, 4));
+
+		if (nes.bp.hit != Breakpoints::NONE)
+		{
+			std::string sType = nes.bp.hit == Breakpoints::EXEC ? "EXEC" : nes.bp.hit == Breakpoints::READ ? "READ" : "WRITE";
+			DrawString(x + 128, y + 50, "BREAK " + sType + " $" + hex(nes.bp.hit_addr, 4), olc::YELLOW);
+		}
+	}
+
+	// Shows the shadow call stack, innermost frame first
+	void DrawCallStack(int x, int y, int nLines)
+	{
+		static const char *sType[] = { "JSR", "BRK", "IRQ", "NMI" };
+		std::vector<olc6502::FRAME> frames = nes.cpu.backtrace();
+
+		DrawString(x, y, "CALL STACK: " + std::to_string(frames.size()));
+		for (int i = 0; i < nLines && i < (int)frames.size(); i++)
+		{
+			const olc6502::FRAME &f = frames[frames.size() - 1 - i];
+			DrawString(x, y + 10 + i * 10, std::string(sType[f.type]) + " " + symbols.Format(f.target) + " <- " + symbols.Format(f.ret));
+		}
+	}
+
+	// Lines with an execution breakpoint are drawn in red
+	olc::Pixel CodeColour(uint16_t nAddr)
+	{
+		return nes.bp.IsSet(nAddr, Breakpoints::EXEC) ? olc::RED : olc::WHITE;
 	}
 
 	void DrawCode(int x, int y, int nLines)
@@ -177,7 +438,7 @@ public:
 				nLineY += 10;
 				if (++it_a != mapAsm.end())
 				{
-					DrawString(x, nLineY, (*it_a).second);
+					DrawString(x, nLineY, (*it_a).second, CodeColour((*it_a).first));
 				}
 			}
 		}
@@ -191,7 +452,7 @@ public:
 				nLineY -= 10;
 				if (--it_a != mapAsm.end())
 				{
-					DrawString(x, nLineY, (*it_a).second);
+					DrawString(x, nLineY, (*it_a).second, CodeColour((*it_a).first));
 				}
 			}
 		}		
@@ -199,74 +460,111 @@ public:
 
 	void LoadDefaultProgram()
 	{
-		// Load Program (assembled at https://www.masswerk.at/6502/assembler.html)
-		/*
+		// Multiplies 3 by 11 the long way, with the built-in assembler
+		Assembler as;
+		as.ConnectBus(&nes);
+		as.Assemble(R"(
 			*=$8000
-			LDA #3
+start		LDA #3
 			STA $01
 			LDA #0
-			LDY #11			 
+			LDY #11
 			CLC
-			loop
-			ADC $01
+loop		ADC $01
 			DEY
 			BNE loop
 			STA $02
 			NOP
 			NOP
 			NOP
-		*/
-		
-		std::stringstream ss;
-		ss << "A9 03 85 01 A9 00 A0 0B 18 65 01 88 D0 FB 85 02 EA EA EA";
-
-		while (!ss.eof())
-		{	//Convert hex string into bytes and store in prog_buf
-			std::string b;
-			ss >> b;
-			uint8_t bb = (uint8_t)std::stoul(b, nullptr, 16);
-				// debug msg std::cerr << "b: " << b << ", bb: " << std::to_string(bb) << std::endl;
-			prog_buf.push_back(bb); 
-		}
+
+			*=$FFFC
+			.word start
+		)");
+		as.ExportSymbols(symbols);
 	}
 
-    bool loadProgramFromFile(const char *fileName) noexcept
-        {
-        // Try to open a file specified by its name
-        std::ifstream file(fileName, std::ios::in | std::ios::binary);
-        if (!file.is_open() || file.bad())
-            return false;
+	// Raw binaries go at nLoad, other formats say where they go. The
+	// reset vector is pointed at the program unless it sets its own
+	bool loadProgramFromFile(const char *fileName, uint16_t nLoad)
+	{
+		Loader loader;
+		loader.ConnectBus(&nes);
+		loader.nRawAddr = nLoad;
+		if (!loader.Load(fileName))
+		{
+			std::cerr << fileName << ": " << loader.Error() << std::endl;
+			return false;
+		}
+		return true;
+	}
 
-        // Clear whitespace removal flag
-        file.unsetf(std::ios::skipws);
+	// Free running on the worker thread, 100000 cycles at a time between
+	// looks at the stop flag and copies of memory for the panels. The first
+	// copy is made here, before the runner owns the bus
+	void StartRunning()
+	{
+		Loop.on = false;
+		snap_gen = nes.page_gen;
+		PeekMemory(0x0000, snap_mem.data(), 0x10000);
 
-        // Determine size of the file
-        file.seekg(0, std::ios_base::end);
-        size_t fileSize = file.tellg();
-        file.seekg(0, std::ios_base::beg);
+		bStopRunner = false;
+		bRunnerDone = false;
+		bRunning = true;
+		runner = std::thread([this]()
+		{
+			while (!bStopRunner && !nes.cpu.run(100000))
+				PublishMemory();
+			bRunnerDone = true;
+		});
+	}
 
-        // Discard previous vector content
-        /* prog_buf.resize(0);
-        prog_buf.reserve(0);
-        prog_buf.shrink_to_fit(); */
+	// Waits for the worker, after which the CPU is the UI's again
+	void StopRunning()
+	{
+		if (runner.joinable())
+		{
+			bStopRunner = true;
+			runner.join();
+		}
+		bRunning = false;
+	}
 
-        // Order to prealocate memory to avoid unnecessary reallocations due to vector growth
-        prog_buf.reserve(fileSize);
+	// A 6522 in place of 16 bytes of RAM, as on Ben Eater's board at $6000
+	void AttachVia(uint16_t nAddr)
+	{
+		via.ConnectBus(&nes);
+		nes.Attach(&via, nAddr, nAddr + 0x0F);
+	}
 
-        // Read entire file content into prealocated vector memory
-        prog_buf.insert(begin(prog_buf),
-            std::istream_iterator<uint8_t>(file),
-            std::istream_iterator<uint8_t>());
+	// A 6551 with its line on the host. What it receives goes through the
+	// input journal, so a recorded session replays without the host
+	bool AttachAcia(uint16_t nAddr, const std::string &sSerial)
+	{
+		if (!acia.Open(sSerial)) {
+			std::cerr << "Error opening serial line: " << acia.Error() << std::endl;
+			return false;
+		}
+		nAcia = nAddr;
+		acia.ConnectBus(&nes);
+		acia.on_host_byte = [this](uint8_t data) { journal.input((uint16_t)nAcia, data); };
+		nes.Attach(&acia, nAddr, nAddr + 0x03);
+		return true;
+	}
 
-        // Make sure entire content is loaded
-        return size(prog_buf) == fileSize;
-        }
+	// An image bigger than 64K, switched through one window a bank at a
+	// time
+	bool AttachBanks(const BANKS &b)
+	{
+		return ::AttachBanks(banks, nes, b);
+	}
 
 	// Reset CPU
 	void ResetCPU()
 	{
-		nes.cpu.reset();
+		journal.reset();
 		Loop.on = false;
+		bRunning = false;
 		StepCPU(1);			// step CPU once to fix no response to space first time in OnUserUpdate
 	}
 
@@ -274,38 +572,44 @@ public:
 	void StepCPU(uint16_t numStep)
 	{
 		for (uint16_t i = 0; i < numStep; i++) {
-			do
-			{
-				nes.cpu.clock();
-			} 
-			while (!nes.cpu.complete());
+			nes.cpu.step();
 		} 
 	}
 
 
 	bool OnUserCreate()
 	{
-		// load program from prog_buf into emulated ram
-		uint16_t nOffset = 0x8000;
-		for (int i=0; i<size(prog_buf); i++)
-		{
-			nes.ram[nOffset+i] = prog_buf[i];
-		}
-
-		// Set Reset Vector
-		nes.ram[0xFFFC] = 0x00;
-		nes.ram[0xFFFD] = 0x80;
-
+		// The program is already in RAM, with the reset vector set
 		// Dont forget to set IRQ and NMI vectors if you want to play with those
+
+		// All external events are logged from here on, so the session can
+		// be replayed, and rewound through
+		journal.ConnectBus(&nes);
+		if (nAcia >= 0)
+			journal.input_handler = [this](uint16_t port, uint8_t data) {
+				if (port == nAcia) acia.Receive(data); else nes.write(port, data);
+			};
+		journal.StartRecording();
+
+		// Full snapshot every million cycles, page deltas every 10000, 64MB at most
+		rewind.ConnectBus(&nes);
+		rewind.ConnectJournal(&journal);
+		rewind.Configure(1000000, 10000, 64 * 1024 * 1024);
 				
+		InitRamPanel(ramZeroPage, 0x0000, 16, 16);
+		InitRamPanel(ramBrowser, 0x8000, 16, 16);
+
 		// Extract dissassembly
+		nes.cpu.symbols = &symbols;
 		mapAsm = nes.cpu.disassemble(0x0000, 0xFFFF);
 
 		// Reset
 		ResetCPU();
+		rewind.Start();
 
 		// clear variables for key functions
 		KeyDownTime = 0;
+		bRunning = false;
 
 		return true;
 
@@ -315,10 +619,44 @@ public:
 	{
 		Clear(olc::DARK_BLUE);
 
+		// Scrolling the browser is fine while running, as it only reads memory
+		if (GetKey(olc::Key::UP).bPressed)   ScrollRamPanel(ramBrowser, -1);
+		if (GetKey(olc::Key::DOWN).bPressed) ScrollRamPanel(ramBrowser, 1);
+		if (GetKey(olc::Key::PGUP).bPressed) ScrollRamPanel(ramBrowser, -ramBrowser.nRows);
+		if (GetKey(olc::Key::PGDN).bPressed) ScrollRamPanel(ramBrowser, ramBrowser.nRows);
+		if (GetMouseWheel() != 0)
+			ScrollRamPanel(ramBrowser, GetMouseWheel() > 0 ? -4 : 4);
+
+		if (bRunning)
+		{
+			// A breakpoint, or any other key, stops it. The key does nothing else
+			static const olc::Key keys[] = { olc::Key::SPACE, olc::Key::L, olc::Key::C, olc::Key::B,
+				olc::Key::G, olc::Key::R, olc::Key::I, olc::Key::N, olc::Key::BACK, olc::Key::ESCAPE };
+			bool bStop = bRunnerDone;
+			for (auto k : keys)
+				bStop |= GetKey(k).bPressed;
+
+			if (!bStop)
+			{
+				nFrame++;
+				DrawRam(2, 2, ramZeroPage);
+				DrawRam(2, 182, ramBrowser);
+				DrawString(600, 2, "RUNNING", olc::GREEN);
+				DrawString(600, 12, "Any key to stop");
+				DrawString(10, 370, "UP/DOWN/PGUP/PGDN = Scroll Memory");
+				return true;
+			}
+
+			StopRunning();
+			KeyDownTime = 0;
+			return DrawAll();
+		}
+
 		if (GetKey(olc::Key::SPACE).bPressed)
 		{
 			KeyDownTime = 0;
 			Loop.on = false;		// space press stops any looping
+			bRunning = false;
 			StepCPU(1);
 		}
 
@@ -352,48 +690,229 @@ public:
 		}
 
 
+		if (GetKey(olc::Key::B).bPressed)	// toggle breakpoint at the current instruction
+		{
+			if (nes.bp.IsSet(nes.cpu.pc, Breakpoints::EXEC))
+				nes.bp.Clear(nes.cpu.pc, Breakpoints::EXEC);
+			else
+				nes.bp.Set(nes.cpu.pc, Breakpoints::EXEC);
+		}
+
+		if (GetKey(olc::Key::G).bPressed)	// run until a breakpoint is hit
+			StartRunning();
+
 		if (GetKey(olc::Key::R).bPressed)
 			ResetCPU();
 
 		if (GetKey(olc::Key::I).bPressed)
-			nes.cpu.irq();
+			journal.irq();
 
 		if (GetKey(olc::Key::N).bPressed)
-			nes.cpu.nmi();
+			journal.nmi();
 
-		// Draw Ram Page 0x00		
-		DrawRam(2, 2, 0x0000, 16, 16);
-		DrawRam(2, 182, 0x8000, 16, 16);
+		if (GetKey(olc::Key::BACK).bPressed)	// step back one instruction
+		{
+			Loop.on = false;
+			rewind.StepBack();
+		}
+
+		return DrawAll();
+	}
+
+	bool DrawAll()
+	{
+		// Draw Ram Page 0x00 and the memory browser
+		nFrame++;
+		DrawRam(2, 2, ramZeroPage);
+		DrawRam(2, 182, ramBrowser);
 		DrawCpu(600, 2);
 		DrawCode(600, 72, 26);
+		DrawCallStack(600, 350, 11);
 
 
 		DrawString(10, 370, "SPACE = Step Instruction    L = Loop Once    C = Loop Continuously");
-		DrawString(10, 380, "R = RESET    I = IRQ    N = NMI");
+		DrawString(10, 380, "R = RESET    I = IRQ    N = NMI    B = Toggle Breakpoint    G = Go");
+		DrawString(10, 390, "BACKSPACE = Step Back    UP/DOWN/PGUP/PGDN = Scroll Memory");
+
+		Rewind::STATS rs = rewind.GetStats();
+		DrawString(10, 410, "REWIND: " + std::to_string(rs.bytes / 1024) + " KB, " + std::to_string((uint64_t)rs.bytes_per_second / 1024) + " KB/s emulated, back to #" + std::to_string(rewind.OldestInstruction()));
+
+		return true;
+	}
+
+	bool OnUserDestroy()
+	{
+		StopRunning();
+		if (!sJournalFile.empty() && !journal.Save(sJournalFile))
+			std::cerr << "Error writing journal " << sJournalFile << std::endl;
 
+		// What the conditional breakpoints cost, per evaluation
+		if (!nes.bp.Conditions().empty())
+			std::cout << nes.bp.ConditionReport();
 		return true;
 	}
 };
 
 
-int main(int argc, char* argv[])
+// Replays a journal without a window, as fast as the host can go,
+// optionally printing the routines that took the most cycles
+int ReplayJournal(const char *fileName, const Symbols &symbols, bool bProfile, int nVia, int nAcia, const BANKS &b)
 {
-	if (argc>2) {
-		std::cerr << "Usage: " << argv[0] << " [OPTION] [FILE]" << std::endl;
+	Bus nes;
+	InputJournal journal;
+	journal.ConnectBus(&nes);
+	nes.cpu.EnableProfile(bProfile);
+
+	// The session's devices must be there for the replay to match it
+	Via6522 via;
+	if (nVia >= 0) {
+		via.ConnectBus(&nes);
+		nes.Attach(&via, (uint16_t)nVia, (uint16_t)(nVia + 0x0F));
+	}
+
+	// The serial line's input comes from the journal, its output still
+	// goes to stdout
+	Acia6551 acia;
+	if (nAcia >= 0) {
+		acia.ConnectBus(&nes);
+		acia.Open(-1, 1);
+		nes.Attach(&acia, (uint16_t)nAcia, (uint16_t)(nAcia + 0x03));
+		journal.input_handler = [&](uint16_t port, uint8_t data) {
+			if (port == nAcia) acia.Receive(data); else nes.write(port, data);
+		};
+	}
+
+	// Banks aren't in the journal, so they start from the image again
+	BankController banks;
+	if (!b.sImage.empty() && !AttachBanks(banks, nes, b))
+		return 1;
+
+	if (!journal.Load(fileName)) {
+		std::cerr << "Error reading journal " << fileName << std::endl;
 		return 1;
 	}
 
+	auto tp1 = std::chrono::steady_clock::now();
+	journal.RunReplay();
+	auto tp2 = std::chrono::steady_clock::now();
+	double dSeconds = std::chrono::duration<double>(tp2 - tp1).count();
+
+	std::cout << "Replayed " << journal.Events().size() << " events, " << nes.cpu.GetClockCount() << " cycles, "
+		<< nes.cpu.GetInstructionCount() << " instructions in " << dSeconds << "s" << std::endl;
+	std::cout << "PC:" << std::hex << nes.cpu.pc << " A:" << (int)nes.cpu.a << " X:" << (int)nes.cpu.x
+		<< " Y:" << (int)nes.cpu.y << " SP:" << (int)nes.cpu.stkp << " P:" << (int)nes.cpu.status << std::endl;
+
+	if (bProfile) {
+		// Cycles are inclusive, so callers come out above their callees
+		const std::vector<olc6502::PROFILE> &profile = nes.cpu.profile();
+		std::vector<uint16_t> routines;
+		for (uint32_t addr = 0; addr < profile.size(); addr++)
+			if (profile[addr].calls)
+				routines.push_back((uint16_t)addr);
+		std::sort(routines.begin(), routines.end(),
+			[&](uint16_t a, uint16_t b) { return profile[a].cycles > profile[b].cycles; });
+
+		printf("\n%-24s %12s %14s\n", "Routine", "Calls", "Cycles");
+		for (size_t i = 0; i < routines.size() && i < 20; i++) {
+			const olc6502::PROFILE &p = profile[routines[i]];
+			printf("%-24s %12llu %14llu\n", symbols.Format(routines[i]).c_str(),
+				(unsigned long long)p.calls, (unsigned long long)p.cycles);
+		}
+	}
+	return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	// --replay JOURNAL     replay a recorded session headless and unthrottled
+	// --profile            with --replay, print the routines taking the most cycles
+	// --record JOURNAL     save this session's input journal on exit
+	// --load ADDR          where a raw binary is loaded, in hex (default 8000)
+	// --symbols FILE       label file naming addresses, see Symbols.h
+	// --via ADDR           put a 6522 VIA at ADDR, in hex, e.g. 6000
+	// --acia ADDR          put a 6551 ACIA at ADDR, in hex, e.g. 5000
+	// --serial SPEC        the ACIA's line: - for stdin/stdout (default),
+	//                      unix:PATH for a socket, or a FIFO or tty
+	// --break EXPR         conditional breakpoint, e.g. 'PC == $8010 && A > $80'
+	//                      (see Condition.h); their cost is printed on exit
+	// --banks FILE ADDR SIZE REG
+	//                      bank switch FILE through a window of SIZE bytes at
+	//                      ADDR, selected by writing REG, all in hex
 	Demo_olc6502 demo;
+	const char *sFile = nullptr;
+	const char *sReplay = nullptr;
+	bool bProfile = false;
+	bool bUsage = false;
+	uint16_t nLoad = 0x8000;
+	int nVia = -1;
+	int nAcia = -1;
+	std::string sSerial = "-";
+	BANKS banks;
+
+	for (int i = 1; i < argc; i++) {
+		std::string sArg = argv[i];
+		if (sArg == "--replay" && i + 1 < argc)
+			sReplay = argv[++i];
+		else if (sArg == "--profile")
+			bProfile = true;
+		else if (sArg == "--record" && i + 1 < argc)
+			demo.sJournalFile = argv[++i];
+		else if (sArg == "--load" && i + 1 < argc)
+			nLoad = (uint16_t)strtoul(argv[++i], nullptr, 16);
+		else if (sArg == "--via" && i + 1 < argc)
+			nVia = (int)(strtoul(argv[++i], nullptr, 16) & 0xFFF0);
+		else if (sArg == "--acia" && i + 1 < argc)
+			nAcia = (int)(strtoul(argv[++i], nullptr, 16) & 0xFFFC);
+		else if (sArg == "--serial" && i + 1 < argc)
+			sSerial = argv[++i];
+		else if (sArg == "--break" && i + 1 < argc) {
+			std::string sError;
+			if (!demo.nes.bp.SetConditional(argv[++i], sError)) {
+				std::cerr << "Error in breakpoint " << argv[i] << ": " << sError << std::endl;
+				return 1;
+			}
+		}
+		else if (sArg == "--banks" && i + 4 < argc) {
+			banks.sImage = argv[++i];
+			banks.nAddr = (uint16_t)strtoul(argv[++i], nullptr, 16);
+			banks.nSize = (uint32_t)strtoul(argv[++i], nullptr, 16);
+			banks.nReg = (uint16_t)strtoul(argv[++i], nullptr, 16);
+		}
+		else if (sArg == "--symbols" && i + 1 < argc) {
+			if (!demo.symbols.Load(argv[++i])) {
+				std::cerr << "Error reading symbols " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (sArg[0] != '-' && sFile == nullptr)
+			sFile = argv[i];
+		else
+			bUsage = true;
+	}
 
-	if (argc<2)	{
-		demo.LoadDefaultProgram();		// if no filename given, load a short default demo program
+	// A replay has its own program, from the journal
+	if (sReplay && !sFile && !bUsage)
+		return ReplayJournal(sReplay, demo.symbols, bProfile, nVia, nAcia, banks);
+
+	if (bUsage || sReplay || bProfile) {
+		std::cerr << "Usage: " << argv[0] << " [--record JOURNAL] [--load ADDR] [--symbols FILE] [--via ADDR] [--acia ADDR [--serial SPEC]] [--banks FILE ADDR SIZE REG] [--break EXPR]... [FILE]" << std::endl;
+		std::cerr << "       " << argv[0] << " --replay JOURNAL [--profile] [--symbols FILE] [--via ADDR] [--acia ADDR] [--banks FILE ADDR SIZE REG]" << std::endl;
+		return 1;
 	}
 
-	if (argc==2) {
-		if (!demo.loadProgramFromFile(argv[1])) {
-			std::cerr << "Error reading file " << argv[1] << std::endl;
-			return 1;
-		}
+	if (nVia >= 0)
+		demo.AttachVia((uint16_t)nVia);
+	if (nAcia >= 0 && !demo.AttachAcia((uint16_t)nAcia, sSerial))
+		return 1;
+	if (!banks.sImage.empty() && !demo.AttachBanks(banks))
+		return 1;
+
+	if (sFile == nullptr)	{
+		demo.LoadDefaultProgram();		// if no filename given, load a short default demo program
+	}
+	else if (!demo.loadProgramFromFile(sFile, nLoad)) {
+		return 1;
 	}
 
 	demo.Construct(840, 480, 2, 2, false, true);  // last true enables vsync
@@ -0,0 +1,142 @@
+/*
+	6502_functest - Runs Klaus Dormann's 6502 functional test as a
+	correctness check and throughput benchmark for the olc6502 core
+
+	The test is a 64KB memory image assembled from 6502_functional_test.a65
+	(https://github.com/Klaus2m5/6502_65C02_functional_tests). It starts at
+	$0400 and exercises every documented instruction and addressing mode.
+	Whenever a check fails it stops in a "trap", a branch or jump to itself,
+	and when everything has passed it traps at a known success address,
+	$3469 for the image shipped as bin_files/6502_functional_test.bin. An
+	image assembled with different options traps elsewhere, so the success
+	and start addresses can be given on the command line.
+
+	The image is not part of this repository. Build or download it, then
+
+		make functest
+		./6502_functest 6502_functional_test.bin [SUCCESS [START]]
+
+	or "make check FUNCTEST_BIN=path/to/image".
+
+	The exit code is 0 if the success trap was reached, 1 if the test
+	trapped anywhere else or ran out of cycles, and 2 if it could not run.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Bus.h"
+#include "olc6502.h"
+
+// Far more than a passing run needs, which is under 100 million cycles
+static const uint64_t MAX_CYCLES = 1000000000;
+
+static bool ParseHex(const char *s, uint16_t &n)
+{
+	char *end = nullptr;
+	unsigned long v = strtoul(s, &end, 16);
+	if (end == s || *end != '\0' || v > 0xFFFF)
+		return false;
+	n = (uint16_t)v;
+	return true;
+}
+
+static bool LoadImage(Bus &bus, const char *fileName)
+{
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	file.read((char*)bus.ram.data(), bus.ram.size());
+	return file.gcount() > 0;
+}
+
+int main(int argc, char* argv[])
+{
+	uint16_t nSuccess = 0x3469;
+	uint16_t nStart = 0x0400;
+
+	if (argc < 2 || argc > 4
+		|| (argc > 2 && !ParseHex(argv[2], nSuccess))
+		|| (argc > 3 && !ParseHex(argv[3], nStart)))
+	{
+		std::cerr << "Usage: " << argv[0] << " IMAGE [SUCCESS [START]]" << std::endl;
+		std::cerr << "  IMAGE    6502_functional_test.bin, loaded at $0000" << std::endl;
+		std::cerr << "  SUCCESS  address of the success trap in hex, default 3469" << std::endl;
+		std::cerr << "  START    address to start from in hex, default 0400" << std::endl;
+		return 2;
+	}
+
+	Bus bus;
+	if (!LoadImage(bus, argv[1]))
+	{
+		std::cerr << "Error reading " << argv[1] << std::endl;
+		std::cerr << "The functional test image is not included, assemble it from "
+			"6502_functional_test.a65 or fetch bin_files/6502_functional_test.bin" << std::endl;
+		return 2;
+	}
+
+	// The test does not go through the reset vector, so start it by hand
+	bus.cpu.reset();
+	do
+	{
+		bus.cpu.clock();
+	}
+	while (!bus.cpu.complete());
+	bus.cpu.pc = nStart;
+
+	uint64_t nCycles0 = bus.cpu.GetClockCount();
+	uint64_t nInstr0 = bus.cpu.GetInstructionCount();
+	uint16_t nLastPC = 0;
+	bool bTrapped = false;
+
+	auto tp1 = std::chrono::steady_clock::now();
+	while (bus.cpu.GetClockCount() - nCycles0 < MAX_CYCLES)
+	{
+		nLastPC = bus.cpu.pc;
+		do
+		{
+			bus.cpu.clock();
+		}
+		while (!bus.cpu.complete());
+
+		// An instruction that leaves PC where it was is a trap
+		if (bus.cpu.pc == nLastPC)
+		{
+			bTrapped = true;
+			break;
+		}
+	}
+	auto tp2 = std::chrono::steady_clock::now();
+
+	double dSeconds = std::chrono::duration<double>(tp2 - tp1).count();
+	uint64_t nCycles = bus.cpu.GetClockCount() - nCycles0;
+	uint64_t nInstr = bus.cpu.GetInstructionCount() - nInstr0;
+	bool bPassed = bTrapped && nLastPC == nSuccess;
+
+	char sLine[128];
+	if (bPassed)
+		snprintf(sLine, sizeof(sLine), "PASS: success trap at $%04X", nLastPC);
+	else if (bTrapped)
+		snprintf(sLine, sizeof(sLine), "FAIL: trapped at $%04X, expected $%04X", nLastPC, nSuccess);
+	else
+		snprintf(sLine, sizeof(sLine), "FAIL: no trap after %llu cycles, PC $%04X", (unsigned long long)nCycles, bus.cpu.pc);
+	std::cout << sLine << std::endl;
+
+	snprintf(sLine, sizeof(sLine), "%llu cycles, %llu instructions in %.3fs",
+		(unsigned long long)nCycles, (unsigned long long)nInstr, dSeconds);
+	std::cout << sLine << std::endl;
+
+	if (dSeconds > 0.0)
+	{
+		snprintf(sLine, sizeof(sLine), "%.2f emulated MHz, %.2f million instructions/s",
+			nCycles / dSeconds / 1e6, nInstr / dSeconds / 1e6);
+		std::cout << sLine << std::endl;
+	}
+
+	return bPassed ? 0 : 1;
+}
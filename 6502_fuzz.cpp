@@ -0,0 +1,525 @@
+/*
+	6502_fuzz - Coverage guided fuzzing of 6502 programs
+
+	A firmware image is loaded into RAM and the routine under test is
+	called at "entry" with each fuzz input copied into RAM at "input".
+	Coverage comes from the core's edge map (olc6502::coverage), which
+	counts every branch, jump, call, return and interrupt. A run ends when
+	the routine returns, or after "budget" instructions. It is a crash if
+	execution reaches one of the "crash" addresses, e.g. the firmware's
+	panic handler, or writes to one of the "crash-write" addresses.
+
+	Between inputs the machine is put back to a snapshot taken just before
+	the routine is called. Only the pages whose write generation has moved
+	since then are copied back, so a run that touches a few pages costs a
+	few hundred bytes to undo rather than 64KB.
+
+	The same file builds two ways:
+
+	With libFuzzer, where the edge map is placed in libFuzzer's extra
+	counters section so it drives libFuzzer's own corpus:
+
+		make libfuzzer
+		./6502_libfuzzer --image=fw.bin --entry=8000 --input=0200:256 CORPUS_DIR
+
+	Standalone, with a small built-in mutational fuzzer using the same map:
+
+		make fuzz
+		./6502_fuzz --image=fw.bin --entry=8000 --input=0200:256 [--runs=N] [SEED ...]
+		./6502_fuzz --image=fw.bin --entry=8000 --repro crash-1234
+
+	Options take the --name=value form, which libFuzzer leaves alone.
+	Addresses are hex, counts are decimal:
+
+		--image=FILE          firmware image: raw, PRG, Intel HEX or S-record
+		--load=ADDR           where a raw image is loaded (default 0000)
+		--entry=ADDR          routine to call (default: the reset vector, or
+		                      the image's entry point if it has none)
+		--input=ADDR[:MAX]    where inputs are copied, and the most bytes
+		                      copied (default 0200:256)
+		--length=ADDR         also store the input's length here, 16-bit
+		--budget=N            instructions per run (default 100000)
+		--crash=ADDR          executing this address is a crash (repeatable)
+		--crash-write=ADDR    writing this address is a crash (repeatable)
+
+	Standalone only:
+
+		--runs=N              inputs to run (default 1000000, 0 for no limit)
+		--seed=N              random seed
+		--repro               run each FILE once and report, instead of fuzzing
+
+	The routine is called as if by a JSR ending at $FFFE, so its RTS lands
+	on $FFFF, which is where a run is considered to have returned.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Bus.h"
+#include "olc6502.h"
+#include "Loader.h"
+
+#ifdef USE_LIBFUZZER
+// libFuzzer treats everything in this section as extra coverage counters
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t coverage_map[olc6502::COVERAGE_SIZE];
+
+static const uint16_t EXIT_ADDR = 0xFFFF;
+
+struct CONFIG
+{
+	std::string sImage;
+	uint16_t nLoad = 0x0000;
+	int32_t  nEntry = -1;
+	uint16_t nInput = 0x0200;
+	uint32_t nInputMax = 256;
+	int32_t  nLength = -1;
+	uint64_t nBudget = 100000;
+	std::vector<uint16_t> crash, crash_write;
+
+	uint64_t nRuns = 1000000;
+	uint32_t nSeed = 0;
+	bool     bRepro = false;
+	std::vector<std::string> files;
+};
+
+class Harness
+{
+public:
+	enum RESULT
+	{
+		RESULT_RETURNED,	// The routine returned
+		RESULT_BUDGET,		// Still running when the budget ran out
+		RESULT_CRASH,
+	};
+
+	bool Setup(const CONFIG &c)
+	{
+		config = c;
+
+		Loader loader;
+		loader.ConnectBus(&bus);
+		loader.nRawAddr = c.nLoad;
+		if (!loader.Load(c.sImage))
+		{
+			std::cerr << "Error loading " << c.sImage << ": " << loader.Error() << std::endl;
+			return false;
+		}
+
+		if (config.nInput + config.nInputMax > 0x10000)
+			config.nInputMax = 0x10000 - config.nInput;
+
+		for (auto addr : c.crash)
+			bus.bp.Set(addr, Breakpoints::EXEC);
+		for (auto addr : c.crash_write)
+			bus.bp.Set(addr, Breakpoints::WRITE);
+
+		// As if called by a JSR ending at $FFFE, so RTS returns to EXIT_ADDR
+		olc6502 &cpu = bus.cpu;
+		cpu.a = cpu.x = cpu.y = 0x00;
+		cpu.status = olc6502::U | olc6502::I;
+		cpu.stkp = 0xFD;
+		bus.ram[0x01FF] = (EXIT_ADDR - 1) >> 8;
+		bus.ram[0x01FE] = (EXIT_ADDR - 1) & 0xFF;
+		cpu.pc = c.nEntry >= 0 ? (uint16_t)c.nEntry : bus.ram[0xFFFC] | (bus.ram[0xFFFD] << 8);
+		cpu.coverage = coverage_map;
+
+		cpu.SaveState(snap_cpu);
+		snap_ram = bus.ram;
+		snap_gen = bus.page_gen;
+		return true;
+	}
+
+	RESULT Execute(const uint8_t *data, size_t size)
+	{
+		Restore();
+
+		size_t n = size < config.nInputMax ? size : config.nInputMax;
+		if (n > 0)
+		{
+			memcpy(&bus.ram[config.nInput], data, n);
+			for (uint32_t p = config.nInput >> 8; p <= (config.nInput + n - 1) >> 8; p++)
+				bus.page_gen[p]++;
+		}
+		if (config.nLength >= 0)
+		{
+			bus.write((uint16_t)config.nLength, n & 0xFF);
+			bus.write((uint16_t)(config.nLength + 1), (n >> 8) & 0xFF);
+		}
+
+		memset(coverage_map, 0, sizeof(coverage_map));
+		bus.cpu.ResetCoverage();
+		bus.bp.hit = Breakpoints::NONE;
+
+		olc6502 &cpu = bus.cpu;
+		for (uint64_t i = 0; i < config.nBudget; i++)
+		{
+			if (cpu.pc == EXIT_ADDR)
+				return RESULT_RETURNED;
+
+			do
+			{
+				cpu.clock();
+			}
+			while (!cpu.complete());
+
+			if (bus.bp.hit != Breakpoints::NONE)
+				return RESULT_CRASH;
+		}
+		return RESULT_BUDGET;
+	}
+
+	// What the last crash was
+	void Describe(FILE *f) const
+	{
+		fprintf(f, "%s at $%04X, PC $%04X\n", bus.bp.hit == Breakpoints::EXEC ? "executed" : "wrote",
+			bus.bp.hit_addr, bus.cpu.pc);
+	}
+
+private:
+	Bus bus;
+	CONFIG config;
+	olc6502::STATE snap_cpu;
+	std::array<uint8_t, 64 * 1024> snap_ram;
+	std::array<uint32_t, 256> snap_gen;
+
+	// Copies back only the pages written since the snapshot, then takes
+	// their current generations as the new baseline, so the counts keep
+	// going up for anything else watching them
+	void Restore()
+	{
+		for (int p = 0; p < 256; p++)
+		{
+			if (bus.page_gen[p] != snap_gen[p])
+			{
+				memcpy(&bus.ram[p << 8], &snap_ram[p << 8], 256);
+				snap_gen[p] = ++bus.page_gen[p];
+			}
+		}
+		bus.cpu.LoadState(snap_cpu);
+	}
+};
+
+static bool ParseHex(const std::string &s, uint32_t nMax, uint32_t &n)
+{
+	char *end = nullptr;
+	unsigned long v = strtoul(s.c_str(), &end, 16);
+	if (s.empty() || *end != '\0' || v > nMax)
+		return false;
+	n = (uint32_t)v;
+	return true;
+}
+
+// Reads the --name=value options. Anything else is left for libFuzzer, or
+// taken as a file when standalone
+static bool ParseArgs(int argc, char **argv, CONFIG &c)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string sArg = argv[i];
+		if (sArg.compare(0, 2, "--") != 0)
+		{
+			c.files.push_back(sArg);
+			continue;
+		}
+
+		size_t eq = sArg.find('=');
+		std::string sName = sArg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+		std::string sValue = eq == std::string::npos ? "" : sArg.substr(eq + 1);
+		uint32_t n = 0;
+		bool ok = true;
+
+		if (sName == "image")
+			c.sImage = sValue;
+		else if (sName == "load")
+			ok = ParseHex(sValue, 0xFFFF, n), c.nLoad = n;
+		else if (sName == "entry")
+			ok = ParseHex(sValue, 0xFFFF, n), c.nEntry = n;
+		else if (sName == "length")
+			ok = ParseHex(sValue, 0xFFFE, n), c.nLength = n;
+		else if (sName == "crash")
+			ok = ParseHex(sValue, 0xFFFF, n), c.crash.push_back(n);
+		else if (sName == "crash-write")
+			ok = ParseHex(sValue, 0xFFFF, n), c.crash_write.push_back(n);
+		else if (sName == "input")
+		{
+			size_t colon = sValue.find(':');
+			ok = ParseHex(sValue.substr(0, colon), 0xFFFF, n);
+			c.nInput = n;
+			if (colon != std::string::npos)
+				c.nInputMax = strtoul(sValue.c_str() + colon + 1, nullptr, 10);
+		}
+		else if (sName == "budget")
+			c.nBudget = strtoull(sValue.c_str(), nullptr, 10);
+		else if (sName == "runs")
+			c.nRuns = strtoull(sValue.c_str(), nullptr, 10);
+		else if (sName == "seed")
+			c.nSeed = strtoul(sValue.c_str(), nullptr, 10);
+		else if (sName == "repro")
+			c.bRepro = true;
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			std::cerr << "Bad option " << sArg << std::endl;
+			return false;
+		}
+	}
+
+	if (c.sImage.empty())
+	{
+		std::cerr << "No --image given" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static Harness harness;
+
+static bool Init(int argc, char **argv, CONFIG &c)
+{
+	if (!ParseArgs(argc, argv, c))
+		return false;
+	return harness.Setup(c);
+}
+
+
+
+#ifdef USE_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	CONFIG c;
+	if (!Init(*argc, *argv, c))
+		exit(2);
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (harness.Execute(data, size) == Harness::RESULT_CRASH)
+	{
+		harness.Describe(stderr);
+		abort();
+	}
+	return 0;
+}
+
+#else
+
+// AFL's hit count buckets. An edge only counts as new coverage when its
+// count moves into a bucket not seen before, so loops going round a few
+// more times don't flood the corpus
+static uint8_t Bucket(uint8_t n)
+{
+	if (n <= 2) return n;
+	if (n == 3) return 4;
+	if (n <= 7) return 8;
+	if (n <= 15) return 16;
+	if (n <= 31) return 32;
+	if (n <= 127) return 64;
+	return 128;
+}
+
+class Fuzzer
+{
+public:
+	Fuzzer(uint32_t nSeed, size_t nMaxLen) : rng(nSeed), nMax(nMaxLen ? nMaxLen : 1)
+	{
+		for (int i = 0; i < 256; i++)
+			bucket[i] = Bucket((uint8_t)i);
+		seen.fill(0);
+	}
+
+	// Folds the last run's map into what has been seen. True if anything new
+	bool NewCoverage()
+	{
+		bool bNew = false;
+		const uint64_t *words = (const uint64_t*)coverage_map;
+		for (size_t w = 0; w < sizeof(coverage_map) / 8; w++)
+		{
+			if (words[w] == 0)
+				continue;
+			for (size_t i = w * 8; i < w * 8 + 8; i++)
+			{
+				uint8_t b = bucket[coverage_map[i]];
+				if (b & ~seen[i])
+				{
+					if (seen[i] == 0)
+						nEdges++;
+					seen[i] |= b;
+					bNew = true;
+				}
+			}
+		}
+		return bNew;
+	}
+
+	void Mutate(std::vector<uint8_t> &v)
+	{
+		int nOps = 1 << (rng() % 4);
+		for (int i = 0; i < nOps; i++)
+		{
+			size_t pos = v.empty() ? 0 : rng() % v.size();
+			switch (rng() % 7)
+			{
+			case 0: if (!v.empty()) v[pos] ^= 1 << (rng() % 8); break;
+			case 1: if (!v.empty()) v[pos] = (uint8_t)rng(); break;
+			case 2: if (!v.empty()) v[pos] = INTERESTING[rng() % sizeof(INTERESTING)]; break;
+			case 3: if (!v.empty()) v[pos] += (uint8_t)(rng() % 33) - 16; break;
+			case 4: if (v.size() < nMax) v.insert(v.begin() + pos, (uint8_t)rng()); break;
+			case 5: if (v.size() > 1) v.erase(v.begin() + pos); break;
+			case 6:
+				// Splice in part of another corpus entry
+				if (!corpus.empty() && !v.empty())
+				{
+					const std::vector<uint8_t> &o = corpus[rng() % corpus.size()];
+					if (!o.empty())
+					{
+						size_t from = rng() % o.size();
+						size_t len = std::min(o.size() - from, v.size() - pos);
+						std::copy(o.begin() + from, o.begin() + from + len, v.begin() + pos);
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	std::vector<std::vector<uint8_t>> corpus;
+	size_t nEdges = 0;
+	std::mt19937 rng;
+
+private:
+	static constexpr uint8_t INTERESTING[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, 0x10, 0x20, 0x40, 0x0A, 0x0D };
+	size_t nMax;
+	uint8_t bucket[256];
+	std::array<uint8_t, olc6502::COVERAGE_SIZE> seen;
+};
+
+constexpr uint8_t Fuzzer::INTERESTING[];
+
+static bool ReadFile(const std::string &sFile, std::vector<uint8_t> &v)
+{
+	std::ifstream file(sFile, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	v.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static void WriteFile(const std::string &sFile, const std::vector<uint8_t> &v)
+{
+	std::ofstream file(sFile, std::ios::out | std::ios::binary);
+	file.write((const char*)v.data(), v.size());
+}
+
+int main(int argc, char* argv[])
+{
+	CONFIG c;
+	if (!Init(argc, argv, c))
+		return 2;
+
+	if (c.bRepro)
+	{
+		int nCrashes = 0;
+		for (auto &sFile : c.files)
+		{
+			std::vector<uint8_t> v;
+			if (!ReadFile(sFile, v))
+			{
+				std::cerr << "Error reading " << sFile << std::endl;
+				return 2;
+			}
+			Harness::RESULT r = harness.Execute(v.data(), v.size());
+			printf("%s: ", sFile.c_str());
+			if (r == Harness::RESULT_CRASH)
+			{
+				harness.Describe(stdout);
+				nCrashes++;
+			}
+			else
+				printf("%s\n", r == Harness::RESULT_RETURNED ? "returned" : "budget exhausted");
+		}
+		return nCrashes ? 1 : 0;
+	}
+
+	Fuzzer fuzzer(c.nSeed, c.nInputMax);
+	for (auto &sFile : c.files)
+	{
+		std::vector<uint8_t> v;
+		if (!ReadFile(sFile, v))
+		{
+			std::cerr << "Error reading " << sFile << std::endl;
+			return 2;
+		}
+		harness.Execute(v.data(), v.size());
+		fuzzer.NewCoverage();
+		fuzzer.corpus.push_back(v);
+	}
+	if (fuzzer.corpus.empty())
+	{
+		fuzzer.corpus.push_back({ 0x00 });
+		harness.Execute(fuzzer.corpus[0].data(), 1);
+		fuzzer.NewCoverage();
+	}
+
+	auto tpStart = std::chrono::steady_clock::now();
+	auto tpReport = tpStart;
+	uint64_t nRun = 0;
+
+	auto report = [&](const char *sWhy)
+	{
+		double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+		printf("#%llu %s edges: %zu corpus: %zu exec/s: %.0f\n", (unsigned long long)nRun, sWhy,
+			fuzzer.nEdges, fuzzer.corpus.size(), dSeconds > 0.0 ? nRun / dSeconds : 0.0);
+		fflush(stdout);
+	};
+
+	std::vector<uint8_t> input;
+	while (c.nRuns == 0 || nRun < c.nRuns)
+	{
+		input = fuzzer.corpus[fuzzer.rng() % fuzzer.corpus.size()];
+		fuzzer.Mutate(input);
+		Harness::RESULT r = harness.Execute(input.data(), input.size());
+		nRun++;
+
+		if (r == Harness::RESULT_CRASH)
+		{
+			std::string sFile = "crash-" + std::to_string(nRun);
+			WriteFile(sFile, input);
+			report("CRASH");
+			printf("%s: ", sFile.c_str());
+			harness.Describe(stdout);
+			return 1;
+		}
+
+		if (fuzzer.NewCoverage())
+		{
+			fuzzer.corpus.push_back(input);
+			report("NEW");
+		}
+
+		if ((nRun & 0xFFF) == 0 && std::chrono::steady_clock::now() - tpReport > std::chrono::seconds(2))
+		{
+			tpReport = std::chrono::steady_clock::now();
+			report("PULSE");
+		}
+	}
+
+	report("DONE");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+	6502_lockstep - Runs olc6502 and an independent reference core side by
+	side and stops at the first instruction where they disagree
+
+		make lockstep
+		./6502_lockstep [OPTIONS] IMAGE [START]
+		./6502_lockstep [OPTIONS] --random SEEDS
+
+	IMAGE is loaded at $0000 and run from START (hex), or from the reset
+	vector if no START is given. With --random, each seed from 1 to SEEDS
+	fills memory with random bytes drawn from the documented opcodes, so
+	whatever is executed is documented too, and runs from a random address.
+	With --undocumented as well, the bytes are drawn from every opcode but
+	KIL.
+
+	Options:
+		-n INSTRUCTIONS  how many to run, per seed with --random (default 1000000)
+		-k K             instructions of history to print on divergence (default 32)
+		--no-decimal     compare the 2A03, both cores ignoring the D flag
+		--undocumented   the reference core executes undocumented opcodes too
+		--symbols FILE   label file naming addresses in the report, see Symbols.h
+
+	The exit code is 0 if the cores agreed throughout, 1 if they diverged
+	and 2 if the run could not be done.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Bus.h"
+#include "olc6502.h"
+#include "Ref6502.h"
+#include "Symbols.h"
+#include "Lockstep.h"
+
+typedef std::array<uint8_t, 64 * 1024> IMAGE;
+
+// olc6502 on a Bus, with the bus recording its writes. The variant is
+// picked at run time, so this has its own CPU rather than the bus's
+template <typename VARIANT>
+class OlcCore
+{
+public:
+	OlcCore() { cpu.ConnectBus(&bus); bus.write_log = &writes; }
+
+	const char* Name() const { return "olc6502"; }
+
+	void Load(const IMAGE &image) { bus.ram = image; }
+
+	// Through LoadState(), which also wakes a CPU jammed by the last run
+	void SetState(const LOCKSTEP_STATE &s)
+	{
+		typename olc6502_t<VARIANT>::STATE st;
+		st.a = s.a; st.x = s.x; st.y = s.y;
+		st.stkp = s.stkp; st.status = s.status; st.pc = s.pc;
+		cpu.LoadState(st);
+		nCycles = s.cycles;
+	}
+
+	LOCKSTEP_STATE State() const
+	{
+		LOCKSTEP_STATE s;
+		s.a = cpu.a; s.x = cpu.x; s.y = cpu.y;
+		s.stkp = cpu.stkp; s.status = cpu.status; s.pc = cpu.pc;
+		s.cycles = nCycles;
+		return s;
+	}
+
+	bool Step()
+	{
+		writes.clear();
+		uint64_t nStart = cpu.GetClockCount();
+		cpu.step();
+		nCycles += cpu.GetClockCount() - nStart;
+		return true;
+	}
+
+	const std::vector<Bus::WRITE>& Writes() const { return writes; }
+	uint8_t Peek(uint16_t addr) const { return bus.peek(addr); }
+
+private:
+	Bus bus;
+	olc6502_t<VARIANT> cpu;
+	std::vector<Bus::WRITE> writes;
+	uint64_t nCycles = 0;
+};
+
+class RefCore
+{
+public:
+	const char* Name() const { return "ref6502"; }
+
+	void Load(const IMAGE &image) { cpu.mem = image; }
+
+	void SetState(const LOCKSTEP_STATE &s)
+	{
+		cpu.a = s.a; cpu.x = s.x; cpu.y = s.y;
+		cpu.stkp = s.stkp; cpu.status = s.status; cpu.pc = s.pc;
+		cpu.cycles = s.cycles;
+	}
+
+	LOCKSTEP_STATE State() const
+	{
+		LOCKSTEP_STATE s;
+		s.a = cpu.a; s.x = cpu.x; s.y = cpu.y;
+		s.stkp = cpu.stkp; s.status = cpu.status; s.pc = cpu.pc;
+		s.cycles = cpu.cycles;
+		return s;
+	}
+
+	bool Step() { return cpu.Step(); }
+
+	const std::vector<Bus::WRITE>& Writes() const { return cpu.writes; }
+	uint8_t Peek(uint16_t addr) const { return cpu.mem[addr]; }
+
+	Ref6502 cpu;
+};
+
+static bool LoadImage(IMAGE &image, const char *fileName)
+{
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	image.fill(0x00);
+	file.read((char*)image.data(), image.size());
+	return file.gcount() > 0;
+}
+
+static void RandomImage(IMAGE &image, LOCKSTEP_STATE &s, uint32_t nSeed, bool bUndocumented)
+{
+	std::vector<uint8_t> opcodes;
+	olc6502_t<NMOS6502> cpu;
+	for (int op = 0x00; op <= 0xFF; op++)
+	{
+		olc6502_t<NMOS6502>::OPCODEINFO info = cpu.GetOpcodeInfo((uint8_t)op);
+		if (info.bDocumented || (bUndocumented && info.name != "KIL"))
+			opcodes.push_back((uint8_t)op);
+	}
+
+	std::mt19937 rng(nSeed);
+	for (auto &b : image)
+		b = opcodes[rng() % opcodes.size()];
+
+	s = LOCKSTEP_STATE();
+	s.pc = (uint16_t)rng();
+	s.a = (uint8_t)rng(); s.x = (uint8_t)rng(); s.y = (uint8_t)rng();
+	s.stkp = (uint8_t)rng();
+	s.status = ((uint8_t)rng() | Ref6502::U) & ~Ref6502::B;
+}
+
+struct OPTIONS
+{
+	uint64_t nInstructions = 1000000;
+	size_t nHistory = 32;
+	uint32_t nSeeds = 0;
+	const char *sImage = nullptr;
+	const char *sStart = nullptr;
+	bool bUndocumented = false;
+	const char *sSymbols = nullptr;
+};
+
+template <typename VARIANT>
+static int Compare(const OPTIONS &opt)
+{
+	typedef Lockstep<OlcCore<VARIANT>, RefCore> LOCKSTEP;
+
+	OlcCore<VARIANT> olc;
+	RefCore ref;
+	ref.cpu.bDecimal = VARIANT::bDecimal;
+	ref.cpu.bUndocumented = opt.bUndocumented;
+	LOCKSTEP lockstep(olc, ref, opt.nHistory);
+
+	Symbols symbols;
+	if (opt.sSymbols)
+	{
+		if (!symbols.Load(opt.sSymbols))
+		{
+			std::cerr << "Error reading " << opt.sSymbols << std::endl;
+			return 2;
+		}
+		lockstep.symbols = &symbols;
+	}
+
+	IMAGE image;
+	LOCKSTEP_STATE start;
+	uint64_t nTotal = 0;
+	auto tp1 = std::chrono::steady_clock::now();
+
+	for (uint32_t nSeed = 1; nSeed <= (opt.nSeeds ? opt.nSeeds : 1); nSeed++)
+	{
+		if (opt.nSeeds)
+		{
+			RandomImage(image, start, nSeed, opt.bUndocumented);
+		}
+		else
+		{
+			if (!LoadImage(image, opt.sImage))
+			{
+				std::cerr << "Error reading " << opt.sImage << std::endl;
+				return 2;
+			}
+			start.pc = opt.sStart ? (uint16_t)strtoul(opt.sStart, nullptr, 16) : image[0xFFFC] | (image[0xFFFD] << 8);
+		}
+
+		lockstep.Start(image, start);
+		auto result = lockstep.Run(opt.nInstructions);
+		nTotal += lockstep.Instructions();
+
+		if (result == LOCKSTEP::RESULT_OK)
+			continue;
+
+		if (opt.nSeeds)
+			printf("Seed %u:\n", nSeed);
+		lockstep.Report(stdout);
+
+		// Random memory can have undocumented opcodes written into it, which
+		// just ends that seed
+		if (result == LOCKSTEP::RESULT_DIVERGED || !opt.nSeeds)
+			return result == LOCKSTEP::RESULT_DIVERGED ? 1 : 2;
+		printf("\n");
+	}
+
+	auto tp2 = std::chrono::steady_clock::now();
+	double dSeconds = std::chrono::duration<double>(tp2 - tp1).count();
+	printf("%s: %llu instructions in lockstep, no divergence (%.2f million/s)\n", VARIANT::name,
+		(unsigned long long)nTotal, dSeconds > 0.0 ? nTotal / dSeconds / 1e6 : 0.0);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	OPTIONS opt;
+	bool bDecimal = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bValue = i + 1 < argc;
+		if (bValue && strcmp(argv[i], "-n") == 0)
+			opt.nInstructions = strtoull(argv[++i], nullptr, 10);
+		else if (bValue && strcmp(argv[i], "-k") == 0)
+			opt.nHistory = strtoul(argv[++i], nullptr, 10);
+		else if (bValue && strcmp(argv[i], "--random") == 0)
+			opt.nSeeds = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--no-decimal") == 0)
+			bDecimal = false;
+		else if (bValue && strcmp(argv[i], "--symbols") == 0)
+			opt.sSymbols = argv[++i];
+		else if (strcmp(argv[i], "--undocumented") == 0)
+			opt.bUndocumented = true;
+		else if (argv[i][0] != '-' && opt.sImage == nullptr)
+			opt.sImage = argv[i];
+		else if (argv[i][0] != '-' && opt.sStart == nullptr)
+			opt.sStart = argv[i];
+		else
+			opt.sImage = opt.sStart = nullptr, opt.nSeeds = 0, i = argc;
+	}
+
+	if ((opt.sImage == nullptr) == (opt.nSeeds == 0))
+	{
+		std::cerr << "Usage: " << argv[0] << " [-n INSTRUCTIONS] [-k K] [--no-decimal] [--undocumented] [--symbols FILE] IMAGE [START]" << std::endl;
+		std::cerr << "       " << argv[0] << " [-n INSTRUCTIONS] [-k K] [--no-decimal] [--undocumented] [--symbols FILE] --random SEEDS" << std::endl;
+		return 2;
+	}
+
+	return bDecimal ? Compare<NMOS6502>(opt) : Compare<RP2A03>(opt);
+}
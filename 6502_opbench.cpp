@@ -0,0 +1,284 @@
+/*
+	6502_opbench - Per-opcode microbenchmark for the olc6502 core
+
+	For every documented opcode in the translation table, a loop is built
+	in RAM that repeats the instruction many times and then jumps back to
+	the start. The loop is run for a fixed number of instructions and the
+	host time per instruction is reported, so a change to the core can be
+	checked for handlers that got slower.
+
+	Operands are chosen so every copy of an instruction does the same work
+	each time round: zero page operands are $80, absolute ones $0300, every
+	zero page pointer points at $0202, branches have an offset of 0 and so
+	land on the next instruction whether taken or not, and JMP goes to the
+	next instruction. A few instructions can not be repeated on their own,
+	so they share a loop with their partner and report the time of the
+	pair: JSR with RTS, and BRK with RTI. Every timing includes one JMP in
+	each REPEAT + 1 instructions for the loop itself.
+
+		make opbench
+		./6502_opbench [-n INSTRUCTIONS] [-r RUNS] [--csv FILE] [--json FILE]
+
+	Each opcode is run "RUNS" times and the fastest run is kept, which
+	filters out most of the noise from the host.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "Bus.h"
+#include "olc6502.h"
+
+// Copies of the instruction in each loop
+static const int REPEAT = 64;
+
+static const uint16_t CODE       = 0x1000;
+static const uint16_t DATA       = 0x0300;
+static const uint16_t ZP         = 0x80;
+static const uint16_t JMP_TABLE  = 0x0500;	// Pointers for JMP (ind)
+static const uint16_t RTI_ADDR   = 0x0600;	// BRK/IRQ/NMI handler
+static const uint16_t RTS_ADDR   = 0x0610;	// JSR target
+
+struct RESULT
+{
+	uint8_t  opcode = 0x00;
+	olc6502::OPCODEINFO info;
+	std::string loop;			// Instructions sharing the loop, if any
+	uint64_t instructions = 0;
+	uint64_t cycles = 0;
+	double   ns_per_instruction = 0.0;
+};
+
+// Builds the loop for one opcode at CODE
+static void BuildLoop(Bus &bus, uint8_t nOpcode, const olc6502::OPCODEINFO &info)
+{
+	auto &ram = bus.ram;
+	std::fill(ram.begin(), ram.end(), 0x55);
+	std::fill(ram.begin(), ram.begin() + 0x100, 0x02);
+
+	ram[RTI_ADDR] = 0x40;	// RTI
+	ram[RTS_ADDR] = 0x60;	// RTS
+	ram[0xFFFA] = RTI_ADDR & 0xFF; ram[0xFFFB] = RTI_ADDR >> 8;
+	ram[0xFFFC] = CODE & 0xFF;     ram[0xFFFD] = CODE >> 8;
+	ram[0xFFFE] = RTI_ADDR & 0xFF; ram[0xFFFF] = RTI_ADDR >> 8;
+
+	uint16_t addr = CODE;
+	for (int i = 0; i < REPEAT; i++)
+	{
+		uint16_t next = addr + info.bytes;
+		uint16_t operand = 0x0000;
+
+		switch (info.mode)
+		{
+		case olc6502::AM_IMM: operand = 0x55; break;
+		case olc6502::AM_ZP0:
+		case olc6502::AM_ZPX:
+		case olc6502::AM_ZPY:
+		case olc6502::AM_IZX:
+		case olc6502::AM_IZY:
+		case olc6502::AM_IZP:
+		case olc6502::AM_ZPR: operand = ZP; break;	// BBR/BBS: offset 0
+		case olc6502::AM_REL: operand = 0x00; break;
+		case olc6502::AM_ABX:
+		case olc6502::AM_ABY: operand = DATA; break;
+		case olc6502::AM_ABS:
+			if (info.name == "JMP")
+				operand = next;
+			else if (info.name == "JSR")
+				operand = RTS_ADDR;
+			else
+				operand = DATA;
+			break;
+		case olc6502::AM_IND:
+		case olc6502::AM_IAX:	// X is always 0
+			operand = JMP_TABLE + i * 2;
+			ram[operand] = next & 0xFF;
+			ram[operand + 1] = next >> 8;
+			break;
+		default:
+			break;
+		}
+
+		ram[addr] = nOpcode;
+		if (info.bytes > 1) ram[addr + 1] = operand & 0xFF;
+		if (info.bytes > 2) ram[addr + 2] = operand >> 8;
+		addr = next;
+	}
+
+	// JMP CODE
+	ram[addr] = 0x4C;
+	ram[addr + 1] = CODE & 0xFF;
+	ram[addr + 2] = CODE >> 8;
+}
+
+// Runs whole instructions until nInstructions more have started
+static void Run(olc6502 &cpu, uint64_t nInstructions)
+{
+	uint64_t nEnd = cpu.GetInstructionCount() + nInstructions;
+	while (cpu.GetInstructionCount() < nEnd)
+	{
+		do
+		{
+			cpu.clock();
+		}
+		while (!cpu.complete());
+	}
+}
+
+static RESULT Measure(uint8_t nOpcode, const olc6502::OPCODEINFO &info, uint64_t nInstructions, int nRuns)
+{
+	// RTS and RTI need something to return from, so they are measured with
+	// JSR and BRK, which then report the same loop
+	uint8_t nLoopOpcode = nOpcode;
+	RESULT r;
+	r.opcode = nOpcode;
+	r.info = info;
+	if (info.name == "JSR" || info.name == "RTS") { nLoopOpcode = 0x20; r.loop = "JSR/RTS"; }
+	if (info.name == "BRK" || info.name == "RTI") { nLoopOpcode = 0x00; r.loop = "BRK/RTI"; }
+
+	Bus bus;
+	BuildLoop(bus, nLoopOpcode, bus.cpu.GetOpcodeInfo(nLoopOpcode));
+	bus.cpu.reset();
+	do
+	{
+		bus.cpu.clock();
+	}
+	while (!bus.cpu.complete());
+
+	// Warm the caches and branch predictors up before timing
+	Run(bus.cpu, nInstructions / 10 + 1);
+
+	double dBest = 0.0;
+	for (int i = 0; i < nRuns; i++)
+	{
+		uint64_t nCycles0 = bus.cpu.GetClockCount();
+		uint64_t nInstr0 = bus.cpu.GetInstructionCount();
+
+		auto tp1 = std::chrono::steady_clock::now();
+		Run(bus.cpu, nInstructions);
+		auto tp2 = std::chrono::steady_clock::now();
+
+		double dSeconds = std::chrono::duration<double>(tp2 - tp1).count();
+		if (i == 0 || dSeconds < dBest)
+		{
+			dBest = dSeconds;
+			r.cycles = bus.cpu.GetClockCount() - nCycles0;
+			r.instructions = bus.cpu.GetInstructionCount() - nInstr0;
+		}
+	}
+
+	r.ns_per_instruction = r.instructions ? dBest * 1e9 / r.instructions : 0.0;
+	return r;
+}
+
+static bool WriteCSV(const char *fileName, const std::vector<RESULT> &results)
+{
+	FILE *f = fopen(fileName, "w");
+	if (f == nullptr)
+		return false;
+
+	fprintf(f, "opcode,name,mode,loop,instructions,cycles,ns_per_instruction\n");
+	for (auto &r : results)
+	{
+		fprintf(f, "0x%02X,%s,%s,%s,%llu,%llu,%.3f\n", r.opcode, r.info.name.c_str(),
+			olc6502::AddrModeName(r.info.mode), r.loop.c_str(),
+			(unsigned long long)r.instructions, (unsigned long long)r.cycles, r.ns_per_instruction);
+	}
+	return fclose(f) == 0;
+}
+
+static bool WriteJSON(const char *fileName, const std::vector<RESULT> &results, double dGeoMean)
+{
+	FILE *f = fopen(fileName, "w");
+	if (f == nullptr)
+		return false;
+
+	fprintf(f, "{\n  \"geomean_ns_per_instruction\": %.3f,\n  \"opcodes\": [\n", dGeoMean);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const RESULT &r = results[i];
+		fprintf(f, "    { \"opcode\": %u, \"name\": \"%s\", \"mode\": \"%s\", \"loop\": \"%s\", "
+			"\"instructions\": %llu, \"cycles\": %llu, \"ns_per_instruction\": %.3f }%s\n",
+			r.opcode, r.info.name.c_str(), olc6502::AddrModeName(r.info.mode), r.loop.c_str(),
+			(unsigned long long)r.instructions, (unsigned long long)r.cycles, r.ns_per_instruction,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	return fclose(f) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t nInstructions = 1000000;
+	int nRuns = 5;
+	const char *sCSV = nullptr;
+	const char *sJSON = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bValue = i + 1 < argc;
+		if (bValue && strcmp(argv[i], "-n") == 0)
+			nInstructions = strtoull(argv[++i], nullptr, 10);
+		else if (bValue && strcmp(argv[i], "-r") == 0)
+			nRuns = atoi(argv[++i]);
+		else if (bValue && strcmp(argv[i], "--csv") == 0)
+			sCSV = argv[++i];
+		else if (bValue && strcmp(argv[i], "--json") == 0)
+			sJSON = argv[++i];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [-n INSTRUCTIONS] [-r RUNS] [--csv FILE] [--json FILE]" << std::endl;
+			return 1;
+		}
+	}
+
+	if (nInstructions == 0 || nRuns < 1)
+	{
+		std::cerr << "INSTRUCTIONS and RUNS must be at least 1" << std::endl;
+		return 1;
+	}
+
+	std::vector<RESULT> results;
+	double dLogSum = 0.0;
+	olc6502 cpu;
+
+	for (int op = 0x00; op <= 0xFF; op++)
+	{
+		olc6502::OPCODEINFO info = cpu.GetOpcodeInfo((uint8_t)op);
+		// WAI and STP stop the CPU, so there is nothing to time
+		if (!info.bDocumented || info.name == "WAI" || info.name == "STP")
+			continue;
+
+		RESULT r = Measure((uint8_t)op, info, nInstructions, nRuns);
+		results.push_back(r);
+		dLogSum += std::log(r.ns_per_instruction);
+
+		printf("$%02X %s %s %7.2f ns %5.2f cycles%s%s\n", r.opcode, r.info.name.c_str(),
+			olc6502::AddrModeName(r.info.mode), r.ns_per_instruction,
+			(double)r.cycles / r.instructions, r.loop.empty() ? "" : "  ", r.loop.c_str());
+	}
+
+	double dGeoMean = results.empty() ? 0.0 : std::exp(dLogSum / results.size());
+	printf("%zu opcodes, geometric mean %.2f ns/instruction\n", results.size(), dGeoMean);
+
+	if (sCSV && !WriteCSV(sCSV, results))
+	{
+		std::cerr << "Error writing " << sCSV << std::endl;
+		return 1;
+	}
+
+	if (sJSON && !WriteJSON(sJSON, results, dGeoMean))
+	{
+		std::cerr << "Error writing " << sJSON << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
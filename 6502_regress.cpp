@@ -0,0 +1,497 @@
+/*
+	6502_regress - Regression checks for the debugger, devices and fast
+	paths around the olc6502 core
+
+	Each check sets up a small situation on a Bus of its own, such as a
+	few instructions in RAM, and looks at the outcome. They need no images
+	and run in well under a second.
+
+		make regress
+		./6502_regress
+
+	Each failure is printed. The exit code is 0 if every check passed and
+	1 otherwise.
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "Bus.h"
+#include "olc6502.h"
+#include "Condition.h"
+#include "Rewind.h"
+#include "InputJournal.h"
+#include "Acia6551.h"
+#include "BankController.h"
+#include "Loader.h"
+#include "Assembler.h"
+
+static int nFailed = 0;
+
+// The opcode that stops the CPU until a reset: STP on a 65C02, KIL on
+// the others
+static const uint8_t OP_STOP = OLC6502_VARIANT::bCmos ? 0xDB : 0x02;
+
+static void Expect(bool bOk, const std::string &sWhat)
+{
+	if (!bOk)
+	{
+		std::cout << "FAIL: " << sWhat << std::endl;
+		nFailed++;
+	}
+}
+
+// Puts a program at nAddr and points the reset vector at it
+static void LoadProgram(Bus &bus, uint16_t nAddr, const std::vector<uint8_t> &prog)
+{
+	for (size_t i = 0; i < prog.size(); i++)
+		bus.ram[nAddr + i] = prog[i];
+	bus.ram[0xFFFC] = nAddr & 0xFF;
+	bus.ram[0xFFFD] = nAddr >> 8;
+	bus.cpu.reset();
+	bus.cpu.step();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CORE
+
+// Bugs the lockstep harness found in the core, which a faster path could
+// easily bring back
+
+// BRK skips its signature byte, so RTI comes back to BRK + 2, and the
+// status it pushes still has I as the program left it
+static void CheckBrk()
+{
+	Bus bus;
+
+	// CLI, BRK, signature, NOP. The handler looks at the status pushed
+	// with PLA, PHA, then returns
+	LoadProgram(bus, 0x0200, { 0x58, 0x00, 0xEA, 0xEA });
+	bus.ram[0x0300] = 0x68; bus.ram[0x0301] = 0x48; bus.ram[0x0302] = 0x40;
+	bus.ram[0xFFFE] = 0x00; bus.ram[0xFFFF] = 0x03;
+
+	bus.cpu.step();
+	bus.cpu.step();
+	Expect(bus.cpu.pc == 0x0300 && (bus.cpu.status & olc6502::I), "BRK enters its handler with I set");
+	bus.cpu.step();
+	Expect(!(bus.cpu.a & olc6502::I), "BRK pushes the status before setting I");
+	bus.cpu.step();
+	bus.cpu.step();
+	Expect(bus.cpu.pc == 0x0203, "BRK returns past its signature byte");
+}
+
+// The same for an IRQ, which must not leave interrupts disabled after RTI
+static void CheckIrqStatus()
+{
+	Bus bus;
+
+	// CLI, then NOPs
+	LoadProgram(bus, 0x0200, { 0x58, 0xEA, 0xEA, 0xEA });
+	bus.ram[0x0300] = 0x68; bus.ram[0x0301] = 0x48; bus.ram[0x0302] = 0x40;
+	bus.ram[0xFFFE] = 0x00; bus.ram[0xFFFF] = 0x03;
+
+	bus.cpu.step();
+	bus.cpu.irq();
+	bus.cpu.step();		// the interrupt's own cycles
+	bus.cpu.step();
+	Expect(bus.cpu.pc == 0x0301 && !(bus.cpu.a & olc6502::I), "IRQ pushes the status before setting I");
+	bus.cpu.step();
+	bus.cpu.step();
+	Expect(bus.cpu.pc == 0x0201 && !(bus.cpu.status & olc6502::I), "RTI from an IRQ enables interrupts again");
+}
+
+// JSR reads the high byte of its address after pushing the return address,
+// which shows when it runs from the stack page and the push overwrites it
+static void CheckJsrOrder()
+{
+	Bus bus;
+
+	// LDX #$F2, TXS, JMP $01F0, where JSR $0380 has its high byte where
+	// the return address' high byte, $01, is pushed
+	LoadProgram(bus, 0x0200, { 0xA2, 0xF2, 0x9A, 0x4C, 0xF0, 0x01 });
+	bus.ram[0x01F0] = 0x20; bus.ram[0x01F1] = 0x80; bus.ram[0x01F2] = 0x03;
+
+	for (int i = 0; i < 4; i++)
+		bus.cpu.step();
+	Expect(bus.cpu.pc == 0x0180, "JSR reads its high address byte after pushing");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CONDITIONS
+
+// The example from Condition.h, against CPU states either side of each term
+static void CheckConditions()
+{
+	Bus bus;
+	Condition c;
+	std::string sError;
+
+	Expect(c.Compile("PC == $8010 && A > $80 && [$0002] == 0", sError), "example condition compiles: " + sError);
+	Expect(c.HasAddress() && c.address() == 0x8010, "example condition applies at $8010");
+
+	bus.cpu.pc = 0x8010;
+	bus.cpu.a = 0x81;
+	bus.ram[0x0002] = 0x00;
+	Expect(c.Evaluate(bus), "example condition passes");
+
+	bus.cpu.a = 0x80;
+	Expect(!c.Evaluate(bus), "example condition fails with A == $80");
+	bus.cpu.a = 0x81;
+	bus.ram[0x0002] = 0x01;
+	Expect(!c.Evaluate(bus), "example condition fails with [$0002] != 0");
+	bus.ram[0x0002] = 0x00;
+	bus.cpu.pc = 0x8011;
+	Expect(!c.Evaluate(bus), "example condition fails away from $8010");
+
+	Expect(c.Evaluations() == 4 && c.Passes() == 1, "example condition evaluations counted");
+
+	// Precedence and the other operand forms
+	Condition d;
+	Expect(d.Compile("1 + 2 * 3 == 7 && (0x10 | %0001) == 17 && -1 < 0 && !Z", sError), "arithmetic condition compiles: " + sError);
+	Expect(!d.HasAddress(), "arithmetic condition has no address");
+	bus.cpu.status = 0x00;
+	Expect(d.Evaluate(bus), "arithmetic condition passes");
+
+	Condition e;
+	Expect(!e.Compile("PC == ", sError) && !sError.empty(), "incomplete condition is rejected");
+
+	// Overflow wraps, and the one division that traps on the host doesn't
+	Condition f;
+	Expect(f.Compile("(0-$7FFFFFFF-1)/(0-1) == 0-$7FFFFFFF-1 && (0-$7FFFFFFF-1)%(0-1) == 0 && 7/0 == 0 && 7%0 == 0", sError), "division condition compiles: " + sError);
+	Expect(f.Evaluate(bus), "division by -1 and 0 is defined");
+	Condition g;
+	Expect(g.Compile("$7FFFFFFF+1 == 0-$7FFFFFFF-1 && $10000*$10000 == 0 && -(0-$7FFFFFFF-1) == 0-$7FFFFFFF-1 && 1<<31 < 0", sError), "overflow condition compiles: " + sError);
+	Expect(g.Evaluate(bus), "overflow wraps around");
+
+	// As a breakpoint: INX, JMP $0200 stops at $0200 once X is 5
+	Bus loop;
+	LoadProgram(loop, 0x0200, { 0xE8, 0x4C, 0x00, 0x02 });
+	Expect(loop.bp.SetConditional("PC == $0200 && X == 5", sError), "conditional breakpoint is set: " + sError);
+	Expect(loop.cpu.run(100000), "conditional breakpoint stops the CPU");
+	Expect(loop.cpu.pc == 0x0200 && loop.cpu.x == 5, "conditional breakpoint stops when its condition holds");
+	Expect(loop.bp.ConditionReport().find("X == 5") != std::string::npos, "condition report lists the condition");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WATCHPOINTS
+
+// Watchpoints set once the code page pointer is already held must still
+// see the opcode and operand fetches from that page
+static void CheckWatchCodePage()
+{
+	Bus bus;
+
+	// NOP, LDA $0280
+	LoadProgram(bus, 0x0200, { 0xEA, 0xAD, 0x80, 0x02 });
+	bus.cpu.step();
+
+	bus.bp.Set(0x0202, Breakpoints::READ);
+	bus.bp.Set(0x0280, Breakpoints::READ);
+	bus.cpu.step();
+	Expect(bus.bp.hit == Breakpoints::READ && bus.bp.hit_addr == 0x0202, "read watchpoint on an operand in the code page");
+
+	// And the opcode itself, with the pointer held across a rewind's seek
+	Bus seek;
+	LoadProgram(seek, 0x0200, { 0xEA, 0xEA, 0xEA, 0xEA });
+	Rewind rewind;
+	rewind.ConnectBus(&seek);
+	rewind.Configure(1000000, 10000, 1024 * 1024);
+	rewind.Start();
+	seek.cpu.step();
+	seek.cpu.step();
+	Expect(rewind.StepBack(), "step back over NOPs");
+	seek.bp.Set(0x0202, Breakpoints::READ);
+	seek.cpu.step();
+	seek.cpu.step();
+	Expect(seek.bp.hit == Breakpoints::READ && seek.bp.hit_addr == 0x0202, "read watchpoint on an opcode after a rewind");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// REWIND
+
+// Reads 1 the first time and 0 ever after, like a device that isn't
+// rewound along with the CPU
+class OnceDevice : public Device
+{
+public:
+	uint8_t read(uint16_t addr) override { return bRead ? 0 : (bRead = true); }
+	void    write(uint16_t addr, uint8_t data) override {}
+	uint8_t peek(uint16_t addr) const override { return bRead ? 0 : 1; }
+	void    poke(uint16_t addr, uint8_t data) override {}
+
+private:
+	bool bRead = false;
+};
+
+// Stepping back re-executes from a checkpoint. If a device sends that
+// down another path, into KIL here, it must give up rather than wait for
+// an instruction count that never comes
+static void CheckRewindDivergence()
+{
+	Bus bus;
+	OnceDevice device;
+	bus.Attach(&device, 0xD000, 0xD000);
+
+	// LDA $D000, BEQ to KIL, otherwise JMP to itself forever
+	LoadProgram(bus, 0x0200, { 0xAD, 0x00, 0xD0, 0xF0, 0x03, 0x4C, 0x05, 0x02, OP_STOP });
+
+	Rewind rewind;
+	rewind.ConnectBus(&bus);
+	rewind.Configure(1000000, 10000, 1024 * 1024);
+	rewind.Start();
+	for (int i = 0; i < 10; i++)
+		bus.cpu.step();
+
+	Expect(!rewind.StepBack(), "step back that diverges into KIL gives up");
+	Expect(bus.cpu.pc == 0x0209, "diverged step back stops at the KIL");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// JOURNALS
+
+// Overwrites the byte at nOffset of a saved journal, tries to load it,
+// then puts the byte back
+static bool LoadsCorrupted(InputJournal &journal, const std::string &sFile, long nOffset, uint8_t nByte)
+{
+	FILE *f = fopen(sFile.c_str(), "r+b");
+	if (!f)
+		return true;
+	fseek(f, nOffset, SEEK_SET);
+	int nOld = fgetc(f);
+	fseek(f, nOffset, SEEK_SET);
+	fputc(nByte, f);
+	fclose(f);
+
+	bool bLoaded = journal.Load(sFile);
+
+	f = fopen(sFile.c_str(), "r+b");
+	fseek(f, nOffset, SEEK_SET);
+	fputc(nOld, f);
+	fclose(f);
+	return bLoaded;
+}
+
+// A journal saved inside a call, with two inputs, must be refused once a
+// frame's type, the halt state, an event's type or the events' order is
+// corrupted, rather than index past the frame type names or restore
+// something the CPU and replay can't make sense of
+static void CheckJournalFrames()
+{
+	Bus bus;
+	InputJournal journal;
+	journal.ConnectBus(&bus);
+
+	// JSR $0210, which then loops forever
+	LoadProgram(bus, 0x0200, { 0x20, 0x10, 0x02 });
+	bus.ram[0x0210] = 0x4C; bus.ram[0x0211] = 0x10; bus.ram[0x0212] = 0x02;
+	bus.cpu.step();
+	journal.StartRecording();
+	journal.input(0x0300, 0x01);
+	bus.cpu.run(100);
+	journal.input(0x0300, 0x02);
+	journal.Stop();
+
+	std::string sFile = "/tmp/6502_regress.journal";
+	Expect(journal.Save(sFile), "journal saves");
+
+	InputJournal loaded;
+	loaded.ConnectBus(&bus);
+	Expect(loaded.Load(sFile), "journal loads");
+
+	// The halt state follows the magic, registers, pc and cycles. The
+	// first frame's type follows it, the clock and instruction counts,
+	// frame count, target, return and stkp
+	long nHaltOffset = 8 + 5 + 2 + 1;
+	long nTypeOffset = nHaltOffset + 1 + 8 + 8 + 4 + 2 + 2 + 1;
+
+	// Then the rest of the frame, RAM, end cycle and event count before
+	// the events, each a cycle, type, data and port
+	long nEventOffset = nTypeOffset + 1 + 8 + 64 * 1024 + 8 + 8;
+	long nEventSize = 8 + 1 + 1 + 2;
+
+	Expect(!LoadsCorrupted(loaded, sFile, nTypeOffset, 0xEE), "journal with a bad frame type is refused");
+	Expect(!LoadsCorrupted(loaded, sFile, nHaltOffset, 0xEE), "journal with a bad halt state is refused");
+	Expect(!LoadsCorrupted(loaded, sFile, nEventOffset + 8, 0xEE), "journal with a bad event type is refused");
+	Expect(!LoadsCorrupted(loaded, sFile, nEventOffset + 7, 0x7F), "journal with events out of order is refused");
+	Expect(loaded.Load(sFile), "journal loads again once restored");
+	remove(sFile.c_str());
+}
+
+
+
+// A session recorded while the CPU is halted starts its replay halted
+// too, rather than running on into whatever follows
+static void CheckJournalHalt()
+{
+	Bus bus;
+	InputJournal journal;
+	journal.ConnectBus(&bus);
+
+	// KIL, then INX forever if it ever ran on
+	LoadProgram(bus, 0x0200, { OP_STOP, 0xE8, 0x4C, 0x01, 0x02 });
+	bus.cpu.step();
+	journal.StartRecording();
+	bus.cpu.run(100);
+	journal.Stop();
+
+	std::string sFile = "/tmp/6502_regress.journal";
+	Expect(journal.Save(sFile), "journal saves while halted");
+
+	Bus replay;
+	InputJournal loaded;
+	loaded.ConnectBus(&replay);
+	Expect(loaded.Load(sFile) && loaded.RunReplay(), "halted journal replays");
+	Expect(replay.cpu.x == 0 && replay.cpu.pc == bus.cpu.pc, "replay stays halted");
+	remove(sFile.c_str());
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DEVICES
+
+// An interrupt driven transmitter writes a byte per TX interrupt. The
+// first byte goes straight into the idle shift register, which leaves
+// the data register empty, so the next interrupt must come at once
+static void CheckAciaTxIrq()
+{
+	Bus bus;
+	Acia6551 acia;
+	acia.ConnectBus(&bus);
+	bus.Attach(&acia, 0x5000, 0x5003);
+
+	bus.write(0x5000 + Acia6551::CONTROL, 0x1F);	// 19200 baud, 8N1
+	bus.write(0x5000 + Acia6551::COMMAND, 0x05);	// DTR, TX interrupts
+	bus.read(0x5000 + Acia6551::STATUS);			// acknowledge the first
+	Expect(bus.irq_line == 0, "ACIA TX interrupt acknowledged");
+
+	bus.write(0x5000 + Acia6551::DATA, 'A');
+	uint8_t nStatus = bus.read(0x5000 + Acia6551::STATUS);
+	Expect((nStatus & Acia6551::ST_IRQ) && (nStatus & Acia6551::ST_TDRE), "ACIA interrupts for the next byte when one starts shifting out");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LOADING
+
+// A program loaded or assembled where a bank is mapped goes into the bank,
+// where the CPU will see it, not into the bus's RAM underneath
+static void CheckLoadIntoBanks()
+{
+	Bus bus;
+	BankController banks;
+	banks.ConnectBus(&bus);
+	Expect(banks.Allocate(0x8000), "banks allocate");
+	banks.AddWindow(0x8000, 0x4000);
+	banks.MapRegisters(0x7FF0);
+
+	const uint8_t image[] = { 0xA9, 0x42, 0xEA };
+	Loader loader;
+	loader.ConnectBus(&bus);
+	Expect(loader.Load(image, sizeof(image), Loader::FORMAT_RAW), "raw image loads: " + loader.Error());
+	Expect(bus.peek(0x8000) == 0xA9 && bus.peek(0x8002) == 0xEA, "raw image lands in the bank");
+	Expect(bus.ram[0x8000] == 0x00, "raw image leaves the RAM under the bank alone");
+	Expect(bus.peek(0xFFFC) == 0x00 && bus.peek(0xFFFD) == 0x80, "reset vector set");
+
+	Assembler assembler;
+	assembler.ConnectBus(&bus);
+	Expect(assembler.Assemble("*= $8100\nLDX #$07\n"), "source assembles: " + assembler.Error());
+	Expect(bus.peek(0x8100) == 0xA2 && bus.peek(0x8101) == 0x07, "assembled code lands in the bank");
+
+	// And the registers, a device page, take the bytes through poke()
+	const uint8_t select[] = { 0x01 };
+	loader.nRawAddr = 0x7FF0;
+	loader.bSetVector = false;
+	Expect(loader.Load(select, sizeof(select), Loader::FORMAT_RAW), "image over a device loads");
+	Expect(banks.Selected(0) == 1 && bus.peek(0x8000) == 0x00, "image over a device pokes it");
+}
+
+
+
+// Code that switches the bank it is running from carries on in the new
+// bank, so remapping the page pc is in must drop the CPU's pointer to it
+static void CheckSwitchUnderPC()
+{
+	Bus bus;
+	BankController banks;
+	banks.ConnectBus(&bus);
+	banks.Allocate(0x8000);
+	banks.AddWindow(0x8000, 0x4000);
+	banks.MapRegisters(0x7FF0);
+
+	// Bank 0: LDA #1, STA $7FF0, then stop. Bank 1: LDX #$42 where that
+	// stop would have been, then stop
+	const uint8_t bank0[] = { 0xA9, 0x01, 0x8D, 0xF0, 0x7F, OP_STOP };
+	const uint8_t bank1[] = { 0xA2, 0x42, OP_STOP };
+	std::copy(bank0, bank0 + sizeof(bank0), banks.Data());
+	std::copy(bank1, bank1 + sizeof(bank1), banks.Data() + 0x4000 + 5);
+	bus.ram[0xFFFC] = 0x00;
+	bus.ram[0xFFFD] = 0x80;
+	bus.cpu.reset();
+	bus.cpu.step();
+
+	for (int i = 0; i < 4; i++)
+		bus.cpu.step();
+	Expect(banks.Selected(0) == 1 && bus.cpu.x == 0x42, "code runs on in the bank it switched to");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ASSEMBLER
+
+// Every source the assembler refuses comes with a reason
+static void CheckAssemblerErrors()
+{
+	Bus bus;
+	Assembler assembler;
+	assembler.ConnectBus(&bus);
+
+	for (const char *sSource : { "*= $8000\n .res 1,2,3\n", "*= $8000\n .res\n", "*= $8000\n .res 4,\n" })
+	{
+		bool bOk = assembler.Assemble(sSource);
+		Expect(!bOk && !assembler.Error().empty(), std::string("bad .res is refused with a reason: ") + sSource);
+	}
+	Expect(assembler.Assemble("*= $8000\n .res 2, $EA\n") && bus.peek(0x8001) == 0xEA, ".res with a fill assembles");
+}
+
+
+
+int main()
+{
+	CheckBrk();
+	CheckIrqStatus();
+	CheckJsrOrder();
+	CheckConditions();
+	CheckWatchCodePage();
+	CheckRewindDivergence();
+	CheckJournalFrames();
+	CheckJournalHalt();
+	CheckAciaTxIrq();
+	CheckLoadIntoBanks();
+	CheckSwitchUnderPC();
+	CheckAssemblerErrors();
+
+	if (nFailed)
+	{
+		std::cout << nFailed << " check(s) failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
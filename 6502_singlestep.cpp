@@ -0,0 +1,307 @@
+/*
+	6502_singlestep - Runs the per-opcode SingleStepTests against olc6502
+
+		make singlestep
+		./6502_singlestep [-v] DIR [OPCODE ...]
+
+	The SingleStepTests (https://github.com/SingleStepTests/65x02) have,
+	for every opcode, ten thousand single instructions run on a real CPU,
+	each with the registers and memory before and after, and every bus
+	cycle it took. DIR is one of their directories of per-opcode files,
+	"00.json" to "ff.json", e.g. 6502/v1 for the NMOS 6502, nes6502/v1 for
+	the 2A03 or wdc65c02/v1 for the 65C02. Build with the matching VARIANT.
+
+	Each test puts the CPU and the listed memory in the initial state,
+	executes one instruction and checks the registers, the listed memory
+	and the number of cycles. B and U are not compared, as they only exist
+	in the copy of the status register pushed onto the stack. The order of
+	the bus cycles isn't checked, as the core doesn't model them one by one.
+
+	OPCODEs (hex) limit the run to those files. Opcodes that jam the CPU
+	are skipped. -v prints the first failing test of each opcode.
+
+	The exit code is 0 if every test passed, 1 if any failed and 2 if no
+	tests could be read.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Bus.h"
+#include "olc6502.h"
+
+// Just enough JSON for the test files: objects, arrays, numbers and
+// strings, with no escapes beyond \"
+struct JSON
+{
+	enum TYPE { NUL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+	double number = 0.0;
+	std::string str;
+	std::vector<JSON> items;
+	std::vector<std::pair<std::string, JSON>> members;
+
+	const JSON& operator[](const char *sKey) const
+	{
+		static const JSON none;
+		for (auto &m : members)
+		{
+			if (m.first == sKey)
+				return m.second;
+		}
+		return none;
+	}
+
+	int Int() const { return (int)number; }
+};
+
+class JsonParser
+{
+public:
+	JsonParser(const std::string &s) : text(s) {}
+
+	bool Parse(JSON &v)
+	{
+		pos = 0;
+		return Value(v) && (Skip(), pos == text.size());
+	}
+
+private:
+	const std::string &text;
+	size_t pos = 0;
+
+	void Skip()
+	{
+		while (pos < text.size() && isspace((unsigned char)text[pos]))
+			pos++;
+	}
+
+	bool String(std::string &s)
+	{
+		if (text[pos] != '"')
+			return false;
+		size_t end = ++pos;
+		while (end < text.size() && text[end] != '"')
+			end += text[end] == '\\' ? 2 : 1;
+		if (end >= text.size())
+			return false;
+		s = text.substr(pos, end - pos);
+		pos = end + 1;
+		return true;
+	}
+
+	bool Value(JSON &v)
+	{
+		Skip();
+		if (pos >= text.size())
+			return false;
+
+		char c = text[pos];
+		if (c == '{')
+		{
+			v.type = JSON::OBJECT;
+			pos++;
+			Skip();
+			if (text[pos] == '}')
+				return pos++, true;
+			while (true)
+			{
+				std::string sKey;
+				Skip();
+				if (!String(sKey))
+					return false;
+				Skip();
+				if (text[pos++] != ':')
+					return false;
+				v.members.emplace_back(sKey, JSON());
+				if (!Value(v.members.back().second))
+					return false;
+				Skip();
+				if (text[pos] == ',')
+					pos++;
+				else if (text[pos] == '}')
+					return pos++, true;
+				else
+					return false;
+			}
+		}
+		if (c == '[')
+		{
+			v.type = JSON::ARRAY;
+			pos++;
+			Skip();
+			if (text[pos] == ']')
+				return pos++, true;
+			while (true)
+			{
+				v.items.emplace_back();
+				if (!Value(v.items.back()))
+					return false;
+				Skip();
+				if (text[pos] == ',')
+					pos++;
+				else if (text[pos] == ']')
+					return pos++, true;
+				else
+					return false;
+			}
+		}
+		if (c == '"')
+		{
+			v.type = JSON::STRING;
+			return String(v.str);
+		}
+		if (text.compare(pos, 4, "null") == 0)
+		{
+			pos += 4;
+			return true;
+		}
+
+		char *end = nullptr;
+		v.number = strtod(text.c_str() + pos, &end);
+		if (end == text.c_str() + pos)
+			return false;
+		v.type = JSON::NUMBER;
+		pos = end - text.c_str();
+		return true;
+	}
+};
+
+static void SetState(Bus &bus, const JSON &s)
+{
+	olc6502::STATE st;
+	st.pc = s["pc"].Int();
+	st.stkp = s["s"].Int();
+	st.a = s["a"].Int();
+	st.x = s["x"].Int();
+	st.y = s["y"].Int();
+	st.status = s["p"].Int();
+	bus.cpu.LoadState(st);
+
+	for (auto &m : s["ram"].items)
+		bus.ram[m.items[0].Int()] = m.items[1].Int();
+}
+
+// Returns an empty string if the CPU and memory match, otherwise what
+// didn't
+static std::string Check(Bus &bus, const JSON &s, int nCycles, int nExpected)
+{
+	const uint8_t mask = (uint8_t)~(olc6502::B | olc6502::U);
+	std::ostringstream os;
+	auto reg = [&](const char *sName, int nHave, int nWant)
+	{
+		if (nHave != nWant)
+			os << " " << sName << " " << std::hex << nHave << " not " << nWant << std::dec;
+	};
+
+	reg("PC", bus.cpu.pc, s["pc"].Int());
+	reg("SP", bus.cpu.stkp, s["s"].Int());
+	reg("A", bus.cpu.a, s["a"].Int());
+	reg("X", bus.cpu.x, s["x"].Int());
+	reg("Y", bus.cpu.y, s["y"].Int());
+	reg("P", bus.cpu.status & mask, s["p"].Int() & mask);
+	for (auto &m : s["ram"].items)
+	{
+		int nAddr = m.items[0].Int();
+		if (bus.ram[nAddr] != m.items[1].Int())
+			os << " [" << std::hex << nAddr << "] " << (int)bus.ram[nAddr] << " not " << m.items[1].Int() << std::dec;
+	}
+	if (nCycles != nExpected)
+		os << " cycles " << nCycles << " not " << nExpected;
+	return os.str();
+}
+
+int main(int argc, char* argv[])
+{
+	bool bVerbose = false;
+	const char *sDir = nullptr;
+	std::vector<int> opcodes;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+			bVerbose = true;
+		else if (sDir == nullptr)
+			sDir = argv[i];
+		else
+			opcodes.push_back((int)strtoul(argv[i], nullptr, 16) & 0xFF);
+	}
+
+	if (sDir == nullptr)
+	{
+		std::cerr << "Usage: " << argv[0] << " [-v] DIR [OPCODE ...]" << std::endl;
+		return 2;
+	}
+
+	if (opcodes.empty())
+	{
+		for (int op = 0x00; op <= 0xFF; op++)
+			opcodes.push_back(op);
+	}
+
+	Bus bus;
+	uint64_t nPassed = 0, nFailed = 0;
+	int nFiles = 0;
+
+	for (int op : opcodes)
+	{
+		olc6502::OPCODEINFO info = bus.cpu.GetOpcodeInfo((uint8_t)op);
+		if (info.name == "KIL" || info.name == "STP")
+		{
+			printf("$%02X %s skipped\n", op, info.name.c_str());
+			continue;
+		}
+
+		char sFile[512];
+		snprintf(sFile, sizeof(sFile), "%s/%02x.json", sDir, op);
+		std::ifstream file(sFile, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+			continue;
+
+		std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		JSON tests;
+		if (!JsonParser(text).Parse(tests) || tests.type != JSON::ARRAY)
+		{
+			std::cerr << "Error parsing " << sFile << std::endl;
+			continue;
+		}
+		nFiles++;
+
+		int nFail = 0;
+		std::string sFirst;
+		for (auto &t : tests.items)
+		{
+			SetState(bus, t["initial"]);
+			bus.cpu.step();
+
+			std::string sDiff = Check(bus, t["final"], (int)bus.cpu.GetClockCount(), (int)t["cycles"].items.size());
+			if (sDiff.empty())
+				continue;
+
+			if (nFail++ == 0)
+				sFirst = t["name"].str + ":" + sDiff;
+		}
+
+		nPassed += tests.items.size() - nFail;
+		nFailed += nFail;
+		printf("$%02X %s %s %zu/%zu\n", op, info.name.c_str(), olc6502::AddrModeName(info.mode),
+			tests.items.size() - nFail, tests.items.size());
+		if (bVerbose && nFail)
+			printf("    %s\n", sFirst.c_str());
+	}
+
+	if (nFiles == 0)
+	{
+		std::cerr << "No tests found in " << sDir << std::endl;
+		return 2;
+	}
+
+	printf("%s: %llu passed, %llu failed\n", olc6502::VariantName(),
+		(unsigned long long)nPassed, (unsigned long long)nFailed);
+	return nFailed ? 1 : 0;
+}
@@ -0,0 +1,432 @@
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Acia6551.h"
+#include "Bus.h"
+
+
+
+Acia6551::Acia6551()
+{
+	on_host_byte = [this](uint8_t data) { Receive(data); };
+}
+
+Acia6551::~Acia6551()
+{
+	Close();
+}
+
+void Acia6551::ConnectBus(Bus *n)
+{
+	bus = n;
+	irq_source = bus->IrqSource();
+
+	tx_event = bus->sched.Register([this](uint64_t now)
+	{
+		tick(now);
+		FlushHost();
+		ScheduleEvents();
+	});
+	rx_event = bus->sched.Register([this](uint64_t now)
+	{
+		tick(now);
+		ArriveRx(now);
+		ScheduleEvents();
+	});
+}
+
+void Acia6551::reset()
+{
+	// A byte already shifting out carries on, but nothing else survives
+	command = 0x02;
+	control = 0x00;
+	bRdrf = false;
+	bOverrun = false;
+	bIrq = false;
+	bTdrFull = false;
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+void Acia6551::tick(uint64_t nClock)
+{
+	nNow = nClock;
+	UpdateTx();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// REGISTERS
+
+uint8_t Acia6551::Status() const
+{
+	return (bOverrun ? ST_OVERRUN : 0) | (bRdrf ? ST_RDRF : 0) | (bTdrFull ? 0 : ST_TDRE) | (bIrq ? ST_IRQ : 0);
+}
+
+uint8_t Acia6551::peek(uint16_t addr) const
+{
+	switch (addr & 0x03)
+	{
+	case DATA:    return rdr;
+	case STATUS:  return Status();
+	case COMMAND: return command;
+	default:      return control;
+	}
+}
+
+uint8_t Acia6551::read(uint16_t addr)
+{
+	uint8_t data = peek(addr);
+
+	switch (addr & 0x03)
+	{
+	case DATA:
+		// Frees the register for the next byte, which may have been held
+		bRdrf = false;
+		bOverrun = false;
+		break;
+
+	case STATUS:
+		bIrq = false;
+		break;
+
+	default:
+		return data;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+	return data;
+}
+
+void Acia6551::write(uint16_t addr, uint8_t data)
+{
+	switch (addr & 0x03)
+	{
+	case DATA:
+		// Straight into the shift register if it is idle, otherwise into
+		// the holding register, replacing whatever was waiting there. Into
+		// the shift register leaves the data register empty again, which
+		// interrupts at once for the next byte, if that is enabled
+		if (tx_end == UINT64_MAX)
+		{
+			tx_byte = data & DataMask();
+			tx_end  = nNow + CharCycles();
+			if ((command & 0x0C) == 0x04)
+				bIrq = true;
+		}
+		else
+		{
+			tdr = data & DataMask();
+			bTdrFull = true;
+		}
+		break;
+
+	case STATUS:
+		// Programmed reset
+		command &= 0xE0;
+		bOverrun = false;
+		break;
+
+	case COMMAND:
+		command = data;
+		// A transmitter interrupt enabled with the register already empty
+		// happens straight away
+		if ((command & 0x0C) == 0x04 && !bTdrFull)
+			bIrq = true;
+		break;
+
+	case CONTROL:
+		control = data;
+		break;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+void Acia6551::poke(uint16_t addr, uint8_t data)
+{
+	switch (addr & 0x03)
+	{
+	case DATA:    rdr = data; break;
+	case STATUS:
+		bOverrun = (data & ST_OVERRUN) != 0;
+		bRdrf    = (data & ST_RDRF) != 0;
+		bIrq     = (data & ST_IRQ) != 0;
+		break;
+	case COMMAND: command = data; break;
+	default:      control = data; break;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// THE LINE
+
+// Start bit, data bits, parity and stop bits, at the baud rate. Rate 0 is
+// the 16x external clock, taken as the usual 1.8432MHz crystal's 115200
+uint64_t Acia6551::CharCycles() const
+{
+	static const double dBaud[16] =
+	{
+		115200, 50, 75, 109.92, 134.58, 150, 300, 600,
+		1200, 1800, 2400, 3600, 4800, 7200, 9600, 19200,
+	};
+
+	int nBits = 1 + (8 - ((control >> 5) & 3)) + ((command & 0x20) ? 1 : 0) + ((control & 0x80) ? 2 : 1);
+	return std::max<uint64_t>(1, (uint64_t)(nClockHz * nBits / dBaud[control & 0x0F]));
+}
+
+// Bytes that have finished shifting out go to the host, and the holding
+// register moves up behind them
+void Acia6551::UpdateTx()
+{
+	while (nNow >= tx_end)
+	{
+		out.push_back(tx_byte);
+		if (bTdrFull)
+		{
+			tx_byte  = tdr;
+			bTdrFull = false;
+			tx_end  += CharCycles();
+			if ((command & 0x0C) == 0x04)
+				bIrq = true;
+		}
+		else
+			tx_end = UINT64_MAX;
+	}
+
+	UpdateIrq();
+}
+
+void Acia6551::Receive(uint8_t data)
+{
+	if (bRdrf)
+		bOverrun = true;	// The new byte is lost
+	else
+	{
+		rdr = data & DataMask();
+		bRdrf = true;
+		if ((command & 0x03) == 0x01)
+			bIrq = true;
+	}
+
+	// Echo mode sends it straight back
+	if (command & 0x10)
+		out.push_back(data);
+
+	UpdateIrq();
+}
+
+// The next byte from the host, if it is time for one, the receiver is
+// on and, with flow control, the last byte has been read
+void Acia6551::ArriveRx(uint64_t now)
+{
+	PollHost();
+	if (in_pos == in.size() || now < rx_next || !(command & 0x01) || (bFlowControl && bRdrf))
+		return;
+
+	rx_next = now + CharCycles();
+	on_host_byte(in[in_pos++]);
+}
+
+void Acia6551::PollHost()
+{
+	if (fdIn < 0 || bInEnd)
+		return;
+
+	if (in_pos == in.size())
+	{
+		in.clear();
+		in_pos = 0;
+	}
+	if (in.size() - in_pos >= 4096)
+		return;
+
+	uint8_t buf[4096];
+	ssize_t n = ::read(fdIn, buf, sizeof(buf));
+	if (n > 0)
+		in.insert(in.end(), buf, buf + n);
+	else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		bInEnd = true;
+}
+
+void Acia6551::FlushHost()
+{
+	if (fdOut < 0)
+	{
+		out.clear();
+		return;
+	}
+
+	bHostBusy = false;
+	size_t nDone = 0;
+	while (nDone < out.size())
+	{
+		ssize_t n = ::write(fdOut, out.data() + nDone, out.size() - nDone);
+		if (n > 0)
+			nDone += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else
+		{
+			// Try again later if the host is just busy, otherwise the
+			// far end has gone and the bytes go nowhere
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				bHostBusy = true;
+			else
+				nDone = out.size();
+			break;
+		}
+	}
+	out.erase(out.begin(), out.begin() + nDone);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EVENTS
+
+void Acia6551::UpdateIrq()
+{
+	if (bus)
+		bus->SetIrq(irq_source, bIrq);
+}
+
+// The transmitter needs an event when a byte finishes, or to retry a
+// host that wasn't ready. The receiver needs one when its next byte is
+// due, or to look at the host again while the line is idle. An idle look
+// already due is left alone, or a program polling the status register
+// would keep putting it off
+void Acia6551::ScheduleEvents()
+{
+	if (!bus)
+		return;
+
+	uint64_t nIdle = std::max<uint64_t>(CharCycles(), nClockHz / 100);
+
+	if (tx_end != UINT64_MAX)
+		bus->sched.Schedule(tx_event, tx_end);
+	else if (!out.empty() && !bHostBusy)
+		bus->sched.Schedule(tx_event, nNow);
+	else if (!out.empty() && bus->sched.When(tx_event) == Scheduler::NEVER)
+		bus->sched.Schedule(tx_event, nNow + nIdle);
+	else if (out.empty())
+		bus->sched.Cancel(tx_event);
+
+	bool bWaiting = in_pos < in.size();
+	bool bHeld = !(command & 0x01) || (bFlowControl && bRdrf);
+	if (bWaiting && !bHeld)
+		bus->sched.Schedule(rx_event, std::max(rx_next, nNow));
+	else if (!bWaiting && fdIn >= 0 && !bInEnd)
+	{
+		if (bus->sched.When(rx_event) == Scheduler::NEVER)
+			bus->sched.Schedule(rx_event, nNow + nIdle);
+	}
+	else
+		bus->sched.Cancel(rx_event);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// HOST
+
+bool Acia6551::Open(const std::string &sSpec)
+{
+	Close();
+
+	if (sSpec == "-")
+		return Open(0, 1);
+
+	int fd = -1;
+	if (sSpec.compare(0, 5, "unix:") == 0)
+	{
+		sockaddr_un sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_UNIX;
+		if (sSpec.size() - 5 >= sizeof(sa.sun_path))
+		{
+			sError = "socket path too long";
+			return false;
+		}
+		strcpy(sa.sun_path, sSpec.c_str() + 5);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (sockaddr*)&sa, sizeof(sa)) != 0)
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+	else
+		fd = open(sSpec.c_str(), O_RDWR | O_NOCTTY);
+
+	if (fd < 0)
+	{
+		sError = "can't open " + sSpec + ": " + strerror(errno);
+		return false;
+	}
+
+	Open(fd, fd);
+	bOwned = true;
+	return true;
+}
+
+bool Acia6551::Open(int fdNewIn, int fdNewOut)
+{
+	Close();
+	fdIn = fdNewIn;
+	fdOut = fdNewOut;
+	bInEnd = false;
+
+	if (fdIn >= 0)
+	{
+		nInFlags = fcntl(fdIn, F_GETFL);
+		fcntl(fdIn, F_SETFL, nInFlags | O_NONBLOCK);
+	}
+	if (fdOut >= 0 && fdOut != fdIn)
+	{
+		nOutFlags = fcntl(fdOut, F_GETFL);
+		fcntl(fdOut, F_SETFL, nOutFlags | O_NONBLOCK);
+	}
+
+	ScheduleEvents();
+	return true;
+}
+
+void Acia6551::Close()
+{
+	// Whatever the host will take, as it is about to go
+	if (!out.empty())
+		FlushHost();
+
+	if (fdIn >= 0 && nInFlags != -1)
+		fcntl(fdIn, F_SETFL, nInFlags);
+	if (fdOut >= 0 && fdOut != fdIn && nOutFlags != -1)
+		fcntl(fdOut, F_SETFL, nOutFlags);
+
+	if (bOwned)
+	{
+		::close(fdIn);
+		if (fdOut != fdIn)
+			::close(fdOut);
+	}
+
+	fdIn = fdOut = -1;
+	nInFlags = nOutFlags = -1;
+	bOwned = false;
+	out.clear();
+}
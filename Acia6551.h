@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "Device.h"
+
+class Bus;
+
+// 6551 ACIA ==========================================================
+// The Asynchronous Communications Interface Adapter, a serial port, with
+// the far end of its line on the host: stdin/stdout, a FIFO, a tty or a
+// Unix domain socket. The four registers repeat through whatever range
+// the ACIA is attached at, decoded from the low two address bits.
+//
+// The line runs at the baud rate and frame in the control and command
+// registers, turned into CPU cycles with nClockHz. Nothing polls it each
+// cycle. A byte written to the data register takes a character time to
+// shift out, which is a Scheduler event at its end, when it is passed to
+// the host. Bytes from the host arrive no faster than one a character
+// time, each an event of its own. The host descriptors are non-blocking
+// and read and written in large chunks, and while the line is idle they
+// are only looked at every 10ms of emulated time.
+//
+// Modelled: RDRF/TDRE with their interrupts, overrun, the transmitter
+// holding register, echo mode, programmed and hardware reset, word
+// length and stop bits in the character time. Parity is counted in the
+// timing but never checked, and DCD/DSR always read as asserted.
+class Acia6551 : public Device
+{
+public:
+	Acia6551();
+	~Acia6551();
+
+	// Takes an IRQ source and registers the line's events. Attach the
+	// ACIA to the bus separately, e.g. Attach(&acia, 0x5000, 0x5003)
+	void ConnectBus(Bus *n);
+
+	uint8_t read(uint16_t addr) override;
+	void    write(uint16_t addr, uint8_t data) override;
+	uint8_t peek(uint16_t addr) const override;
+	void    poke(uint16_t addr, uint8_t data) override;
+	void    tick(uint64_t nClock) override;
+	void    reset() override;
+
+	enum REGISTER
+	{
+		DATA, STATUS, COMMAND, CONTROL,
+	};
+
+	enum STATUSBITS
+	{
+		ST_PARITY  = (1 << 0),
+		ST_FRAMING = (1 << 1),
+		ST_OVERRUN = (1 << 2),
+		ST_RDRF    = (1 << 3),
+		ST_TDRE    = (1 << 4),
+		ST_DCD     = (1 << 5),
+		ST_DSR     = (1 << 6),
+		ST_IRQ     = (1 << 7),
+	};
+
+	// The CPU's clock rate, which turns baud rates into cycles
+	uint32_t nClockHz = 1000000;
+
+	// Hold each byte from the host until the program has read the last
+	// one, as a far end watching RTS would, rather than overrunning
+	bool bFlowControl = true;
+
+	// Connects the line to the host. "-" is stdin and stdout, "unix:PATH"
+	// connects to a Unix domain socket, and anything else is a file
+	// opened for reading and writing, such as a FIFO or a tty. Returns
+	// false, with Error() saying why, if it can't be opened
+	bool Open(const std::string &sSpec);
+
+	// The same with descriptors that are already open, either of which
+	// can be -1. They are made non-blocking until Close(), but not closed
+	bool Open(int fdIn, int fdOut);
+	void Close();
+	const std::string& Error() const { return sError; }
+
+	// Each byte from the host is handed here when it arrives on the line.
+	// By default that is Receive(), but an input journal can take it, to
+	// log it and call Receive() itself, so a replay gets the same bytes at
+	// the same cycles without the host
+	std::function<void(uint8_t)> on_host_byte;
+
+	// Puts a byte in the receive data register now, overrunning if the
+	// last one hasn't been read
+	void Receive(uint8_t data);
+
+private:
+	Bus *bus = nullptr;
+	uint32_t irq_source = 0;
+	int tx_event = -1;
+	int rx_event = -1;
+
+	uint64_t nNow = 0;				// Clock count the state is up to
+
+	uint8_t command = 0x02, control = 0x00;
+	uint8_t rdr = 0x00;				// Receive data register
+	bool    bRdrf = false;
+	bool    bOverrun = false;
+	bool    bIrq = false;
+
+	// The transmitter shifts out tx_byte until tx_end, with tdr waiting
+	// behind it if bTdrFull
+	uint8_t  tdr = 0x00;
+	bool     bTdrFull = false;
+	uint8_t  tx_byte = 0x00;
+	uint64_t tx_end = UINT64_MAX;
+
+	uint64_t rx_next = 0;			// Earliest the next byte can arrive
+
+	// Host side
+	int  fdIn = -1, fdOut = -1;
+	int  nInFlags = -1, nOutFlags = -1;	// To restore on Close()
+	bool bOwned = false;				// Opened here, so closed here
+	bool bInEnd = false;
+	bool bHostBusy = false;				// The last write would have blocked
+	std::vector<uint8_t> in;			// Read from the host, in[in_pos] next
+	size_t in_pos = 0;
+	std::vector<uint8_t> out;			// Waiting to be written to the host
+	std::string sError;
+
+	uint64_t CharCycles() const;
+	uint8_t  DataMask() const { return 0xFF >> ((control >> 5) & 3); }
+	uint8_t  Status() const;
+
+	void UpdateTx();
+	void ArriveRx(uint64_t now);
+	void PollHost();
+	void FlushHost();
+	void UpdateIrq();
+	void ScheduleEvents();
+};
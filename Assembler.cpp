@@ -0,0 +1,645 @@
+#include <cctype>
+#include <cstring>
+
+#include "Assembler.h"
+#include "Bus.h"
+#include "Symbols.h"
+
+
+
+Assembler::Assembler()
+{
+}
+
+void Assembler::ConnectBus(Bus *n)
+{
+	bus = n;
+
+	// Where an instruction has more than one opcode for a mode, e.g. NOP
+	// or SBC #, the documented one is used
+	opcodes.clear();
+	for (int op = 0x00; op <= 0xFF; op++)
+	{
+		olc6502::OPCODEINFO info = bus->cpu.GetOpcodeInfo((uint8_t)op);
+		auto it = opcodes.find(info.name);
+		if (it == opcodes.end())
+		{
+			it = opcodes.emplace(info.name, std::array<int16_t, olc6502::AM_ZPR + 1>()).first;
+			it->second.fill(-1);
+		}
+
+		int16_t &nOpcode = it->second[info.mode];
+		if (nOpcode < 0 || (info.bDocumented && !bus->cpu.GetOpcodeInfo((uint8_t)nOpcode).bDocumented))
+			nOpcode = (int16_t)op;
+	}
+}
+
+bool Assembler::Find(const std::string &sName, uint16_t &nValue) const
+{
+	auto it = symbols.find(sName);
+	if (it == symbols.end())
+		return false;
+	nValue = it->second.value;
+	return true;
+}
+
+void Assembler::ExportSymbols(Symbols &table) const
+{
+	for (auto &s : symbols)
+	{
+		if (s.second.bLabel)
+			table.Add(s.second.value, s.first);
+	}
+}
+
+bool Assembler::Fail(const std::string &s, size_t nLine)
+{
+	sError = "line " + std::to_string(nLine) + ": " + s;
+	return false;
+}
+
+bool Assembler::Assemble(const std::string &sSource)
+{
+	statements.clear();
+	symbols.clear();
+	sError.clear();
+	nLowest   = 0xFFFF;
+	nHighest  = 0x0000;
+	nBytes    = 0;
+
+	return Parse(sSource) && Pass(false) && Pass(true);
+}
+
+static bool IsNameStart(char c)
+{
+	return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '@';
+}
+
+static bool IsNameChar(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '@';
+}
+
+static std::string Trim(const char *s, const char *end)
+{
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	while (end > s && isspace((unsigned char)end[-1]))
+		end--;
+	return std::string(s, end);
+}
+
+static std::string Upper(std::string s)
+{
+	for (auto &c : s)
+		c = toupper((unsigned char)c);
+	return s;
+}
+
+// Splits a list on the commas that aren't inside quotes
+static std::vector<std::string> SplitList(const std::string &s)
+{
+	std::vector<std::string> items;
+	char quote = 0;
+	size_t start = 0;
+	for (size_t i = 0; i <= s.size(); i++)
+	{
+		if (i == s.size() || (s[i] == ',' && !quote))
+		{
+			items.push_back(Trim(s.data() + start, s.data() + i));
+			start = i + 1;
+		}
+		else if (s[i] == '"' || s[i] == '\'')
+		{
+			quote = quote == s[i] ? 0 : quote ? quote : s[i];
+		}
+	}
+	return items;
+}
+
+// Breaks each line into its label, operation and operand. Nothing is
+// evaluated yet, that needs the labels
+bool Assembler::Parse(const std::string &sSource)
+{
+	const char *text = sSource.data(), *end = text + sSource.size();
+	size_t nLine = 0;
+
+	while (text < end)
+	{
+		const char *eol = (const char*)memchr(text, '\n', end - text);
+		if (eol == nullptr)
+			eol = end;
+		nLine++;
+
+		// The comment, outside of quotes
+		const char *s = text, *stop = text;
+		char quote = 0;
+		for (; stop < eol && (quote || *stop != ';'); stop++)
+		{
+			if (*stop == '"' || *stop == '\'')
+				quote = quote == *stop ? 0 : quote ? quote : *stop;
+		}
+		text = eol + 1;
+
+		STATEMENT st;
+		st.nLine = nLine;
+		auto skip = [&]() { while (s < stop && isspace((unsigned char)*s)) s++; };
+
+		// A label is a name followed by ':', or any name in the first
+		// column that isn't an instruction or directive
+		bool bFirstColumn = s < stop && !isspace((unsigned char)*s);
+		skip();
+		if (s < stop && IsNameStart(*s))
+		{
+			const char *name = s;
+			while (s < stop && IsNameChar(*s))
+				s++;
+			std::string sName(name, s);
+
+			if (s < stop && *s == ':' && (s + 1 == stop || s[1] != '='))
+			{
+				st.sLabel = sName;
+				s++;
+			}
+			else if (bFirstColumn && sName[0] != '.' && opcodes.count(Upper(sName)) == 0)
+				st.sLabel = sName;
+			else
+				s = name;
+		}
+
+		skip();
+		if (s == stop)
+		{
+			if (!st.sLabel.empty())
+				statements.push_back(st);
+			continue;
+		}
+
+		if (*s == '*' || *s == '=' || (*s == ':' && s + 1 < stop && s[1] == '='))
+		{
+			// "*= value" or "name = value"
+			bool bOrg = *s == '*';
+			if (bOrg)
+			{
+				s++;
+				skip();
+			}
+			if (s < stop && *s == ':')
+				s++;
+			if (s == stop || *s != '=')
+				return Fail("expected =", nLine);
+			if (!bOrg && st.sLabel.empty())
+				return Fail("= without a name", nLine);
+
+			st.kind = bOrg ? KIND_ORG : KIND_SET;
+			st.sOperand = Trim(s + 1, stop);
+			statements.push_back(st);
+			continue;
+		}
+
+		const char *op = s;
+		while (s < stop && IsNameChar(*s))
+			s++;
+		st.sOp = Upper(std::string(op, s));
+		st.sOperand = Trim(s, stop);
+
+		if (st.sOp == "EQU")
+		{
+			if (st.sLabel.empty())
+				return Fail("EQU without a name", nLine);
+			st.kind = KIND_SET;
+		}
+		else if (st.sOp == ".ORG")
+			st.kind = KIND_ORG;
+		else if (st.sOp == ".BYTE" || st.sOp == ".DB" || st.sOp == ".TEXT")
+			st.kind = KIND_BYTE;
+		else if (st.sOp == ".WORD" || st.sOp == ".DW")
+			st.kind = KIND_WORD;
+		else if (st.sOp == ".RES" || st.sOp == ".DS")
+			st.kind = KIND_RES;
+		else if (st.sOp == ".END")
+		{
+			statements.push_back(st);
+			break;
+		}
+		else if (opcodes.count(st.sOp))
+			st.kind = KIND_INSTRUCTION;
+		else
+			return Fail("unknown instruction " + std::string(op, s), nLine);
+
+		statements.push_back(st);
+	}
+
+	return true;
+}
+
+// Bytes, including the opcode, for each addressing mode
+static const uint8_t nModeBytes[] = { 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2, 3, 3 };
+
+bool Assembler::Pass(bool bSecond)
+{
+	pc = nOrigin;
+	bFinal = bSecond;
+
+	for (auto &st : statements)
+	{
+		nStatement = (uint16_t)pc;
+
+		if (!st.sLabel.empty() && st.kind != KIND_SET && !bSecond)
+		{
+			if (symbols.count(st.sLabel))
+				return Fail(st.sLabel + " is already defined", st.nLine);
+			symbols[st.sLabel] = { (uint16_t)pc, true };
+		}
+
+		int32_t nValue = 0;
+		bool bKnown = true;
+
+		switch (st.kind)
+		{
+		case KIND_NONE:
+			break;
+
+		case KIND_SET:
+			if (!EvalAll(st.sOperand, nValue, bKnown, st.nLine))
+				return false;
+			if (!bSecond && symbols.count(st.sLabel))
+				return Fail(st.sLabel + " is already defined", st.nLine);
+			if (bKnown)
+				symbols[st.sLabel] = { (uint16_t)nValue, false };
+			break;
+
+		case KIND_ORG:
+			if (!EvalAll(st.sOperand, nValue, bKnown, st.nLine))
+				return false;
+			if (!bKnown || nValue < 0 || nValue > 0xFFFF)
+				return Fail("origin must be a known address", st.nLine);
+			pc = (uint32_t)nValue;
+			break;
+
+		case KIND_INSTRUCTION:
+			if (!bSecond && !Mode(st))
+				return false;
+			if (bSecond && !Encode(st))
+				return false;
+			if (!bSecond)
+				pc += st.size;
+			break;
+
+		case KIND_BYTE:
+			for (auto &sItem : SplitList(st.sOperand))
+			{
+				if (sItem.size() >= 2 && sItem[0] == '"' && sItem.back() == '"')
+				{
+					for (size_t i = 1; i + 1 < sItem.size(); i++)
+					{
+						if (bSecond && !Emit((uint8_t)sItem[i], st.nLine))
+							return false;
+						pc += bSecond ? 0 : 1;
+					}
+					continue;
+				}
+
+				if (!EvalAll(sItem, nValue, bKnown, st.nLine))
+					return false;
+				if (bSecond && (nValue < -128 || nValue > 0xFF))
+					return Fail("byte out of range", st.nLine);
+				if (bSecond && !Emit((uint8_t)nValue, st.nLine))
+					return false;
+				pc += bSecond ? 0 : 1;
+			}
+			break;
+
+		case KIND_WORD:
+			for (auto &sItem : SplitList(st.sOperand))
+			{
+				if (!EvalAll(sItem, nValue, bKnown, st.nLine))
+					return false;
+				if (bSecond && (nValue < -0x8000 || nValue > 0xFFFF))
+					return Fail("word out of range", st.nLine);
+				if (bSecond && !(Emit(nValue & 0xFF, st.nLine) && Emit((nValue >> 8) & 0xFF, st.nLine)))
+					return false;
+				pc += bSecond ? 0 : 2;
+			}
+			break;
+
+		case KIND_RES:
+		{
+			std::vector<std::string> items = SplitList(st.sOperand);
+			int32_t nFill = 0;
+			if (items.size() > 2 || items[0].empty())
+				return Fail("expected size[, fill]", st.nLine);
+			if (!EvalAll(items[0], nValue, bKnown, st.nLine))
+				return false;
+			if (!bKnown || nValue < 0 || nValue > 0x10000)
+				return Fail("size must be known", st.nLine);
+			if (items.size() == 2 && !EvalAll(items[1], nFill, bKnown, st.nLine))
+				return false;
+
+			for (int32_t i = 0; i < nValue; i++)
+			{
+				if (bSecond && !Emit((uint8_t)nFill, st.nLine))
+					return false;
+			}
+			pc += bSecond ? 0 : nValue;
+			break;
+		}
+		}
+
+		if (pc > 0x10000)
+			return Fail("program goes past $FFFF", st.nLine);
+	}
+
+	return true;
+}
+
+static bool EndsWithIndex(std::string &s, char r)
+{
+	size_t n = s.size();
+	if (n < 2 || toupper((unsigned char)s[n - 1]) != r)
+		return false;
+
+	size_t i = n - 1;
+	while (i > 0 && isspace((unsigned char)s[i - 1]))
+		i--;
+	if (i == 0 || s[i - 1] != ',')
+		return false;
+
+	s = Trim(s.data(), s.data() + i - 1);
+	return true;
+}
+
+// Picks the addressing mode from the operand's form, and for a plain
+// address whether it fits in zero page. This fixes the size for the
+// second pass
+bool Assembler::Mode(STATEMENT &st)
+{
+	const auto &ops = opcodes[st.sOp];
+	std::string o = st.sOperand;
+	ADDRMODE mode = olc6502::AM_IMP;
+
+	if (o.empty() && ops[olc6502::AM_IMP] < 0 && ops[olc6502::AM_IMM] >= 0)
+	{
+		// BRK, which is followed by a signature byte the CPU skips
+		mode = olc6502::AM_IMM;
+		st.sExpr = "0";
+	}
+	else if (o.empty() || Upper(o) == "A")
+	{
+		mode = olc6502::AM_IMP;
+	}
+	else if (o[0] == '#')
+	{
+		mode = olc6502::AM_IMM;
+		st.sExpr = o.substr(1);
+	}
+	else if (o[0] == '(' && ops[olc6502::AM_REL] < 0 && ops[olc6502::AM_ZPR] < 0)
+	{
+		size_t close = o.find(')');
+		if (close == std::string::npos)
+			return Fail("missing )", st.nLine);
+		std::string sInner = o.substr(1, close - 1);
+		std::string sAfter;
+		for (size_t i = close + 1; i < o.size(); i++)
+		{
+			if (!isspace((unsigned char)o[i]))
+				sAfter += toupper((unsigned char)o[i]);
+		}
+
+		if (sAfter.empty() && EndsWithIndex(sInner, 'X'))
+			mode = ops[olc6502::AM_IAX] >= 0 ? olc6502::AM_IAX : olc6502::AM_IZX;
+		else if (sAfter.empty())
+			mode = ops[olc6502::AM_IND] >= 0 ? olc6502::AM_IND : olc6502::AM_IZP;
+		else if (sAfter == ",Y")
+			mode = olc6502::AM_IZY;
+		else
+			return Fail("bad indirect operand", st.nLine);
+		st.sExpr = sInner;
+	}
+	else if (ops[olc6502::AM_ZPR] >= 0)
+	{
+		std::vector<std::string> items = SplitList(o);
+		if (items.size() != 2)
+			return Fail("expected zero page address, target", st.nLine);
+		mode = olc6502::AM_ZPR;
+		st.sExpr = items[0];
+		st.sExpr2 = items[1];
+	}
+	else if (ops[olc6502::AM_REL] >= 0)
+	{
+		mode = olc6502::AM_REL;
+		st.sExpr = o;
+	}
+	else
+	{
+		ADDRMODE zp = olc6502::AM_ZP0, abs = olc6502::AM_ABS;
+		if (EndsWithIndex(o, 'X'))
+			zp = olc6502::AM_ZPX, abs = olc6502::AM_ABX;
+		else if (EndsWithIndex(o, 'Y'))
+			zp = olc6502::AM_ZPY, abs = olc6502::AM_ABY;
+		st.sExpr = o;
+
+		int32_t nValue = 0;
+		bool bKnown = true;
+		if (!EvalAll(o, nValue, bKnown, st.nLine))
+			return false;
+		bool bZeroPage = bKnown && nValue >= 0 && nValue <= 0xFF;
+
+		if (ops[zp] >= 0 && (bZeroPage || ops[abs] < 0))
+			mode = zp;
+		else
+			mode = abs;
+	}
+
+	if (ops[mode] < 0)
+		return Fail(st.sOp + " has no " + olc6502::AddrModeName(mode) + " mode", st.nLine);
+
+	st.mode = mode;
+	st.size = nModeBytes[mode];
+	return true;
+}
+
+bool Assembler::Encode(const STATEMENT &st)
+{
+	int32_t nValue = 0, nTarget = 0;
+	bool bKnown = true;
+
+	if (!Emit((uint8_t)opcodes[st.sOp][st.mode], st.nLine))
+		return false;
+	if (st.mode == olc6502::AM_IMP)
+		return true;
+	if (!EvalAll(st.sExpr, nValue, bKnown, st.nLine))
+		return false;
+
+	switch (st.mode)
+	{
+	case olc6502::AM_IMM:
+		if (nValue < -128 || nValue > 0xFF)
+			return Fail("immediate value out of range", st.nLine);
+		return Emit((uint8_t)nValue, st.nLine);
+
+	case olc6502::AM_REL:
+		nValue -= nStatement + 2;
+		if (nValue < -128 || nValue > 127)
+			return Fail("branch out of range", st.nLine);
+		return Emit((uint8_t)nValue, st.nLine);
+
+	case olc6502::AM_ZPR:
+		if (nValue < 0 || nValue > 0xFF)
+			return Fail("zero page address out of range", st.nLine);
+		if (!EvalAll(st.sExpr2, nTarget, bKnown, st.nLine))
+			return false;
+		nTarget -= nStatement + 3;
+		if (nTarget < -128 || nTarget > 127)
+			return Fail("branch out of range", st.nLine);
+		return Emit((uint8_t)nValue, st.nLine) && Emit((uint8_t)nTarget, st.nLine);
+
+	default:
+		if (nValue < 0 || nValue > (st.size == 2 ? 0xFF : 0xFFFF))
+			return Fail(st.size == 2 ? "zero page address out of range" : "address out of range", st.nLine);
+		if (!Emit(nValue & 0xFF, st.nLine))
+			return false;
+		return st.size == 2 || Emit((nValue >> 8) & 0xFF, st.nLine);
+	}
+}
+
+// Straight into memory, like the Loader, through the page table so a
+// bank mapped at pc gets it
+bool Assembler::Emit(uint8_t data, size_t nLine)
+{
+	if (pc > 0xFFFF)
+		return Fail("program goes past $FFFF", nLine);
+
+	bus->Store((uint16_t)pc, &data, 1);
+
+	if (pc < nLowest)
+		nLowest = (uint16_t)pc;
+	if (pc > nHighest)
+		nHighest = (uint16_t)pc;
+	nBytes++;
+	pc++;
+	return true;
+}
+
+bool Assembler::EvalAll(const std::string &sText, int32_t &nValue, bool &bKnown, size_t nLine)
+{
+	const char *s = sText.data(), *end = s + sText.size();
+	if (!Eval(s, end, nValue, bKnown, nLine))
+		return false;
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	if (s != end)
+		return Fail("unexpected " + std::string(s, end), nLine);
+	return true;
+}
+
+bool Assembler::Eval(const char *&s, const char *end, int32_t &nValue, bool &bKnown, size_t nLine)
+{
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+
+	char part = 0;
+	if (s < end && (*s == '<' || *s == '>'))
+		part = *s++;
+
+	if (!Term(s, end, nValue, bKnown, nLine))
+		return false;
+
+	while (true)
+	{
+		while (s < end && isspace((unsigned char)*s))
+			s++;
+		if (s == end || (*s != '+' && *s != '-'))
+			break;
+
+		char sign = *s++;
+		int32_t nTerm = 0;
+		if (!Term(s, end, nTerm, bKnown, nLine))
+			return false;
+		nValue += sign == '+' ? nTerm : -nTerm;
+	}
+
+	if (part == '<')
+		nValue &= 0xFF;
+	else if (part == '>')
+		nValue = (nValue >> 8) & 0xFF;
+	return true;
+}
+
+bool Assembler::Term(const char *&s, const char *end, int32_t &nValue, bool &bKnown, size_t nLine)
+{
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	if (s == end)
+		return Fail("missing value", nLine);
+
+	if (*s == '-')
+	{
+		s++;
+		if (!Term(s, end, nValue, bKnown, nLine))
+			return false;
+		nValue = -nValue;
+		return true;
+	}
+
+	if (*s == '*')
+	{
+		s++;
+		nValue = nStatement;
+		return true;
+	}
+
+	if (*s == '\'')
+	{
+		if (end - s < 3 || s[2] != '\'')
+			return Fail("bad character constant", nLine);
+		nValue = (uint8_t)s[1];
+		s += 3;
+		return true;
+	}
+
+	if (IsNameStart(*s))
+	{
+		const char *name = s;
+		while (s < end && IsNameChar(*s))
+			s++;
+
+		auto it = symbols.find(std::string(name, s));
+		if (it != symbols.end())
+		{
+			nValue = it->second.value;
+			return true;
+		}
+		if (bFinal)
+			return Fail("unknown symbol " + std::string(name, s), nLine);
+		nValue = 0;
+		bKnown = false;
+		return true;
+	}
+
+	int base = 10;
+	if (*s == '$')
+		base = 16, s++;
+	else if (*s == '%')
+		base = 2, s++;
+	else if (end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		base = 16, s += 2;
+
+	const char *start = s;
+	nValue = 0;
+	while (s < end)
+	{
+		int d = isdigit((unsigned char)*s) ? *s - '0'
+			: isxdigit((unsigned char)*s) ? toupper((unsigned char)*s) - 'A' + 10 : 99;
+		if (d >= base)
+			break;
+		nValue = nValue * base + d;
+		if (nValue > 0xFFFFFF)
+			return Fail("number too large", nLine);
+		s++;
+	}
+
+	if (s == start)
+		return Fail("bad number", nLine);
+	return true;
+}
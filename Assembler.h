@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+
+#include "olc6502.h"
+
+class Bus;
+class Symbols;
+
+// Assembler ==========================================================
+// A small two-pass assembler, so tools can build 6502 programs from text
+// without an external one. The instruction set comes from the CPU's own
+// translation table through GetOpcodeInfo(), so it always matches the
+// variant that was built, and the bytes go straight into the bus's memory.
+// The first pass fixes the size of every statement and where each label
+// is, the second evaluates the operands and writes the bytes.
+//
+// Source is one statement per line, ";" starting a comment:
+//
+//		*= $8000			or ".org $8000", where the next byte goes
+//		count = 11			or "count EQU 11", a symbol
+//		loop:				a label. The ":" can be left out if the label
+//		loop ADC $01		starts in the first column
+//		.byte 1, $02, "ab"	bytes and strings, also ".db"
+//		.word start, $1234	little endian words, also ".dw"
+//		.res 16, $EA		reserve bytes, filled with 0 or the value given
+//
+// Operands are written as in the disassembly: #imm, zp, zp,X, abs,Y,
+// (zp,X), (zp),Y, (abs) and, on the 65C02, (zp), (abs,X) and BBRn zp,
+// target. "A" or nothing is the accumulator. BRK on its own is followed
+// by a zero signature byte. An address below $0100
+// that is known in the first pass uses zero page if the instruction has
+// it. Branch operands are targets, not offsets.
+//
+// Expressions are numbers ($hex, %binary, decimal or 'c'), symbols and *
+// for the current address, added and subtracted, with < or > in front
+// for the low or high byte.
+class Assembler
+{
+public:
+	Assembler();
+
+	// Takes the instruction set from the bus's CPU
+	void ConnectBus(Bus *n);
+
+	// Where code goes before the first "*=", as for the Loader's raw images
+	uint16_t nOrigin = 0x8000;
+
+	// Returns false, with Error() saying where and why, if the source
+	// has a mistake. Nothing is written unless the first pass succeeds
+	bool Assemble(const std::string &sSource);
+
+	// What the last Assemble() did
+	uint16_t Lowest()  const { return nLowest; }
+	uint16_t Highest() const { return nHighest; }
+	size_t   Bytes()   const { return nBytes; }
+	const std::string& Error() const { return sError; }
+
+	// The value of a label or symbol from the last Assemble()
+	bool Find(const std::string &sName, uint16_t &nValue) const;
+
+	// Adds the labels and symbols to a symbol table, for the disassembler
+	void ExportSymbols(Symbols &symbols) const;
+
+private:
+	typedef olc6502::ADDRMODE ADDRMODE;
+
+	Bus *bus = nullptr;
+
+	// Opcode for each mnemonic and addressing mode, -1 where there's none
+	std::unordered_map<std::string, std::array<int16_t, olc6502::AM_ZPR + 1>> opcodes;
+
+	enum KIND : uint8_t
+	{
+		KIND_NONE,			// Only a label, or nothing
+		KIND_INSTRUCTION,
+		KIND_ORG,
+		KIND_SET,			// name = value
+		KIND_BYTE,
+		KIND_WORD,
+		KIND_RES,
+	};
+
+	struct STATEMENT
+	{
+		KIND     kind = KIND_NONE;
+		ADDRMODE mode = olc6502::AM_IMP;
+		uint8_t  size = 0;
+		size_t   nLine = 0;
+		std::string sLabel;
+		std::string sOp;		// Mnemonic, upper case
+		std::string sOperand;
+		std::string sExpr;		// The operand's expression, without the mode's
+		std::string sExpr2;		// punctuation. sExpr2 is BBRn/BBSn's target
+	};
+
+	struct SYMBOL
+	{
+		uint16_t value  = 0x0000;
+		bool     bLabel = false;	// An address in the program, not an "="
+	};
+
+	std::vector<STATEMENT> statements;
+	std::unordered_map<std::string, SYMBOL> symbols;
+
+	uint32_t pc = 0;
+	uint16_t nStatement = 0;	// Address of the statement's first byte, for *
+	bool     bFinal = false;	// Second pass: every symbol must be known
+	uint16_t nLowest  = 0x0000;
+	uint16_t nHighest = 0x0000;
+	size_t   nBytes   = 0;
+	std::string sError;
+
+	bool Fail(const std::string &s, size_t nLine);
+	bool Parse(const std::string &sSource);
+	bool Pass(bool bSecond);
+	bool Mode(STATEMENT &st);
+	bool Encode(const STATEMENT &st);
+	bool Emit(uint8_t data, size_t nLine);
+
+	// Evaluates an expression from s, leaving s after it. bKnown is false
+	// if it used a symbol not defined yet, which is only allowed in the
+	// first pass
+	bool Eval(const char *&s, const char *end, int32_t &nValue, bool &bKnown, size_t nLine);
+	bool Term(const char *&s, const char *end, int32_t &nValue, bool &bKnown, size_t nLine);
+	bool EvalAll(const std::string &sText, int32_t &nValue, bool &bKnown, size_t nLine);
+};
@@ -0,0 +1,197 @@
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "BankController.h"
+#include "Bus.h"
+
+
+
+BankController::BankController()
+{
+}
+
+BankController::~BankController()
+{
+	Close();
+}
+
+void BankController::ConnectBus(Bus *n)
+{
+	bus = n;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// THE BUFFER
+
+// Zeroed host memory, as much of it as is asked for, which the host only
+// really provides as it is touched
+bool BankController::Allocate(size_t nNewSize)
+{
+	return Open("", nNewSize);
+}
+
+// The file is mapped over the start of a zeroed mapping the full size, so
+// a short image reads as zeroes after its end rather than faulting
+bool BankController::Open(const std::string &sFile, size_t nNewSize)
+{
+	Close();
+
+	int fd = -1;
+	size_t nFile = 0;
+	if (!sFile.empty())
+	{
+		struct stat st;
+		fd = open(sFile.c_str(), O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0)
+		{
+			sError = "can't open " + sFile + ": " + strerror(errno);
+			if (fd >= 0)
+				::close(fd);
+			return false;
+		}
+		nFile = (size_t)st.st_size;
+	}
+
+	size_t nHostPage = (size_t)sysconf(_SC_PAGESIZE);
+	size_t nWant = std::max(nFile, nNewSize);
+	nWant = (nWant + 0xFF) & ~(size_t)0xFF;
+	nMapped = (nWant + nHostPage - 1) / nHostPage * nHostPage;
+
+	void *p = nMapped ? mmap(nullptr, nMapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+	if (p != MAP_FAILED && nFile > 0
+		&& mmap(p, nFile, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		munmap(p, nMapped);
+		p = MAP_FAILED;
+	}
+	if (fd >= 0)
+		::close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		sError = nMapped ? std::string("can't map banks: ") + strerror(errno) : "no banks";
+		nMapped = 0;
+		return false;
+	}
+
+	buffer = (uint8_t*)p;
+	nSize = nWant;
+	return true;
+}
+
+void BankController::Close()
+{
+	RemoveWindows();
+	if (buffer)
+		munmap(buffer, nMapped);
+	buffer = nullptr;
+	nSize = nMapped = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WINDOWS
+
+int BankController::AddWindow(uint16_t nFirst, uint32_t nWindowSize, size_t nOffset)
+{
+	if (!bus || !buffer || (nFirst & 0xFF) || (nWindowSize & 0xFF) || nWindowSize == 0
+		|| nFirst + nWindowSize > 0x10000 || nOffset + nWindowSize > nSize)
+		return -1;
+
+	WINDOW w;
+	w.nFirst = nFirst;
+	w.nSize = nWindowSize;
+	w.nOffset = nOffset;
+	w.nBanks = (uint32_t)((nSize - nOffset) / nWindowSize);
+	w.nSelected = 0;
+	windows.push_back(w);
+
+	Select((int)windows.size() - 1, 0);
+	return (int)windows.size() - 1;
+}
+
+// The whole switch. Device pages in the window keep their device, and
+// reach the bank through page_mem outside its ranges
+bool BankController::Select(int nWindow, uint32_t nBank)
+{
+	if (nWindow < 0 || nWindow >= (int)windows.size() || nBank >= windows[nWindow].nBanks)
+		return false;
+
+	WINDOW &w = windows[nWindow];
+	w.nSelected = nBank;
+	uint8_t *p = buffer + w.nOffset + (size_t)nBank * w.nSize;
+	for (uint32_t n = 0; n < w.nSize; n += 256)
+		bus->Map((uint8_t)((w.nFirst + n) >> 8), p + n);
+	return true;
+}
+
+uint32_t BankController::Selected(int nWindow) const
+{
+	return nWindow >= 0 && nWindow < (int)windows.size() ? windows[nWindow].nSelected : 0;
+}
+
+uint32_t BankController::Banks(int nWindow) const
+{
+	return nWindow >= 0 && nWindow < (int)windows.size() ? windows[nWindow].nBanks : 0;
+}
+
+// The bus's own RAM goes back behind the windows, and the registers go,
+// before the buffer does
+void BankController::RemoveWindows()
+{
+	if (bus)
+		bus->Detach(this);
+	for (auto &w : windows)
+		for (uint32_t n = 0; n < w.nSize; n += 256)
+			bus->Map((uint8_t)((w.nFirst + n) >> 8), &bus->ram[w.nFirst + n]);
+	windows.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// REGISTERS
+
+void BankController::MapRegisters(uint16_t nAddr)
+{
+	nRegisters = nAddr;
+	bus->Detach(this);
+	if (!windows.empty())
+		bus->Attach(this, nAddr, (uint16_t)(nAddr + windows.size() - 1));
+}
+
+uint8_t BankController::peek(uint16_t addr) const
+{
+	return (uint8_t)Selected(addr - nRegisters);
+}
+
+uint8_t BankController::read(uint16_t addr)
+{
+	return peek(addr);
+}
+
+void BankController::write(uint16_t addr, uint8_t data)
+{
+	int nWindow = addr - nRegisters;
+	if (Banks(nWindow))
+		Select(nWindow, data % Banks(nWindow));
+}
+
+void BankController::poke(uint16_t addr, uint8_t data)
+{
+	write(addr, data);
+}
+
+void BankController::reset()
+{
+	for (int i = 0; i < (int)windows.size(); i++)
+		Select(i, 0);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Device.h"
+
+class Bus;
+
+// Bank Switching =====================================================
+// A memory controller for images bigger than the 6502's 64K. The banks
+// are cut from one host buffer, either zeroed memory or an image file
+// mapped straight into the host's address space, so a large image is
+// neither read nor copied up front, only paged in as it is touched.
+//
+// Windows of the CPU's address space each show one bank at a time, and
+// switching bank rewrites the window's entries in the bus's page table,
+// one pointer per 256 bytes. Nothing is copied, the CPU's accesses to a
+// window stay on the page table's fast path, and only the window's pages
+// get new generations, so memory viewers redraw just those.
+//
+// The controller's registers, one per window, are a Device at whatever
+// address MapRegisters() puts them. Writing a register selects a bank
+// for its window, modulo the number of banks, and reading it gives the
+// bank selected. The reset line selects bank 0 everywhere.
+//
+// Writes to a window land in its bank, as with RAM. An image file is
+// mapped privately, so it never changes on disk. Rewind and the input
+// journal only snapshot the bus's own RAM, not banks or the selection.
+class BankController : public Device
+{
+public:
+	BankController();
+	~BankController();
+
+	void ConnectBus(Bus *n);
+
+	// The buffer banks are cut from, of at least nSize bytes, rounded up
+	// to whole pages. Allocate() zeroes it. Open() maps the image file,
+	// with zeroes after its end up to nSize. Either returns false, with
+	// Error() saying why, if it can't. Windows go with the old buffer
+	bool Allocate(size_t nSize);
+	bool Open(const std::string &sFile, size_t nSize = 0);
+	void Close();
+	const std::string& Error() const { return sError; }
+
+	uint8_t* Data() { return buffer; }
+	size_t   Size() const { return nSize; }
+
+	// A window nSize bytes long at nFirst, both multiples of 256. Bank n
+	// is the nSize bytes of the buffer at nOffset + n * nSize, and bank 0
+	// is shown to begin with. Returns the window's number, which is also
+	// its register's offset, or -1 if it doesn't fit
+	int AddWindow(uint16_t nFirst, uint32_t nSize, size_t nOffset = 0);
+
+	// Shows bank nBank in window nWindow, returning false if there is no
+	// such bank. It costs a pointer store per page
+	bool     Select(int nWindow, uint32_t nBank);
+	uint32_t Selected(int nWindow) const;
+	uint32_t Banks(int nWindow) const;
+
+	// Attaches the registers to the bus at nAddr, after the windows have
+	// been added
+	void MapRegisters(uint16_t nAddr);
+
+	uint8_t read(uint16_t addr) override;
+	void    write(uint16_t addr, uint8_t data) override;
+	uint8_t peek(uint16_t addr) const override;
+	void    poke(uint16_t addr, uint8_t data) override;
+	void    reset() override;
+
+private:
+	Bus *bus = nullptr;
+
+	struct WINDOW
+	{
+		uint16_t nFirst;
+		uint32_t nSize;
+		size_t   nOffset;
+		uint32_t nBanks;
+		uint32_t nSelected;
+	};
+
+	std::vector<WINDOW> windows;
+	uint16_t nRegisters = 0;
+
+	uint8_t *buffer = nullptr;
+	size_t   nSize = 0;
+	size_t   nMapped = 0;			// Host bytes to unmap, a multiple of the host page
+	std::string sError;
+
+	void RemoveWindows();
+};
@@ -0,0 +1,128 @@
+#include <cstdio>
+
+#include "Breakpoints.h"
+
+
+
+Breakpoints::Breakpoints()
+{
+	ClearAll();
+}
+
+Breakpoints::BITMAP* Breakpoints::Map(uint8_t type)
+{
+	switch (type)
+	{
+	case EXEC:  return &map_exec;
+	case READ:  return &map_read;
+	case WRITE: return &map_write;
+	}
+	return nullptr;
+}
+
+void Breakpoints::Set(uint16_t addr, uint8_t type)
+{
+	for (uint8_t t = EXEC; t <= WRITE; t <<= 1)
+	{
+		if ((type & t) && !IsSet(addr, t))
+		{
+			(*Map(t))[addr >> 3] |= (1 << (addr & 7));
+			count++;
+		}
+	}
+	armed = count > 0;
+}
+
+void Breakpoints::Clear(uint16_t addr, uint8_t type)
+{
+	for (uint8_t t = EXEC; t <= WRITE; t <<= 1)
+	{
+		if ((type & t) && IsSet(addr, t))
+		{
+			(*Map(t))[addr >> 3] &= ~(1 << (addr & 7));
+			count--;
+		}
+	}
+	armed = count > 0;
+
+	if (type & EXEC)
+		conditions.erase(addr);
+}
+
+void Breakpoints::ClearAll()
+{
+	map_exec.fill(0x00);
+	map_read.fill(0x00);
+	map_write.fill(0x00);
+	conditions.clear();
+	count = 0;
+	armed = false;
+	hit = NONE;
+	resume = false;
+}
+
+// True if any of the TYPEs in "type" is set at the address
+bool Breakpoints::IsSet(uint16_t addr, uint8_t type) const
+{
+	return ((type & EXEC)  && Test(map_exec, addr))
+		|| ((type & READ)  && Test(map_read, addr))
+		|| ((type & WRITE) && Test(map_write, addr));
+}
+
+void Breakpoints::Resume(uint16_t pc)
+{
+	hit = NONE;
+	resume = Test(map_exec, pc);
+	resume_addr = pc;
+}
+
+bool Breakpoints::SetConditional(uint16_t addr, const std::string &sExpr, std::string &sError)
+{
+	Condition c;
+	if (!c.Compile(sExpr, sError))
+		return false;
+
+	Set(addr, EXEC);
+	conditions[addr] = c;
+	return true;
+}
+
+bool Breakpoints::SetConditional(const std::string &sExpr, std::string &sError)
+{
+	Condition c;
+	if (!c.Compile(sExpr, sError))
+		return false;
+
+	if (!c.HasAddress())
+	{
+		sError = "condition needs a \"PC == address\" term to say where it applies";
+		return false;
+	}
+
+	Set(c.address(), EXEC);
+	conditions[c.address()] = c;
+	return true;
+}
+
+// Only called once the bitmap has matched, so the cost of a condition is
+// paid at its own address and nowhere else
+bool Breakpoints::CheckCondition(uint16_t addr)
+{
+	auto it = conditions.find(addr);
+	if (it == conditions.end())
+		return true;
+	return it->second.Evaluate(*bus);
+}
+
+std::string Breakpoints::ConditionReport() const
+{
+	std::string s = " ADDR        EVALS       PASSES    NS/EVAL  CONDITION\n";
+	for (auto &c : conditions)
+	{
+		char line[96];
+		snprintf(line, sizeof(line), "$%04X %12llu %12llu %10.1f  ", c.first,
+			(unsigned long long)c.second.Evaluations(), (unsigned long long)c.second.Passes(), c.second.AverageNs());
+		s += line + c.second.text() + "\n";
+	}
+	return s;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <string>
+#include <unordered_map>
+
+#include "Condition.h"
+
+class Bus;
+
+// Breakpoints & Watchpoints ==========================================
+// Each kind of breakpoint is a bitmap holding one bit per address, so
+// 8KB covers the whole 64K address space. Testing an address costs the
+// same whether one or a thousand breakpoints are set. The emulation only
+// looks at "armed" until at least one breakpoint exists, so having the
+// debugger available costs next to nothing when it isn't in use.
+class Breakpoints
+{
+public:
+	Breakpoints();
+
+	enum TYPE : uint8_t
+	{
+		NONE  = 0,
+		EXEC  = (1 << 0),	// Stop before the instruction at the address executes
+		READ  = (1 << 1),	// Stop after the instruction reading the address completes
+		WRITE = (1 << 2),	// Stop after the instruction writing the address completes
+	};
+
+	// Set or remove breakpoints at an address. "type" may combine TYPEs
+	void Set(uint16_t addr, uint8_t type);
+	void Clear(uint16_t addr, uint8_t type);
+	void ClearAll();
+	bool IsSet(uint16_t addr, uint8_t type) const;
+	uint32_t Count() const { return count; }
+
+	// Sets an execution breakpoint which only stops when the condition is
+	// true (see Condition.h). The expression is compiled here, so a mistake
+	// in it is reported straight away, and not when the address is reached.
+	// Without an address, the condition must contain a "PC == value" term.
+	// Clearing the execution breakpoint removes its condition.
+	bool SetConditional(uint16_t addr, const std::string &sExpr, std::string &sError);
+	bool SetConditional(const std::string &sExpr, std::string &sError);
+	const std::unordered_map<uint16_t, Condition>& Conditions() const { return conditions; }
+
+	// A table of every condition, with how often it was evaluated, how often
+	// it passed and how long an evaluation takes on average
+	std::string ConditionReport() const;
+
+	// Link to the bus, so conditions can see the CPU and memory
+	void ConnectBus(Bus *n) { bus = n; }
+
+	// True whenever at least one breakpoint is set. This is the single
+	// guard the CPU and bus check before doing anything else
+	bool armed = false;
+
+	// Details of the first hit since execution was last resumed
+	uint8_t  hit      = NONE;
+	uint16_t hit_addr = 0x0000;
+
+	// Clears the last hit before execution continues. If the CPU is sitting
+	// on an execution breakpoint, it is allowed to execute that instruction
+	// once, otherwise it could never move past it
+	void Resume(uint16_t pc);
+
+	// Called by the bus for accesses made by the CPU, only when armed
+	void CheckRead(uint16_t addr)  { if (Test(map_read, addr))  Hit(READ, addr); }
+	void CheckWrite(uint16_t addr) { if (Test(map_write, addr)) Hit(WRITE, addr); }
+
+	// Called by the CPU at each instruction boundary, only when armed.
+	// Returns true if execution must stop in front of this address
+	bool CheckExec(uint16_t addr)
+	{
+		if (!Test(map_exec, addr))
+			return false;
+
+		if (resume && addr == resume_addr)
+		{
+			resume = false;
+			return false;
+		}
+
+		if (!conditions.empty() && !CheckCondition(addr))
+			return false;
+
+		Hit(EXEC, addr);
+		return true;
+	}
+
+private:
+	typedef std::array<uint8_t, 8 * 1024> BITMAP;
+
+	BITMAP   map_exec;
+	BITMAP   map_read;
+	BITMAP   map_write;
+	uint32_t count       = 0;
+	bool     resume      = false;
+	uint16_t resume_addr = 0x0000;
+	Bus     *bus         = nullptr;
+
+	std::unordered_map<uint16_t, Condition> conditions;
+	bool CheckCondition(uint16_t addr);
+
+	static bool Test(const BITMAP &m, uint16_t addr)
+	{
+		return m[addr >> 3] & (1 << (addr & 7));
+	}
+
+	void Hit(uint8_t type, uint16_t addr)
+	{
+		// Keep the first hit, an instruction can touch several addresses
+		if (hit == NONE)
+		{
+			hit = type;
+			hit_addr = addr;
+		}
+	}
+
+	BITMAP* Map(uint8_t type);
+};
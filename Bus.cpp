@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstring>
+
 #include "Bus.h"
 
 
@@ -6,9 +9,23 @@ Bus::Bus()
 {
 	// Connect CPU to communication bus
 	cpu.ConnectBus(this);
+	bp.ConnectBus(this);
 
 	// Clear RAM contents, just in case :P
 	for (auto &i : ram) i = 0x00;
+	page_gen.fill(0);
+
+	for (int p = 0; p < 256; p++)
+		page[p] = page_mem[p] = &ram[p << 8];
+
+	// A held IRQ line is looked at on each instruction boundary, through
+	// the scheduler, so it costs nothing while it is released
+	irq_event = sched.Register([this](uint64_t now)
+	{
+		cpu.irq();
+		if (irq_line)
+			sched.Schedule(irq_event, now + 1);
+	});
 }
 
 
@@ -18,14 +35,180 @@ Bus::~Bus()
 
 void Bus::write(uint16_t addr, uint8_t data)
 {
-	if (addr >= 0x0000 && addr <= 0xFFFF)
-		ram[addr] = data;
+	if (bp.armed)
+		bp.CheckWrite(addr);
+
+	if (write_log)
+		write_log->push_back({ addr, data });
+
+	if (uint8_t *p = page[addr >> 8])
+		p[addr & 0xFF] = data;
+	else
+		WriteIO(addr, data);
+	page_gen[addr >> 8]++;
 }
 
-uint8_t Bus::read(uint16_t addr, bool bReadOnly)
+uint8_t Bus::read(uint16_t addr)
 {
-	if (addr >= 0x0000 && addr <= 0xFFFF)
-		return ram[addr];
+	if (bp.armed)
+		bp.CheckRead(addr);
+
+	if (const uint8_t *p = page[addr >> 8])
+		return p[addr & 0xFF];
+
+	return ReadIO(addr);
+}
+
+uint8_t Bus::peek(uint16_t addr) const
+{
+	if (const uint8_t *p = page[addr >> 8])
+		return p[addr & 0xFF];
+
+	return PeekIO(addr);
+}
+
+void Bus::poke(uint16_t addr, uint8_t data)
+{
+	if (uint8_t *p = page[addr >> 8])
+		p[addr & 0xFF] = data;
+	else
+		PokeIO(addr, data);
+	page_gen[addr >> 8]++;
+}
 
+void Bus::reset()
+{
+	for (auto &m : mappings)
+		m.device->reset();
+	cpu.reset();
+}
+
+uint32_t Bus::IrqSource()
+{
+	return 1u << nIrqSources++;
+}
+
+void Bus::SetIrq(uint32_t nSource, bool bAsserted)
+{
+	uint32_t nOld = irq_line;
+	irq_line = bAsserted ? irq_line | nSource : irq_line & ~nSource;
+
+	if (irq_line && !nOld)
+		sched.Schedule(irq_event, cpu.GetClockCount());
+	else if (!irq_line && nOld)
+		sched.Cancel(irq_event);
+}
+
+void Bus::Attach(Device *device, uint16_t nFirst, uint16_t nLast)
+{
+	mappings.push_back({ device, nFirst, nLast });
+	for (int p = nFirst >> 8; p <= (nLast >> 8); p++)
+		UpdatePage(p);
+}
+
+void Bus::Detach(Device *device)
+{
+	mappings.erase(std::remove_if(mappings.begin(), mappings.end(),
+		[device](const MAPPING &m) { return m.device == device; }), mappings.end());
+	for (int p = 0; p < 256; p++)
+		UpdatePage(p);
+}
+
+void Bus::Map(uint8_t nPage, uint8_t *p)
+{
+	page_mem[nPage] = p;
+	UpdatePage(nPage);
+}
+
+void Bus::Store(uint16_t addr, const uint8_t *data, size_t n)
+{
+	while (n > 0)
+	{
+		uint8_t nPage = addr >> 8;
+		size_t nChunk = std::min<size_t>(n, 0x100 - (addr & 0xFF));
+		if (uint8_t *p = page[nPage])
+			memcpy(p + (addr & 0xFF), data, nChunk);
+		else
+			for (size_t i = 0; i < nChunk; i++)
+				PokeIO((uint16_t)(addr + i), data[i]);
+		page_gen[nPage]++;
+
+		addr += (uint16_t)nChunk;
+		data += nChunk;
+		n -= nChunk;
+	}
+}
+
+// A page stays in the page table, and so on the fast path, unless a
+// device is mapped somewhere in it
+void Bus::UpdatePage(uint8_t nPage)
+{
+	uint8_t *pOld = page[nPage];
+	page[nPage] = page_mem[nPage];
+	for (auto &m : mappings)
+		if ((m.nFirst >> 8) <= nPage && nPage <= (m.nLast >> 8))
+			page[nPage] = nullptr;
+	page_gen[nPage]++;
+	if (page[nPage] != pOld)
+		cpu.PageMapped(nPage);
+}
+
+// There are only ever a handful of mappings, so they are simply searched,
+// the first attached winning where they overlap
+const Bus::MAPPING* Bus::Decode(uint16_t addr) const
+{
+	for (auto &m : mappings)
+		if (m.nFirst <= addr && addr <= m.nLast)
+			return &m;
+	return nullptr;
+}
+
+uint8_t Bus::ReadIO(uint16_t addr)
+{
+	if (const MAPPING *m = Decode(addr))
+	{
+		m->device->tick(cpu.GetClockCount());
+		return m->device->read(addr);
+	}
+
+	if (const uint8_t *p = page_mem[addr >> 8])
+		return p[addr & 0xFF];
+	return 0x00;
+}
+
+void Bus::WriteIO(uint16_t addr, uint8_t data)
+{
+	if (const MAPPING *m = Decode(addr))
+	{
+		m->device->tick(cpu.GetClockCount());
+		m->device->write(addr, data);
+	}
+	else if (uint8_t *p = page_mem[addr >> 8])
+		p[addr & 0xFF] = data;
+}
+
+// Catching up is not a side effect, as the device would be in the same
+// state had it been ticked every cycle, so a peek ticks as well
+uint8_t Bus::PeekIO(uint16_t addr) const
+{
+	if (const MAPPING *m = Decode(addr))
+	{
+		m->device->tick(cpu.GetClockCount());
+		return m->device->peek(addr);
+	}
+
+	if (const uint8_t *p = page_mem[addr >> 8])
+		return p[addr & 0xFF];
 	return 0x00;
 }
+
+void Bus::PokeIO(uint16_t addr, uint8_t data)
+{
+	if (const MAPPING *m = Decode(addr))
+	{
+		m->device->tick(cpu.GetClockCount());
+		m->device->poke(addr, data);
+	}
+	else if (uint8_t *p = page_mem[addr >> 8])
+		p[addr & 0xFF] = data;
+}
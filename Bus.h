@@ -1,8 +1,12 @@
 #pragma once
 #include <cstdint>
 #include <array>
+#include <vector>
 
 #include "olc6502.h"
+#include "Breakpoints.h"
+#include "Scheduler.h"
+#include "Device.h"
 
 class Bus
 {
@@ -13,12 +17,105 @@ public:
 public: // Devices on bus
 	olc6502 cpu;	
 
-	// Fake RAM for this part of the series
+	// 64K of RAM, behind every page until something else is mapped there
 	std::array<uint8_t, 64 * 1024> ram;
 
+	// Host memory behind each 256 byte page, which is where read() and
+	// write() go, and what tools look at to see memory without a call per
+	// byte. Every page starts out as its part of ram. A page with a device
+	// in it is nullptr, and its accesses are decoded by Attach()'s ranges,
+	// as is a page with nothing at all, which reads as 0 and ignores
+	// writes.
+	std::array<uint8_t*, 256> page;
+
+	// The memory each page has apart from any devices. It is what page[]
+	// holds for pages without one, and what a device page's addresses
+	// outside the device's ranges reach
+	std::array<uint8_t*, 256> page_mem;
+
+	// Write generation of each 256 byte page. Every write through the bus
+	// bumps the count for its page, so anything keeping a copy of memory
+	// can find the pages that changed without comparing their contents
+	std::array<uint32_t, 256> page_gen;
+
+	// Execution breakpoints and read/write watchpoints
+	Breakpoints bp;
+
+	// Events timed by the CPU's clock count
+	Scheduler sched;
+
+	// Every write through the bus is appended to write_log while it is set,
+	// for tools that compare the stores made by different cores. Leaving
+	// it null costs one test per write
+	struct WRITE
+	{
+		uint16_t addr;
+		uint8_t  data;
+	};
+
+	std::vector<WRITE> *write_log = nullptr;
+
+public: // Devices
+	// Maps a device at nFirst to nLast inclusive. A device can be attached
+	// for several ranges, and several devices can share a page. The bus
+	// doesn't own the device, which must outlive it or be detached
+	void Attach(Device *device, uint16_t nFirst, uint16_t nLast);
+	void Detach(Device *device);
+
+	// Puts nPage's memory at p, e.g. a bank of a larger buffer, or nullptr
+	// for nothing. The page table is updated unless a device is in the
+	// page, and only this page's generation changes
+	void Map(uint8_t nPage, uint8_t *p);
+
+	// poke() for n bytes from addr, as a loader wants them: into whatever
+	// memory is mapped at each page, e.g. a bank, a page at a time, and
+	// byte by byte to the devices of a page that has any
+	void Store(uint16_t addr, const uint8_t *data, size_t n);
+
+	// The reset line: every device, then the CPU
+	void reset();
+
+	// The IRQ line, which is held low while any device asserts it. Each
+	// device driving it gets a bit of its own from IrqSource(). While the
+	// line is low the CPU is interrupted at every instruction boundary
+	// that it has interrupts enabled, or is waiting after WAI, so an
+	// interrupt that isn't acknowledged is taken again, as on hardware
+	uint32_t IrqSource();
+	void SetIrq(uint32_t nSource, bool bAsserted);
+	uint32_t irq_line = 0;
 
 public: // Bus Read & Write
+	// The CPU's accesses. Watchpoints are checked, writes are logged, and
+	// devices see them as real bus cycles
 	void write(uint16_t addr, uint8_t data);
-	uint8_t read(uint16_t addr, bool bReadOnly = false);
+	uint8_t read(uint16_t addr);
+
+	// The debugger's accesses, which have no side effects: no watchpoints,
+	// no write log, and devices answer through their own peek() and
+	// poke() (see Device.h). A poke still bumps its page's generation, so
+	// memory viewers see the change
+	uint8_t peek(uint16_t addr) const;
+	void poke(uint16_t addr, uint8_t data);
+
+private:
+	struct MAPPING
+	{
+		Device  *device;
+		uint16_t nFirst;
+		uint16_t nLast;
+	};
+
+	std::vector<MAPPING> mappings;
+
+	uint32_t nIrqSources = 0;
+	int irq_event = -1;
+
+	// The slow path for pages out of the page table
+	const MAPPING* Decode(uint16_t addr) const;
+	uint8_t ReadIO(uint16_t addr);
+	void    WriteIO(uint16_t addr, uint8_t data);
+	uint8_t PeekIO(uint16_t addr) const;
+	void    PokeIO(uint16_t addr, uint8_t data);
+	void    UpdatePage(uint8_t nPage);
 };
 
@@ -0,0 +1,454 @@
+#include <chrono>
+#include <cctype>
+
+#include "Condition.h"
+#include "Bus.h"
+
+
+
+// Bytecode for the condition stack machine. Operands follow their opcode
+// in the same array.
+enum CONDOP : int32_t
+{
+	OP_END,
+	OP_CONST,	// value		push value
+	OP_REG,		// register		push register
+	OP_FLAG,	// mask			push 1 if the status bit is set, else 0
+	OP_MEM,		//				replace address on top with the byte there
+	OP_NOT, OP_BNOT, OP_NEG,
+	OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB, OP_SHL, OP_SHR,
+	OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+	OP_AND, OP_XOR, OP_OR,
+	OP_JFALSE,	// target		if top is 0, jump leaving it, else pop it
+	OP_JTRUE,	// target		if top isn't 0, make it 1 and jump, else pop it
+	OP_BOOL,	//				make top 0 or 1
+};
+
+enum CONDREG : int32_t
+{
+	REG_A, REG_X, REG_Y, REG_SP, REG_PC, REG_P,
+};
+
+
+// A recursive descent parser, one function per level of C's precedence
+// table, which emits bytecode as it goes. It also tracks how deep the
+// stack will get, so the evaluator never has to check.
+class ConditionCompiler
+{
+public:
+	ConditionCompiler(Condition &c, const std::string &s) : cond(c), src(s) {}
+
+	bool Compile(std::string &sError)
+	{
+		cond.code.clear();
+		cond.bHasAddress = false;
+
+		int32_t nPC = -1;
+		if (ParseOr(true, nPC))
+		{
+			Skip();
+			if (pos != src.size())
+				Fail("unexpected '" + src.substr(pos, 1) + "'");
+		}
+
+		if (!sErr.empty())
+		{
+			sError = sErr + " at column " + std::to_string(pos + 1);
+			cond.code.clear();
+			return false;
+		}
+
+		Emit(OP_END);
+		if (nPC >= 0)
+		{
+			cond.bHasAddress = true;
+			cond.nAddress = uint16_t(nPC);
+		}
+		return true;
+	}
+
+private:
+	Condition &cond;
+	const std::string &src;
+	size_t pos = 0;
+	int depth = 0;
+	std::string sErr;
+
+	bool Fail(const std::string &s)
+	{
+		if (sErr.empty())
+			sErr = s;
+		return false;
+	}
+
+	void Emit(int32_t op) { cond.code.push_back(op); }
+
+	// Keeps count of stack usage. "n" is what the last emitted op did to it
+	bool Depth(int n)
+	{
+		depth += n;
+		if (depth > Condition::STACK_SIZE)
+			return Fail("expression is too complex");
+		return true;
+	}
+
+	void Skip()
+	{
+		while (pos < src.size() && std::isspace((unsigned char)src[pos]))
+			pos++;
+	}
+
+	// Consumes the operator if it is next. Care is taken that "<" does not
+	// match the start of "<<" or "<=", and so on
+	bool Accept(const char *op)
+	{
+		Skip();
+		size_t n = 0;
+		while (op[n])
+		{
+			if (pos + n >= src.size() || src[pos + n] != op[n])
+				return false;
+			n++;
+		}
+		if (n == 1 && pos + 1 < src.size())
+		{
+			char c = src[pos + 1];
+			if ((op[0] == '<' && (c == '<' || c == '=')) || (op[0] == '>' && (c == '>' || c == '='))
+				|| (op[0] == '&' && c == '&') || (op[0] == '|' && c == '|')
+				|| (op[0] == '!' && c == '='))
+				return false;
+		}
+		pos += n;
+		return true;
+	}
+
+	bool ParseOr(bool bTop, int32_t &nPC)
+	{
+		if (!ParseAnd(nPC))
+			return false;
+
+		bool bOr = false;
+		while (Accept("||"))
+		{
+			bOr = true;
+			size_t nJump = cond.code.size() + 1;
+			Emit(OP_JTRUE); Emit(0);
+			Depth(-1);
+			int32_t nUnused;
+			if (!ParseAnd(nUnused))
+				return false;
+			Emit(OP_BOOL);
+			cond.code[nJump] = int32_t(cond.code.size());
+		}
+
+		// An address can only be taken from a chain of terms which must all
+		// be true, not from one side of an "||" or something in brackets
+		if (!bTop || bOr)
+			nPC = -1;
+		return true;
+	}
+
+	bool ParseAnd(int32_t &nPC)
+	{
+		nPC = -1;
+		if (!ParseTerm(nPC))
+			return false;
+
+		while (Accept("&&"))
+		{
+			size_t nJump = cond.code.size() + 1;
+			Emit(OP_JFALSE); Emit(0);
+			Depth(-1);
+			if (!ParseTerm(nPC))
+				return false;
+			Emit(OP_BOOL);
+			cond.code[nJump] = int32_t(cond.code.size());
+		}
+		return true;
+	}
+
+	// One term of an "&&" chain. If it is exactly "PC == constant" (either
+	// way round), the constant is remembered
+	bool ParseTerm(int32_t &nPC)
+	{
+		size_t nStart = cond.code.size();
+		if (!ParseBinary(0))
+			return false;
+
+		const std::vector<int32_t> &c = cond.code;
+		if (c.size() - nStart == 5 && c[nStart + 4] == OP_EQ)
+		{
+			if (c[nStart] == OP_REG && c[nStart + 1] == REG_PC && c[nStart + 2] == OP_CONST)
+				nPC = c[nStart + 3] & 0xFFFF;
+			if (c[nStart] == OP_CONST && c[nStart + 2] == OP_REG && c[nStart + 3] == REG_PC)
+				nPC = c[nStart + 1] & 0xFFFF;
+		}
+		return true;
+	}
+
+	// Binary operators from "|" down to "*", lowest precedence first
+	bool ParseBinary(int nLevel)
+	{
+		struct BINOP { const char *sym; int32_t op; };
+		static const std::vector<std::vector<BINOP>> levels =
+		{
+			{ { "|", OP_OR } },
+			{ { "^", OP_XOR } },
+			{ { "&", OP_AND } },
+			{ { "==", OP_EQ }, { "!=", OP_NE } },
+			{ { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT } },
+			{ { "<<", OP_SHL }, { ">>", OP_SHR } },
+			{ { "+", OP_ADD }, { "-", OP_SUB } },
+			{ { "*", OP_MUL }, { "/", OP_DIV }, { "%", OP_MOD } },
+		};
+
+		if (nLevel == (int)levels.size())
+			return ParseUnary();
+
+		if (!ParseBinary(nLevel + 1))
+			return false;
+
+		for (;;)
+		{
+			const BINOP *found = nullptr;
+			for (const BINOP &b : levels[nLevel])
+			{
+				if (Accept(b.sym))
+				{
+					found = &b;
+					break;
+				}
+			}
+			if (found == nullptr)
+				return true;
+
+			if (!ParseBinary(nLevel + 1))
+				return false;
+			Emit(found->op);
+			Depth(-1);
+		}
+	}
+
+	bool ParseUnary()
+	{
+		if (Accept("!")) { if (!ParseUnary()) return false; Emit(OP_NOT);  return true; }
+		if (Accept("~")) { if (!ParseUnary()) return false; Emit(OP_BNOT); return true; }
+		if (Accept("-")) { if (!ParseUnary()) return false; Emit(OP_NEG);  return true; }
+		return ParsePrimary();
+	}
+
+	bool ParsePrimary()
+	{
+		Skip();
+		if (pos >= src.size())
+			return Fail("unexpected end of expression");
+
+		if (Accept("("))
+		{
+			int32_t nUnused;
+			if (!ParseOr(false, nUnused))
+				return false;
+			if (!Accept(")"))
+				return Fail("expected ')'");
+			return true;
+		}
+
+		if (Accept("["))
+		{
+			int32_t nUnused;
+			if (!ParseOr(false, nUnused))
+				return false;
+			if (!Accept("]"))
+				return Fail("expected ']'");
+			Emit(OP_MEM);
+			return true;
+		}
+
+		char c = src[pos];
+		if (c == '$' || c == '%' || std::isdigit((unsigned char)c))
+			return ParseNumber();
+
+		if (std::isalpha((unsigned char)c))
+			return ParseName();
+
+		return Fail("unexpected '" + src.substr(pos, 1) + "'");
+	}
+
+	bool ParseNumber()
+	{
+		int nBase = 10;
+		if (src[pos] == '$') { nBase = 16; pos++; }
+		else if (src[pos] == '%') { nBase = 2; pos++; }
+		else if (src.compare(pos, 2, "0x") == 0 || src.compare(pos, 2, "0X") == 0) { nBase = 16; pos += 2; }
+
+		size_t nStart = pos;
+		int64_t nValue = 0;
+		while (pos < src.size())
+		{
+			char c = (char)std::tolower((unsigned char)src[pos]);
+			int d = std::isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 99;
+			if (d >= nBase)
+				break;
+			nValue = nValue * nBase + d;
+			if (nValue > 0x7FFFFFFF)
+				return Fail("number is too large");
+			pos++;
+		}
+		if (pos == nStart)
+			return Fail("expected a number");
+
+		Emit(OP_CONST); Emit(int32_t(nValue));
+		return Depth(+1);
+	}
+
+	bool ParseName()
+	{
+		size_t nStart = pos;
+		std::string s;
+		while (pos < src.size() && std::isalnum((unsigned char)src[pos]))
+			s += (char)std::toupper((unsigned char)src[pos++]);
+
+		static const std::vector<std::pair<std::string, int32_t>> regs =
+		{
+			{ "A", REG_A }, { "X", REG_X }, { "Y", REG_Y }, { "SP", REG_SP }, { "PC", REG_PC }, { "P", REG_P },
+		};
+		static const std::vector<std::pair<std::string, int32_t>> flags =
+		{
+			{ "C", olc6502::C }, { "Z", olc6502::Z }, { "I", olc6502::I }, { "D", olc6502::D },
+			{ "B", olc6502::B }, { "U", olc6502::U }, { "V", olc6502::V }, { "N", olc6502::N },
+		};
+
+		for (auto &r : regs)
+		{
+			if (r.first == s)
+			{
+				Emit(OP_REG); Emit(r.second);
+				return Depth(+1);
+			}
+		}
+		for (auto &f : flags)
+		{
+			if (f.first == s)
+			{
+				Emit(OP_FLAG); Emit(f.second);
+				return Depth(+1);
+			}
+		}
+
+		pos = nStart;
+		return Fail("unknown name '" + s + "'");
+	}
+};
+
+
+
+bool Condition::Compile(const std::string &sExpr, std::string &sError)
+{
+	sText = sExpr;
+	nEvaluations = nPasses = nTimed = nTimedNs = 0;
+	ConditionCompiler cc(*this, sExpr);
+	return cc.Compile(sError);
+}
+
+bool Condition::Evaluate(Bus &bus)
+{
+	bool bResult;
+	if ((nEvaluations++ & ((1 << TIMING_SHIFT) - 1)) == 0)
+	{
+		auto tp1 = std::chrono::steady_clock::now();
+		bResult = Run(bus);
+		auto tp2 = std::chrono::steady_clock::now();
+		nTimedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(tp2 - tp1).count();
+		nTimed++;
+	}
+	else
+		bResult = Run(bus);
+
+	nPasses += bResult;
+	return bResult;
+}
+
+// Arithmetic that can overflow is done unsigned, where it wraps, since
+// the expression is the user's and mustn't be able to crash anything
+static inline int32_t Wrap(uint32_t n) { return int32_t(n); }
+
+static inline int32_t Div(int32_t a, int32_t b)
+{
+	if (b == 0)  return 0;
+	if (b == -1) return Wrap(0u - uint32_t(a));
+	return a / b;
+}
+
+static inline int32_t Mod(int32_t a, int32_t b)
+{
+	return b == 0 || b == -1 ? 0 : a % b;
+}
+
+// The stack machine itself. The compiler has already made sure the code is
+// well formed and fits the stack.
+bool Condition::Run(Bus &bus) const
+{
+	if (code.empty())
+		return true;
+
+	int32_t stack[STACK_SIZE];
+	int sp = -1;
+	const int32_t *ip = code.data();
+	const olc6502 &cpu = bus.cpu;
+
+	for (;;)
+	{
+		int32_t r;
+		switch (*ip++)
+		{
+		case OP_END:   return stack[0] != 0;
+		case OP_CONST: stack[++sp] = *ip++; break;
+		case OP_FLAG:  stack[++sp] = (cpu.status & *ip++) ? 1 : 0; break;
+		case OP_MEM:   stack[sp] = bus.peek(uint16_t(stack[sp])); break;
+		case OP_REG:
+			switch (*ip++)
+			{
+			case REG_A:  r = cpu.a; break;
+			case REG_X:  r = cpu.x; break;
+			case REG_Y:  r = cpu.y; break;
+			case REG_SP: r = cpu.stkp; break;
+			case REG_PC: r = cpu.pc; break;
+			default:     r = cpu.status; break;
+			}
+			stack[++sp] = r;
+			break;
+
+		case OP_NOT:  stack[sp] = !stack[sp]; break;
+		case OP_BNOT: stack[sp] = ~stack[sp]; break;
+		case OP_NEG:  stack[sp] = Wrap(0u - uint32_t(stack[sp])); break;
+		case OP_BOOL: stack[sp] = stack[sp] != 0; break;
+
+		case OP_MUL: sp--; stack[sp] = Wrap(uint32_t(stack[sp]) * uint32_t(stack[sp + 1])); break;
+		case OP_DIV: sp--; stack[sp] = Div(stack[sp], stack[sp + 1]); break;
+		case OP_MOD: sp--; stack[sp] = Mod(stack[sp], stack[sp + 1]); break;
+		case OP_ADD: sp--; stack[sp] = Wrap(uint32_t(stack[sp]) + uint32_t(stack[sp + 1])); break;
+		case OP_SUB: sp--; stack[sp] = Wrap(uint32_t(stack[sp]) - uint32_t(stack[sp + 1])); break;
+		case OP_SHL: sp--; stack[sp] = Wrap(uint32_t(stack[sp]) << (stack[sp + 1] & 31)); break;
+		case OP_SHR: sp--; stack[sp] = stack[sp] >> (stack[sp + 1] & 31); break;
+		case OP_LT:  sp--; stack[sp] = stack[sp] <  stack[sp + 1]; break;
+		case OP_LE:  sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;
+		case OP_GT:  sp--; stack[sp] = stack[sp] >  stack[sp + 1]; break;
+		case OP_GE:  sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;
+		case OP_EQ:  sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;
+		case OP_NE:  sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;
+		case OP_AND: sp--; stack[sp] = stack[sp] &  stack[sp + 1]; break;
+		case OP_XOR: sp--; stack[sp] = stack[sp] ^  stack[sp + 1]; break;
+		case OP_OR:  sp--; stack[sp] = stack[sp] |  stack[sp + 1]; break;
+
+		case OP_JFALSE:
+			if (stack[sp] == 0) ip = code.data() + *ip;
+			else { sp--; ip++; }
+			break;
+
+		case OP_JTRUE:
+			if (stack[sp] != 0) { stack[sp] = 1; ip = code.data() + *ip; }
+			else { sp--; ip++; }
+			break;
+		}
+	}
+}
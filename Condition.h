@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Bus;
+
+// Breakpoint Conditions ==============================================
+// A condition is a small C-like expression over the CPU state, such as
+// "PC == $8010 && A > $80 && [$0002] == 0". It is compiled once, when
+// the breakpoint is set, into bytecode for a tiny stack machine, so that
+// checking it when the breakpoint address is reached is a short loop over
+// an array rather than a walk over a tree of parsed nodes.
+//
+// Operands:   A X Y SP PC P           registers (P is the status register)
+//             C Z I D B U V N         single flags, either 0 or 1
+//             [expr]                  the byte at an address, read without
+//                                     side effects
+//             123  $7F  0x7F  %0101   numbers
+// Operators:  ( ) ! ~ - * / % + - << >> < <= > >= == != & ^ | && ||
+//             with the same meaning and precedence as in C, on 32 bit
+//             signed values that wrap around rather than overflow. x / 0
+//             and x % 0 are 0
+//
+// Names are not case sensitive.
+class Condition
+{
+public:
+	// Compiles an expression. On failure, returns false and explains why
+	bool Compile(const std::string &sExpr, std::string &sError);
+
+	// Evaluates the compiled expression against the bus and its CPU
+	bool Evaluate(Bus &bus);
+
+	const std::string& text() const { return sText; }
+
+	// If the whole expression requires PC to equal a constant, i.e. there is
+	// a "PC == value" term at the top level of an "&&" chain, this gives the
+	// address. It lets a breakpoint be set from the condition alone
+	bool HasAddress() const { return bHasAddress; }
+	uint16_t address() const { return nAddress; }
+
+	// Cost accounting. Every evaluation is counted, and one in every
+	// 2^TIMING_SHIFT is timed, as timing all of them would cost more
+	// than evaluating them
+	uint64_t Evaluations() const { return nEvaluations; }
+	uint64_t Passes() const { return nPasses; }
+	double   AverageNs() const { return nTimed ? double(nTimedNs) / double(nTimed) : 0.0; }
+
+private:
+	friend class ConditionCompiler;
+
+	static constexpr int STACK_SIZE   = 32;
+	static constexpr int TIMING_SHIFT = 4;
+
+	std::vector<int32_t> code;
+	std::string sText;
+	bool     bHasAddress  = false;
+	uint16_t nAddress     = 0x0000;
+
+	uint64_t nEvaluations = 0;
+	uint64_t nPasses      = 0;
+	uint64_t nTimed       = 0;
+	uint64_t nTimedNs     = 0;
+
+	bool Run(Bus &bus) const;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+// Device =============================================================
+// Something on the bus other than plain memory, e.g. a timer chip or a
+// serial port. A device is attached to the bus for one or more address
+// ranges with Bus::Attach(). The pages those ranges touch are taken out
+// of the bus's page table, so only accesses to them reach the device
+// through a virtual call. Accesses anywhere else go straight to memory.
+//
+// The CPU's accesses go to read() and write(), which may have side
+// effects as on the real hardware: reading a status register can clear
+// it, writing a data register can start a transfer.
+//
+// Debuggers use peek() and poke() instead. peek() must return what a
+// read() would, without changing anything. poke() sets what a later
+// read() would return as directly as the device allows, without
+// starting anything. A register that can't be set that way ignores it.
+//
+// addr is the full bus address, so a device can decode it however the
+// board wires it.
+//
+// Nothing is ticked every cycle. Before any access the bus calls tick()
+// with the CPU's clock count, so a device works out what happened since
+// it was last looked at, e.g. how far a timer has counted, and only
+// then answers. Anything that must happen at a particular time without
+// being looked at, such as raising an interrupt, is an event on the
+// bus's Scheduler.
+class Device
+{
+public:
+	virtual ~Device() = default;
+
+	virtual uint8_t read(uint16_t addr) = 0;
+	virtual void    write(uint16_t addr, uint8_t data) = 0;
+
+	virtual uint8_t peek(uint16_t addr) const = 0;
+	virtual void    poke(uint16_t addr, uint8_t data) = 0;
+
+	// Catch up to clock count nClock. If the clock has gone back, as it
+	// does after a rewind, that is simply taken as the time now
+	virtual void tick(uint64_t nClock) {}
+
+	// The reset line, asserted along with the CPU's
+	virtual void reset() {}
+};
@@ -0,0 +1,286 @@
+#include <cstdio>
+#include <cstring>
+
+#include "InputJournal.h"
+#include "Bus.h"
+
+
+
+InputJournal::InputJournal()
+{
+}
+
+void InputJournal::ConnectBus(Bus *n)
+{
+	bus = n;
+	nEvent = bus->sched.Register([this](uint64_t now) { Dispatch(now); });
+	input_handler = [this](uint16_t port, uint8_t data) { bus->write(port, data); };
+}
+
+void InputJournal::reset()
+{
+	EVENT e;
+	e.type = EVENT_RESET;
+	Raise(e);
+}
+
+void InputJournal::irq()
+{
+	EVENT e;
+	e.type = EVENT_IRQ;
+	Raise(e);
+}
+
+void InputJournal::nmi()
+{
+	EVENT e;
+	e.type = EVENT_NMI;
+	Raise(e);
+}
+
+void InputJournal::input(uint16_t port, uint8_t data)
+{
+	EVENT e;
+	e.type = EVENT_INPUT;
+	e.port = port;
+	e.data = data;
+	Raise(e);
+}
+
+void InputJournal::Raise(const EVENT &e)
+{
+	switch (mode)
+	{
+	case MODE_OFF:
+		Apply(e);
+		break;
+
+	case MODE_REPLAY:
+		// Only the journal gets to change what happens
+		break;
+
+	case MODE_RECORD:
+		if (bus->cpu.complete())
+		{
+			EVENT r = e;
+			r.cycle = bus->cpu.GetClockCount();
+			Apply(r);
+			events.push_back(r);
+			cursor = events.size();
+		}
+		else
+		{
+			// Wait for the boundary, which is where a replay can inject it
+			pending.push_back(e);
+			bus->sched.Schedule(nEvent, bus->cpu.GetClockCount());
+		}
+		break;
+	}
+}
+
+void InputJournal::Apply(const EVENT &e)
+{
+	switch (e.type)
+	{
+	case EVENT_RESET: bus->reset(); break;
+	case EVENT_IRQ:   bus->cpu.irq();   break;
+	case EVENT_NMI:   bus->cpu.nmi();   break;
+	case EVENT_INPUT: input_handler(e.port, e.data); break;
+	}
+}
+
+// Runs from the scheduler, at an instruction boundary
+void InputJournal::Dispatch(uint64_t now)
+{
+	while (cursor < events.size() && events[cursor].cycle <= now)
+		Apply(events[cursor++]);
+
+	if (mode == MODE_RECORD)
+	{
+		for (auto &e : pending)
+		{
+			e.cycle = now;
+			Apply(e);
+			events.push_back(e);
+		}
+		cursor = events.size();
+	}
+	pending.clear();
+
+	Reschedule();
+}
+
+void InputJournal::Reschedule()
+{
+	if (cursor < events.size())
+		bus->sched.Schedule(nEvent, events[cursor].cycle);
+	else if (!pending.empty())
+		bus->sched.Schedule(nEvent, bus->cpu.GetClockCount());
+	else
+		bus->sched.Cancel(nEvent);
+}
+
+void InputJournal::StartRecording()
+{
+	bus->cpu.SaveState(start_cpu);
+	start_ram = bus->ram;
+	events.clear();
+	pending.clear();
+	cursor = 0;
+	nEnd = 0;
+	mode = MODE_RECORD;
+	bLoaded = true;
+	Reschedule();
+}
+
+bool InputJournal::StartReplay()
+{
+	if (mode == MODE_RECORD)
+		Stop();
+	if (!bLoaded)
+		return false;
+
+	bus->ram = start_ram;
+	for (auto &g : bus->page_gen)
+		g++;
+	bus->cpu.LoadState(start_cpu);
+
+	pending.clear();
+	cursor = 0;
+	mode = MODE_REPLAY;
+	Reschedule();
+	return true;
+}
+
+bool InputJournal::RunReplay()
+{
+	if (!StartReplay())
+		return false;
+
+	while (bus->cpu.GetClockCount() < nEnd)
+	{
+		if (bus->cpu.run(nEnd - bus->cpu.GetClockCount()))
+			return false;
+	}
+	return true;
+}
+
+void InputJournal::Stop()
+{
+	if (mode == MODE_RECORD)
+		nEnd = bus->cpu.GetClockCount();
+
+	mode = MODE_OFF;
+	pending.clear();
+	bus->sched.Cancel(nEvent);
+}
+
+uint64_t InputJournal::EndCycle() const
+{
+	return mode == MODE_RECORD ? bus->cpu.GetClockCount() : nEnd;
+}
+
+void InputJournal::SetPosition(size_t n)
+{
+	cursor = n < events.size() ? n : events.size();
+	Reschedule();
+}
+
+void InputJournal::Truncate()
+{
+	if (mode == MODE_RECORD)
+	{
+		events.resize(cursor);
+		pending.clear();
+		Reschedule();
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FILES
+
+// The layout is simply each field in turn, in host byte order:
+//   "OLCJNL02", the starting CPU state, its call stack frames, 64KB of
+//   RAM, the end cycle, the number of events and then the events
+// Version 02 added whether the CPU was halted by WAI, STP or KIL
+static const char JOURNAL_MAGIC[8] = { 'O', 'L', 'C', 'J', 'N', 'L', '0', '2' };
+
+template <typename T>
+static bool Put(FILE *f, const T &v) { return fwrite(&v, sizeof(T), 1, f) == 1; }
+
+template <typename T>
+static bool Get(FILE *f, T &v) { return fread(&v, sizeof(T), 1, f) == 1; }
+
+bool InputJournal::Save(const std::string &sFile) const
+{
+	FILE *f = fopen(sFile.c_str(), "wb");
+	if (f == nullptr)
+		return false;
+
+	const olc6502::STATE &s = start_cpu;
+	bool ok = fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, f) == 1
+		&& Put(f, s.a) && Put(f, s.x) && Put(f, s.y) && Put(f, s.stkp) && Put(f, s.status)
+		&& Put(f, s.pc) && Put(f, s.cycles) && Put(f, s.halt) && Put(f, s.clock_count) && Put(f, s.instr_count)
+		&& Put(f, (uint32_t)s.frames.size());
+	for (auto &fr : s.frames)
+		ok = ok && Put(f, fr.target) && Put(f, fr.ret) && Put(f, fr.stkp) && Put(f, fr.type) && Put(f, fr.entry);
+
+	ok = ok && fwrite(start_ram.data(), start_ram.size(), 1, f) == 1
+		&& Put(f, EndCycle()) && Put(f, (uint64_t)events.size());
+	for (auto &e : events)
+		ok = ok && Put(f, e.cycle) && Put(f, e.type) && Put(f, e.data) && Put(f, e.port);
+
+	return (fclose(f) == 0) && ok;
+}
+
+bool InputJournal::Load(const std::string &sFile)
+{
+	FILE *f = fopen(sFile.c_str(), "rb");
+	if (f == nullptr)
+		return false;
+
+	char magic[8];
+	olc6502::STATE s;
+	uint32_t nFrames = 0;
+	uint64_t nEvents = 0, nEndCycle = 0;
+	std::vector<EVENT> loaded;
+
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0
+		&& Get(f, s.a) && Get(f, s.x) && Get(f, s.y) && Get(f, s.stkp) && Get(f, s.status)
+		&& Get(f, s.pc) && Get(f, s.cycles) && Get(f, s.halt) && Get(f, s.clock_count) && Get(f, s.instr_count)
+		&& s.halt <= olc6502::HALT_STP && Get(f, nFrames) && nFrames <= 256;
+	for (uint32_t i = 0; ok && i < nFrames; i++)
+	{
+		olc6502::FRAME fr;
+		ok = Get(f, fr.target) && Get(f, fr.ret) && Get(f, fr.stkp) && Get(f, fr.type) && Get(f, fr.entry)
+			&& fr.type <= olc6502::FRAME_NMI;
+		s.frames.push_back(fr);
+	}
+
+	std::array<uint8_t, 64 * 1024> ram;
+	// Replay delivers events in order, so they must be in cycle order
+	ok = ok && fread(ram.data(), ram.size(), 1, f) == 1 && Get(f, nEndCycle) && Get(f, nEvents);
+	for (uint64_t i = 0; ok && i < nEvents; i++)
+	{
+		EVENT e;
+		ok = Get(f, e.cycle) && Get(f, e.type) && Get(f, e.data) && Get(f, e.port)
+			&& e.type <= EVENT_INPUT && (loaded.empty() || e.cycle >= loaded.back().cycle);
+		loaded.push_back(e);
+	}
+	fclose(f);
+
+	if (!ok)
+		return false;
+
+	if (mode != MODE_OFF)
+		Stop();
+	start_cpu = s;
+	start_ram = ram;
+	events = loaded;
+	nEnd = nEndCycle;
+	cursor = 0;
+	bLoaded = true;
+	return true;
+}
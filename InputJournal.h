@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <functional>
+
+#include "olc6502.h"
+
+class Bus;
+
+// Input Journal ======================================================
+// Everything that reaches the machine from outside, i.e. reset, irq,
+// nmi and bytes delivered by input devices, goes through here. While
+// recording, each event is logged with the clock count it took effect
+// at. Replaying starts from the same machine state and re-injects every
+// event at exactly the same cycle through the scheduler, so a replay
+// runs the same instructions, and produces the same trace, as the
+// original session. Nothing is throttled, so a replay runs as fast as
+// the host allows.
+//
+// Events only ever take effect at instruction boundaries. One raised in
+// the middle of an instruction while recording is held back to the next
+// boundary, which is also where it will be replayed.
+class InputJournal
+{
+public:
+	InputJournal();
+
+	void ConnectBus(Bus *n);
+
+	enum EVENTTYPE : uint8_t
+	{
+		EVENT_RESET,
+		EVENT_IRQ,
+		EVENT_NMI,
+		EVENT_INPUT,
+	};
+
+	struct EVENT
+	{
+		uint64_t cycle = 0;
+		uint8_t  type  = EVENT_RESET;
+		uint8_t  data  = 0x00;		// EVENT_INPUT: the byte
+		uint16_t port  = 0x0000;	// EVENT_INPUT: where it is delivered
+	};
+
+	// External events, used in place of calling the CPU directly. When
+	// recording they are logged and applied, when replaying they are
+	// ignored as the journal is in charge, and otherwise they are simply
+	// passed through
+	void reset();
+	void irq();
+	void nmi();
+	void input(uint16_t port, uint8_t data);
+
+	// Receives EVENT_INPUT bytes. By default they are written to the bus
+	// at "port", which suits a simple memory mapped input latch
+	std::function<void(uint16_t, uint8_t)> input_handler;
+
+	// Takes the current machine state as the starting point and begins
+	// logging events
+	void StartRecording();
+
+	// Puts the machine back to the starting state and injects logged
+	// events as the clock reaches them. Returns false if nothing is loaded
+	bool StartReplay();
+
+	// StartReplay() then runs flat out to the end of the journal. Returns
+	// false if there was nothing to replay or a breakpoint stopped it
+	bool RunReplay();
+
+	void Stop();
+	bool IsRecording() const { return mode == MODE_RECORD; }
+	bool IsReplaying() const { return mode == MODE_REPLAY; }
+
+	// Clock count at which the session ended
+	uint64_t EndCycle() const;
+	const std::vector<EVENT>& Events() const { return events; }
+
+	// A journal file holds the starting state and the events, so it can be
+	// replayed without the original program
+	bool Save(const std::string &sFile) const;
+	bool Load(const std::string &sFile);
+
+	// For rewind: how many events have taken effect, moving that point
+	// back so they are injected again, and forgetting the ones not yet
+	// re-injected when recording
+	size_t Position() const { return cursor; }
+	void   SetPosition(size_t n);
+	void   Truncate();
+
+private:
+	enum MODE
+	{
+		MODE_OFF,
+		MODE_RECORD,
+		MODE_REPLAY,
+	};
+
+	Bus     *bus    = nullptr;
+	int      nEvent = -1;
+	MODE     mode   = MODE_OFF;
+	size_t   cursor = 0;
+	uint64_t nEnd   = 0;
+	bool     bLoaded = false;
+
+	olc6502::STATE start_cpu;
+	std::array<uint8_t, 64 * 1024> start_ram;
+
+	std::vector<EVENT> events;
+	std::vector<EVENT> pending;		// Raised mid-instruction while recording
+
+	void Raise(const EVENT &e);
+	void Apply(const EVENT &e);
+	void Dispatch(uint64_t now);
+	void Reschedule();
+};
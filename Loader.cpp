@@ -0,0 +1,362 @@
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Loader.h"
+#include "Bus.h"
+#include "Assembler.h"
+
+
+
+Loader::Loader()
+{
+}
+
+void Loader::ConnectBus(Bus *n)
+{
+	bus = n;
+}
+
+const char* Loader::FormatName(FORMAT format)
+{
+	switch (format)
+	{
+	case FORMAT_RAW:  return "raw";
+	case FORMAT_PRG:  return "PRG";
+	case FORMAT_IHEX: return "Intel HEX";
+	case FORMAT_SREC: return "S-record";
+	case FORMAT_ASM:  return "assembly";
+	default:          return "auto";
+	}
+}
+
+Loader::FORMAT Loader::Detect(const uint8_t *data, size_t size, const std::string &sName)
+{
+	// The extension says best, as a PRG can't be told from a raw binary
+	std::string sExt;
+	size_t nDot = sName.find_last_of('.');
+	if (nDot != std::string::npos && sName.find_first_of("/\\", nDot) == std::string::npos)
+		sExt = sName.substr(nDot + 1);
+	for (auto &c : sExt)
+		c = tolower((unsigned char)c);
+
+	if (sExt == "prg")
+		return FORMAT_PRG;
+	if (sExt == "hex" || sExt == "ihx" || sExt == "ihex")
+		return FORMAT_IHEX;
+	if (sExt == "srec" || sExt == "s19" || sExt == "s28" || sExt == "s37" || sExt == "mot")
+		return FORMAT_SREC;
+	if (sExt == "s" || sExt == "asm" || sExt == "a65")
+		return FORMAT_ASM;
+
+	// Otherwise a text file starting with a record marker
+	size_t i = 0;
+	while (i < size && isspace(data[i]))
+		i++;
+	if (i + 2 < size && data[i] == ':' && isxdigit(data[i + 1]) && isxdigit(data[i + 2]))
+		return FORMAT_IHEX;
+	if (i + 2 < size && data[i] == 'S' && isdigit(data[i + 1]) && isxdigit(data[i + 2]))
+		return FORMAT_SREC;
+
+	return FORMAT_RAW;
+}
+
+bool Loader::Load(const std::string &sFile, FORMAT fmt)
+{
+	int fd = open(sFile.c_str(), O_RDONLY);
+	if (fd < 0)
+		return Fail("can't open " + sFile);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return Fail(sFile + " is empty");
+	}
+
+	size_t size = (size_t)st.st_size;
+	void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return Fail("can't map " + sFile);
+
+	madvise(p, size, MADV_SEQUENTIAL);
+	bool ok = Load((const uint8_t*)p, size, fmt, sFile);
+	munmap(p, size);
+	return ok;
+}
+
+bool Loader::Load(const uint8_t *data, size_t size, FORMAT fmt, const std::string &sName)
+{
+	format   = fmt == FORMAT_AUTO ? Detect(data, size, sName) : fmt;
+	nLowest  = 0xFFFF;
+	nHighest = 0x0000;
+	nBytes   = 0;
+	nEntry   = 0x0000;
+	bEntry   = false;
+	bVector  = false;
+	sError.clear();
+
+	bool ok = false;
+	switch (format)
+	{
+	case FORMAT_PRG:
+		if (size < 2)
+			return Fail("PRG file has no load address");
+		ok = LoadRaw(data + 2, size - 2, data[0] | (data[1] << 8));
+		break;
+
+	case FORMAT_IHEX:
+		ok = LoadIHex((const char*)data, size);
+		break;
+
+	case FORMAT_SREC:
+		ok = LoadSRec((const char*)data, size);
+		break;
+
+	case FORMAT_ASM:
+		ok = LoadAsm((const char*)data, size);
+		break;
+
+	default:
+		ok = LoadRaw(data, size, nRawAddr);
+		break;
+	}
+
+	if (!ok)
+		return false;
+	if (nBytes == 0)
+		return Fail("nothing to load");
+
+	if (!bEntry)
+		nEntry = nLowest;
+
+	if (bSetVector && !bVector)
+	{
+		uint8_t vector[2] = { (uint8_t)(nEntry & 0xFF), (uint8_t)(nEntry >> 8) };
+		bus->Store(0xFFFC, vector, 2);
+	}
+
+	return true;
+}
+
+bool Loader::Fail(const std::string &s, size_t nLine)
+{
+	sError = nLine ? "line " + std::to_string(nLine) + ": " + s : s;
+	return false;
+}
+
+bool Loader::Put(uint32_t addr, const uint8_t *data, size_t n)
+{
+	if (n == 0)
+		return true;
+	if (addr + n > 0x10000)
+		return Fail("image goes past $FFFF");
+
+	bus->Store((uint16_t)addr, data, n);
+
+	uint16_t nLast = (uint16_t)(addr + n - 1);
+	nLowest  = std::min(nLowest, (uint16_t)addr);
+	nHighest = std::max(nHighest, nLast);
+	nBytes  += n;
+	if (addr <= 0xFFFC && nLast >= 0xFFFD)
+		bVector = true;
+	return true;
+}
+
+bool Loader::LoadRaw(const uint8_t *data, size_t size, uint16_t addr)
+{
+	return Put(addr, data, size);
+}
+
+// Both text formats are lines of hex digit pairs after a one or two
+// character prefix. A record is decoded into bytes before it is checked
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static bool DecodeRecord(const char *s, size_t n, uint8_t *out, size_t &nOut)
+{
+	if (n % 2 != 0 || n / 2 > 256)
+		return false;
+
+	for (size_t i = 0; i < n; i += 2)
+	{
+		int hi = HexDigit(s[i]), lo = HexDigit(s[i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		out[i / 2] = (uint8_t)((hi << 4) | lo);
+	}
+	nOut = n / 2;
+	return true;
+}
+
+// Calls f(line, length, number) for each line, without its end of line,
+// skipping blank ones. Stops early if f returns false
+template <typename F>
+static bool ForEachLine(const char *text, size_t size, F f)
+{
+	const char *end = text + size;
+	size_t nLine = 0;
+	while (text < end)
+	{
+		const char *eol = (const char*)memchr(text, '\n', end - text);
+		if (eol == nullptr)
+			eol = end;
+		nLine++;
+
+		size_t n = eol - text;
+		while (n > 0 && isspace((unsigned char)text[n - 1]))
+			n--;
+		if (n > 0 && !f(text, n, nLine))
+			return false;
+		text = eol + 1;
+	}
+	return true;
+}
+
+bool Loader::LoadIHex(const char *text, size_t size)
+{
+	bool bEnd = false;
+	bool ok = ForEachLine(text, size, [&](const char *s, size_t n, size_t nLine)
+	{
+		if (bEnd)
+			return true;	// Anything after the end of file record is ignored
+
+		// :LLAAAATT, the data, then a checksum making the sum of them all 0
+		uint8_t rec[256 + 5];
+		size_t nRec = 0;
+		if (s[0] != ':' || !DecodeRecord(s + 1, n - 1, rec, nRec) || nRec < 5)
+			return Fail("not an Intel HEX record", nLine);
+
+		uint8_t nLen = rec[0];
+		if (nRec != (size_t)nLen + 5)
+			return Fail("wrong record length", nLine);
+
+		uint8_t nSum = 0;
+		for (size_t i = 0; i < nRec; i++)
+			nSum += rec[i];
+		if (nSum != 0)
+			return Fail("bad checksum", nLine);
+
+		uint16_t addr = (rec[1] << 8) | rec[2];
+		const uint8_t *data = rec + 4;
+		switch (rec[3])
+		{
+		case 0x00:	// Data
+			return Put(addr, data, nLen) || Fail(sError, nLine);
+
+		case 0x01:	// End of file
+			bEnd = true;
+			return true;
+
+		case 0x02:	// Extended segment address
+		case 0x04:	// Extended linear address
+			if (nLen != 2)
+				return Fail("bad extended address record", nLine);
+			if (data[0] || data[1])
+				return Fail("address beyond 64K", nLine);
+			return true;
+
+		case 0x03:	// Start segment address, CS:IP
+		case 0x05:	// Start linear address
+		{
+			if (nLen != 4)
+				return Fail("bad start address record", nLine);
+			uint32_t nStart = rec[3] == 0x03
+				? ((data[0] << 8 | data[1]) << 4) + (data[2] << 8 | data[3])
+				: (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+			if (nStart > 0xFFFF)
+				return Fail("start address beyond 64K", nLine);
+			nEntry = (uint16_t)nStart;
+			bEntry = true;
+			return true;
+		}
+
+		default:
+			return Fail("unknown record type", nLine);
+		}
+	});
+
+	return ok;
+}
+
+bool Loader::LoadSRec(const char *text, size_t size)
+{
+	return ForEachLine(text, size, [&](const char *s, size_t n, size_t nLine)
+	{
+		// Stcc, then the address, data and a checksum, cc bytes in all,
+		// the checksum making the sum of them all 0xFF
+		uint8_t rec[256 + 1];
+		size_t nRec = 0;
+		if (n < 4 || s[0] != 'S' || !isdigit((unsigned char)s[1]) || !DecodeRecord(s + 2, n - 2, rec, nRec))
+			return Fail("not an S-record", nLine);
+
+		if (nRec != (size_t)rec[0] + 1)
+			return Fail("wrong record length", nLine);
+
+		uint8_t nSum = 0;
+		for (size_t i = 0; i < nRec; i++)
+			nSum += rec[i];
+		if (nSum != 0xFF)
+			return Fail("bad checksum", nLine);
+
+		// Bytes of address for S0 to S9
+		static const int nAddrBytes[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+		int type = s[1] - '0';
+		int nAddr = nAddrBytes[type];
+		if (type == 4 || nRec < (size_t)nAddr + 2)
+			return Fail("bad record", nLine);
+
+		uint32_t addr = 0;
+		for (int i = 0; i < nAddr; i++)
+			addr = (addr << 8) | rec[1 + i];
+		const uint8_t *data = rec + 1 + nAddr;
+		size_t nData = nRec - nAddr - 2;
+
+		switch (type)
+		{
+		case 1: case 2: case 3:
+			if (addr > 0xFFFF)
+				return Fail("address beyond 64K", nLine);
+			return Put(addr, data, nData) || Fail(sError, nLine);
+
+		case 7: case 8: case 9:
+			// Often written as 0 when there is no entry point
+			if (addr > 0xFFFF)
+				return Fail("start address beyond 64K", nLine);
+			if (addr != 0)
+			{
+				nEntry = (uint16_t)addr;
+				bEntry = true;
+			}
+			return true;
+
+		default:	// S0 header, S5/S6 record count
+			return true;
+		}
+	});
+}
+
+bool Loader::LoadAsm(const char *text, size_t size)
+{
+	Assembler as;
+	as.ConnectBus(bus);
+	as.nOrigin = nRawAddr;
+	if (!as.Assemble(std::string(text, size)))
+		return Fail(as.Error());
+
+	nLowest  = as.Lowest();
+	nHighest = as.Highest();
+	nBytes   = as.Bytes();
+	bVector  = nHighest >= 0xFFFD;
+	return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+class Bus;
+
+// Loader =============================================================
+// Puts a program image into the bus's memory. The file is mapped rather
+// than read, and each block of bytes is copied into memory a page at a
+// time, so a binary image loads as fast as memcpy allows. The text formats are
+// decoded a record at a time, then copied the same way.
+//
+// Supported formats:
+//		raw		the bytes as they are, loaded at nRawAddr
+//		PRG		Commodore program file, a 2-byte little endian load
+//				address followed by the bytes
+//		IHEX	Intel HEX, 16-bit addresses only (records 00, 01, 03, 05,
+//				and 02/04 with a zero base)
+//		SREC	Motorola S-records (S0-S3, S5-S9), within 64K
+//		ASM		6502 source, put through the Assembler with nRawAddr as
+//				the origin
+//
+// Loading goes through Bus::Store(), like a programmer would, so it
+// doesn't trigger watchpoints. Bytes land in whatever memory is mapped
+// at their page, such as a bank's window rather than the RAM under it,
+// and a page with devices in it has them poked a byte at a time. The
+// write generation of every page touched is bumped.
+//
+// Unless the image has bytes at $FFFC/$FFFD, the reset vector is set to
+// the image's entry point: the start address record of a HEX file, the
+// termination record of an S-record file if it isn't zero, and otherwise
+// the lowest address loaded. Source that reaches $FFFD is taken to set
+// the vector itself.
+class Loader
+{
+public:
+	Loader();
+
+	void ConnectBus(Bus *n);
+
+	enum FORMAT
+	{
+		FORMAT_AUTO,	// From the file's extension, or else its contents
+		FORMAT_RAW,
+		FORMAT_PRG,
+		FORMAT_IHEX,
+		FORMAT_SREC,
+		FORMAT_ASM,
+	};
+
+	// Where raw images go, and where source starts. The demo's programs
+	// are assembled for $8000
+	uint16_t nRawAddr = 0x8000;
+
+	// Set the reset vector to the entry point as above
+	bool bSetVector = true;
+
+	// Returns false, with Error() saying why, if the file couldn't be
+	// read or isn't valid. An invalid file can have been partly loaded
+	bool Load(const std::string &sFile, FORMAT format = FORMAT_AUTO);
+
+	// The same from memory. sName is only used to pick the format
+	bool Load(const uint8_t *data, size_t size, FORMAT format, const std::string &sName = "");
+
+	static FORMAT Detect(const uint8_t *data, size_t size, const std::string &sName);
+	static const char* FormatName(FORMAT format);
+
+	// What the last load did
+	FORMAT   Format()  const { return format; }
+	uint16_t Lowest()  const { return nLowest; }
+	uint16_t Highest() const { return nHighest; }
+	size_t   Bytes()   const { return nBytes; }
+	uint16_t Entry()   const { return nEntry; }
+	const std::string& Error() const { return sError; }
+
+private:
+	Bus *bus = nullptr;
+
+	FORMAT   format   = FORMAT_AUTO;
+	uint16_t nLowest  = 0x0000;
+	uint16_t nHighest = 0x0000;
+	size_t   nBytes   = 0;
+	uint16_t nEntry   = 0x0000;
+	bool     bEntry   = false;		// The image gave an entry point
+	bool     bVector  = false;		// The image has its own reset vector
+	std::string sError;
+
+	bool Put(uint32_t addr, const uint8_t *data, size_t n);
+	bool Fail(const std::string &s, size_t nLine = 0);
+
+	bool LoadRaw(const uint8_t *data, size_t size, uint16_t addr);
+	bool LoadIHex(const char *text, size_t size);
+	bool LoadSRec(const char *text, size_t size);
+	bool LoadAsm(const char *text, size_t size);
+};
@@ -0,0 +1,243 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <array>
+#include <vector>
+#include <string>
+
+#include "Bus.h"
+#include "olc6502.h"
+#include "Symbols.h"
+
+// Lockstep Comparison ================================================
+// Runs two CPU cores over identical memory images one instruction at a
+// time, and after every instruction compares their registers, the number
+// of cycles it took and the stores it made, in order. Everything happens
+// in memory, and the only history kept is a ring of the last few
+// instructions, so it runs at the speed of the slower core. When the
+// cores disagree, Report() prints that history and both sides of the
+// instruction that differed.
+//
+// Each core is wrapped in an adapter with these members:
+//
+//	const char* Name() const;
+//	void  Load(const std::array<uint8_t, 64 * 1024> &image);
+//	void  SetState(const LOCKSTEP_STATE &s);
+//	LOCKSTEP_STATE State() const;
+//	bool  Step();		// One instruction. False if it can't be executed
+//	const std::vector<Bus::WRITE>& Writes() const;	// Made by the last Step()
+//	uint8_t Peek(uint16_t addr) const;
+//
+// B and U are not compared, as they don't exist in the status register
+// itself, only in the copy pushed onto the stack.
+
+struct LOCKSTEP_STATE
+{
+	uint8_t  a = 0x00, x = 0x00, y = 0x00;
+	uint8_t  stkp = 0xFD;
+	uint8_t  status = 0x24;
+	uint16_t pc = 0x0000;
+	uint64_t cycles = 0;		// Total since the start
+};
+
+template <typename CORE_A, typename CORE_B>
+class Lockstep
+{
+public:
+	typedef LOCKSTEP_STATE STATE;
+
+	// Names for the addresses in Report(), if set
+	const Symbols *symbols = nullptr;
+
+	Lockstep(CORE_A &a, CORE_B &b, size_t nHistory = 32)
+		: core_a(a), core_b(b), history(nHistory ? nHistory : 1)
+	{
+	}
+
+	enum RESULT
+	{
+		RESULT_OK,			// Ran the requested number of instructions
+		RESULT_DIVERGED,	// The cores disagreed
+		RESULT_UNSUPPORTED,	// A core could not execute an instruction
+	};
+
+	// Puts both cores in the same state over the same memory
+	void Start(const std::array<uint8_t, 64 * 1024> &image, const STATE &s)
+	{
+		core_a.Load(image);
+		core_b.Load(image);
+		core_a.SetState(s);
+		core_b.SetState(s);
+		nInstructions = 0;
+		nHistory = 0;
+		result = RESULT_OK;
+	}
+
+	RESULT Run(uint64_t nCount)
+	{
+		for (uint64_t i = 0; i < nCount; i++)
+		{
+			// Keep the instruction's bytes before it can overwrite them
+			ENTRY &e = history[nHistory % history.size()];
+			e.before = core_a.State();
+			for (int n = 0; n < 3; n++)
+				e.bytes[n] = core_a.Peek(e.before.pc + n);
+
+			sUnsupported = !core_a.Step() ? core_a.Name() : !core_b.Step() ? core_b.Name() : nullptr;
+			if (sUnsupported)
+			{
+				result = RESULT_UNSUPPORTED;
+				return result;
+			}
+
+			nInstructions++;
+			nHistory++;
+
+			e.after_a = core_a.State();
+			e.after_b = core_b.State();
+			e.nWrites = core_a.Writes().size() < MAX_WRITES ? core_a.Writes().size() : MAX_WRITES;
+			for (size_t n = 0; n < e.nWrites; n++)
+				e.writes[n] = core_a.Writes()[n];
+
+			if (!Same(e.after_a, e.after_b) || !SameWrites(core_a.Writes(), core_b.Writes()))
+			{
+				writes_a = core_a.Writes();
+				writes_b = core_b.Writes();
+				result = RESULT_DIVERGED;
+				return result;
+			}
+		}
+		return result;
+	}
+
+	uint64_t Instructions() const { return nInstructions; }
+
+	// Prints the recent history and, after a divergence, both sides of
+	// the instruction where it happened
+	void Report(FILE *f) const
+	{
+		// An unsupported instruction has an entry, but was never completed
+		size_t nEntries = nHistory + (result == RESULT_UNSUPPORTED ? 1 : 0);
+		size_t nShown = nEntries < history.size() ? nEntries : history.size();
+
+		fprintf(f, "Last %zu instructions:\n", nShown);
+		for (size_t i = nEntries - nShown; i < nEntries; i++)
+		{
+			const ENTRY &e = history[i % history.size()];
+			bool bLast = i + 1 == nEntries;
+
+			if (const char *sName = symbols ? symbols->Name(e.before.pc) : nullptr)
+				fprintf(f, "  %s:\n", sName);
+
+			if (result == RESULT_UNSUPPORTED && bLast)
+			{
+				fprintf(f, "  %s <- not supported by %s\n", Describe(e.before, e.bytes).c_str(), sUnsupported);
+				break;
+			}
+
+			fprintf(f, "  %s %s\n", Describe(e.before, e.bytes).c_str(), Registers(e.after_a).c_str());
+			if (result == RESULT_DIVERGED && bLast)
+			{
+				fprintf(f, "\nDiverged at instruction %llu:\n", (unsigned long long)nInstructions);
+				fprintf(f, "  %-8s %s%s\n", core_a.Name(), Registers(e.after_a).c_str(), WriteList(writes_a).c_str());
+				fprintf(f, "  %-8s %s%s\n", core_b.Name(), Registers(e.after_b).c_str(), WriteList(writes_b).c_str());
+			}
+			else
+			{
+				for (size_t n = 0; n < e.nWrites; n++)
+					fprintf(f, "      $%04X <- $%02X\n", e.writes[n].addr, e.writes[n].data);
+			}
+		}
+	}
+
+private:
+	static const size_t MAX_WRITES = 4;
+
+	struct ENTRY
+	{
+		STATE   before, after_a, after_b;
+		uint8_t bytes[3] = { 0, 0, 0 };
+		size_t  nWrites = 0;
+		Bus::WRITE writes[MAX_WRITES];
+	};
+
+	CORE_A &core_a;
+	CORE_B &core_b;
+	std::vector<ENTRY> history;
+	size_t   nHistory = 0;
+	uint64_t nInstructions = 0;
+	RESULT   result = RESULT_OK;
+	const char *sUnsupported = nullptr;
+	std::vector<Bus::WRITE> writes_a, writes_b;
+
+	static bool Same(const STATE &p, const STATE &q)
+	{
+		const uint8_t mask = (uint8_t)~(olc6502::B | olc6502::U);
+		return p.a == q.a && p.x == q.x && p.y == q.y && p.stkp == q.stkp && p.pc == q.pc
+			&& (p.status & mask) == (q.status & mask) && p.cycles == q.cycles;
+	}
+
+	static bool SameWrites(const std::vector<Bus::WRITE> &p, const std::vector<Bus::WRITE> &q)
+	{
+		if (p.size() != q.size())
+			return false;
+		for (size_t i = 0; i < p.size(); i++)
+		{
+			if (p[i].addr != q[i].addr || p[i].data != q[i].data)
+				return false;
+		}
+		return true;
+	}
+
+	std::string Describe(const STATE &s, const uint8_t *bytes) const
+	{
+		olc6502_t<NMOS6502>::OPCODEINFO info = opcodes.GetOpcodeInfo(bytes[0]);
+		std::string sBytes;
+		for (int n = 0; n < info.bytes; n++)
+			sBytes += Hex(bytes[n]) + " ";
+
+		char sLine[64];
+		snprintf(sLine, sizeof(sLine), "$%04X: %-9s %s {%s}", s.pc, sBytes.c_str(),
+			info.name.c_str(), olc6502_t<NMOS6502>::AddrModeName(info.mode));
+
+		// Name the operand of an absolute address, e.g. a JSR's target
+		std::string sOperand;
+		if (symbols && info.bytes == 3 && info.mode != olc6502_t<NMOS6502>::AM_ZPR)
+		{
+			if (const char *sName = symbols->Name(bytes[1] | (bytes[2] << 8)))
+				sOperand = std::string(" ; ") + sName;
+		}
+		return sLine + sOperand;
+	}
+
+	static std::string Hex(uint8_t n)
+	{
+		char s[4];
+		snprintf(s, sizeof(s), "%02X", n);
+		return s;
+	}
+
+	static std::string Registers(const STATE &s)
+	{
+		char sLine[96];
+		snprintf(sLine, sizeof(sLine), "-> PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X CYC:%llu",
+			s.pc, s.a, s.x, s.y, s.stkp, s.status, (unsigned long long)s.cycles);
+		return sLine;
+	}
+
+	static std::string WriteList(const std::vector<Bus::WRITE> &w)
+	{
+		std::string s;
+		char sWrite[24];
+		for (auto &n : w)
+		{
+			snprintf(sWrite, sizeof(sWrite), " [$%04X <- $%02X]", n.addr, n.data);
+			s += sWrite;
+		}
+		return s;
+	}
+
+	// Only used for its translation table, to name instructions. The
+	// reference core only knows the NMOS instruction set
+	olc6502_t<NMOS6502> opcodes;
+};
@@ -0,0 +1,528 @@
+#include "Ref6502.h"
+
+
+
+Ref6502::Ref6502()
+{
+	mem.fill(0x00);
+}
+
+void Ref6502::Write(uint16_t addr, uint8_t data)
+{
+	mem[addr] = data;
+	writes.push_back({ addr, data });
+}
+
+void Ref6502::Push(uint8_t data)
+{
+	Write(0x0100 | stkp, data);
+	stkp--;
+}
+
+uint8_t Ref6502::Pull()
+{
+	stkp++;
+	return Read(0x0100 | stkp);
+}
+
+uint16_t Ref6502::Abx(bool &bCross)
+{
+	uint16_t base = Abs();
+	uint16_t addr = base + x;
+	bCross = (base ^ addr) & 0xFF00;
+	return addr;
+}
+
+uint16_t Ref6502::Aby(bool &bCross)
+{
+	uint16_t base = Abs();
+	uint16_t addr = base + y;
+	bCross = (base ^ addr) & 0xFF00;
+	return addr;
+}
+
+uint16_t Ref6502::Izx()
+{
+	uint8_t zp = Read(pc++) + x;
+	return Read(zp) | (Read((uint8_t)(zp + 1)) << 8);
+}
+
+uint16_t Ref6502::Izy(bool &bCross)
+{
+	uint8_t zp = Read(pc++);
+	uint16_t base = Read(zp) | (Read((uint8_t)(zp + 1)) << 8);
+	uint16_t addr = base + y;
+	bCross = (base ^ addr) & 0xFF00;
+	return addr;
+}
+
+// In decimal mode Z comes from the binary sum, while N and V come from
+// the sum after the low digit has been adjusted but before the high one
+void Ref6502::Adc(uint8_t m)
+{
+	int c = status & C;
+	int sum = a + m + c;
+
+	if (bDecimal && (status & D))
+	{
+		int lo = (a & 0x0F) + (m & 0x0F) + c;
+		if (lo > 0x09)
+			lo += 0x06;
+		int hi = (a >> 4) + (m >> 4) + (lo > 0x0F);
+
+		Flag(Z, (sum & 0xFF) == 0);
+		Flag(N, hi & 0x08);
+		Flag(V, ~(a ^ m) & (a ^ (hi << 4)) & 0x80);
+		if (hi > 0x09)
+			hi += 0x06;
+		Flag(C, hi > 0x0F);
+		a = (uint8_t)((hi << 4) | (lo & 0x0F));
+		return;
+	}
+
+	Flag(C, sum > 0xFF);
+	Flag(V, ~(a ^ m) & (a ^ sum) & 0x80);
+	a = (uint8_t)sum;
+	SetNZ(a);
+}
+
+// In decimal mode every flag comes from the binary difference
+void Ref6502::Sbc(uint8_t m)
+{
+	int borrow = (status & C) ? 0 : 1;
+	int diff = a - m - borrow;
+
+	Flag(C, diff >= 0);
+	Flag(V, (a ^ m) & (a ^ diff) & 0x80);
+	Flag(Z, (diff & 0xFF) == 0);
+	Flag(N, diff & 0x80);
+
+	if (bDecimal && (status & D))
+	{
+		int lo = (a & 0x0F) - (m & 0x0F) - borrow;
+		int hi = (a >> 4) - (m >> 4);
+		if (lo & 0x10)
+		{
+			lo -= 0x06;
+			hi--;
+		}
+		if (hi & 0x10)
+			hi -= 0x06;
+		a = (uint8_t)((hi << 4) | (lo & 0x0F));
+		return;
+	}
+
+	a = (uint8_t)diff;
+}
+
+void Ref6502::Compare(uint8_t r, uint8_t m)
+{
+	Flag(C, r >= m);
+	SetNZ((uint8_t)(r - m));
+}
+
+// Two cycles if not taken, three if taken, four if taken to another page
+void Ref6502::Branch(bool bTaken)
+{
+	int8_t offset = (int8_t)Read(pc++);
+	cycles += 2;
+	if (bTaken)
+	{
+		uint16_t target = pc + offset;
+		cycles += ((target ^ pc) & 0xFF00) ? 2 : 1;
+		pc = target;
+	}
+}
+
+bool Ref6502::Step()
+{
+	uint8_t  op = Read(pc);
+	uint16_t addr = 0x0000;
+	bool     bCross = false;
+	uint8_t  m = 0x00;
+
+	writes.clear();
+
+	// The ALU instructions, ORA AND EOR ADC STA LDA CMP SBC, are opcodes
+	// aaabbb01, where bbb selects the addressing mode. STA always takes
+	// the extra cycle of (zp),y abs,y and abs,x, whether a page is crossed
+	// or not
+	if ((op & 0x03) == 0x01 && op != 0x89)
+	{
+		pc++;
+		int n = 0;
+		switch ((op >> 2) & 0x07)
+		{
+		case 0: addr = Izx();       n = 6; break;
+		case 1: addr = Zp();        n = 3; break;
+		case 2: addr = pc++;        n = 2; break;
+		case 3: addr = Abs();       n = 4; break;
+		case 4: addr = Izy(bCross); n = 5; break;
+		case 5: addr = Zpx();       n = 4; break;
+		case 6: addr = Aby(bCross); n = 4; break;
+		case 7: addr = Abx(bCross); n = 4; break;
+		}
+
+		uint8_t aaa = op >> 5;
+		if (aaa == 4)
+		{
+			Write(addr, a);
+			cycles += n + (((op >> 2) & 0x07) == 4 || ((op >> 2) & 0x07) >= 6 ? 1 : 0);
+			return true;
+		}
+
+		m = Read(addr);
+		cycles += n + (bCross ? 1 : 0);
+		switch (aaa)
+		{
+		case 0: a |= m; SetNZ(a); break;
+		case 1: a &= m; SetNZ(a); break;
+		case 2: a ^= m; SetNZ(a); break;
+		case 3: Adc(m); break;
+		case 5: a = m; SetNZ(a); break;
+		case 6: Compare(a, m); break;
+		case 7: Sbc(m); break;
+		}
+		return true;
+	}
+
+	// The shifts and increments, ASL ROL LSR ROR DEC INC, are opcodes
+	// aaabbb10 with bbb of 1 (zp), 2 (accumulator), 3 (abs), 5 (zp,x) or
+	// 7 (abs,x). DEC and INC have no accumulator form
+	if ((op & 0x03) == 0x02 && (op >> 5) != 4 && (op >> 5) != 5)
+	{
+		uint8_t aaa = op >> 5;
+		uint8_t bbb = (op >> 2) & 0x07;
+		bool bAcc = bbb == 2;
+		if (bbb == 0 || bbb == 4 || bbb == 6 || (bAcc && aaa >= 6))
+			goto special;
+
+		pc++;
+		switch (bbb)
+		{
+		case 1: addr = Zp();        cycles += 5; break;
+		case 2:                     cycles += 2; break;
+		case 3: addr = Abs();       cycles += 6; break;
+		case 5: addr = Zpx();       cycles += 6; break;
+		case 7: addr = Abx(bCross); cycles += 7; break;
+		}
+
+		m = bAcc ? a : Read(addr);
+		uint8_t c = status & C;
+		switch (aaa)
+		{
+		case 0: Flag(C, m & 0x80); m = m << 1; break;
+		case 1: Flag(C, m & 0x80); m = (m << 1) | c; break;
+		case 2: Flag(C, m & 0x01); m = m >> 1; break;
+		case 3: Flag(C, m & 0x01); m = (m >> 1) | (c << 7); break;
+		case 6: m--; break;
+		case 7: m++; break;
+		}
+		SetNZ(m);
+
+		if (bAcc)
+			a = m;
+		else
+			Write(addr, m);
+		return true;
+	}
+
+special:
+	pc++;
+	switch (op)
+	{
+	// Loads and stores of X and Y
+	case 0xA2: x = Read(pc++);             SetNZ(x); cycles += 2; break;
+	case 0xA6: x = Read(Zp());             SetNZ(x); cycles += 3; break;
+	case 0xB6: x = Read(Zpy());            SetNZ(x); cycles += 4; break;
+	case 0xAE: x = Read(Abs());            SetNZ(x); cycles += 4; break;
+	case 0xBE: x = Read(Aby(bCross));      SetNZ(x); cycles += 4 + bCross; break;
+	case 0xA0: y = Read(pc++);             SetNZ(y); cycles += 2; break;
+	case 0xA4: y = Read(Zp());             SetNZ(y); cycles += 3; break;
+	case 0xB4: y = Read(Zpx());            SetNZ(y); cycles += 4; break;
+	case 0xAC: y = Read(Abs());            SetNZ(y); cycles += 4; break;
+	case 0xBC: y = Read(Abx(bCross));      SetNZ(y); cycles += 4 + bCross; break;
+	case 0x86: Write(Zp(), x);  cycles += 3; break;
+	case 0x96: Write(Zpy(), x); cycles += 4; break;
+	case 0x8E: Write(Abs(), x); cycles += 4; break;
+	case 0x84: Write(Zp(), y);  cycles += 3; break;
+	case 0x94: Write(Zpx(), y); cycles += 4; break;
+	case 0x8C: Write(Abs(), y); cycles += 4; break;
+
+	// Compares of X and Y
+	case 0xE0: Compare(x, Read(pc++));  cycles += 2; break;
+	case 0xE4: Compare(x, Read(Zp()));  cycles += 3; break;
+	case 0xEC: Compare(x, Read(Abs())); cycles += 4; break;
+	case 0xC0: Compare(y, Read(pc++));  cycles += 2; break;
+	case 0xC4: Compare(y, Read(Zp()));  cycles += 3; break;
+	case 0xCC: Compare(y, Read(Abs())); cycles += 4; break;
+
+	case 0x24:
+	case 0x2C:
+		m = Read(op == 0x24 ? Zp() : Abs());
+		Flag(Z, (a & m) == 0);
+		Flag(N, m & 0x80);
+		Flag(V, m & 0x40);
+		cycles += op == 0x24 ? 3 : 4;
+		break;
+
+	// Register transfers, increments and decrements
+	case 0xAA: x = a; SetNZ(x); cycles += 2; break;
+	case 0x8A: a = x; SetNZ(a); cycles += 2; break;
+	case 0xA8: y = a; SetNZ(y); cycles += 2; break;
+	case 0x98: a = y; SetNZ(a); cycles += 2; break;
+	case 0xBA: x = stkp; SetNZ(x); cycles += 2; break;
+	case 0x9A: stkp = x; cycles += 2; break;
+	case 0xE8: x++; SetNZ(x); cycles += 2; break;
+	case 0xCA: x--; SetNZ(x); cycles += 2; break;
+	case 0xC8: y++; SetNZ(y); cycles += 2; break;
+	case 0x88: y--; SetNZ(y); cycles += 2; break;
+	case 0xEA: cycles += 2; break;
+
+	// Flags
+	case 0x18: Flag(C, false); cycles += 2; break;
+	case 0x38: Flag(C, true);  cycles += 2; break;
+	case 0x58: Flag(I, false); cycles += 2; break;
+	case 0x78: Flag(I, true);  cycles += 2; break;
+	case 0xB8: Flag(V, false); cycles += 2; break;
+	case 0xD8: Flag(D, false); cycles += 2; break;
+	case 0xF8: Flag(D, true);  cycles += 2; break;
+
+	// Branches
+	case 0x10: Branch(!(status & N)); break;
+	case 0x30: Branch(status & N);    break;
+	case 0x50: Branch(!(status & V)); break;
+	case 0x70: Branch(status & V);    break;
+	case 0x90: Branch(!(status & C)); break;
+	case 0xB0: Branch(status & C);    break;
+	case 0xD0: Branch(!(status & Z)); break;
+	case 0xF0: Branch(status & Z);    break;
+
+	// Jumps, which for JMP (ind) includes not carrying into the high
+	// byte of the pointer
+	case 0x4C: pc = Abs(); cycles += 3; break;
+	case 0x6C:
+		addr = Abs();
+		pc = Read(addr) | (Read((addr & 0xFF00) | ((addr + 1) & 0x00FF)) << 8);
+		cycles += 5;
+		break;
+
+	// Stack. B only exists in the copy of the status register that PHP and
+	// BRK push, so it is never set in the register itself
+	case 0x48: Push(a); cycles += 3; break;
+	case 0x68: a = Pull(); SetNZ(a); cycles += 4; break;
+	case 0x08: Push(status | B | U); cycles += 3; break;
+	case 0x28: status = (Pull() & ~B) | U; cycles += 4; break;
+
+	// Subroutines and interrupts. JSR pushes the address of its own last
+	// byte, and BRK skips the byte after it
+	case 0x20:
+		addr = Read(pc++);
+		Push(pc >> 8);
+		Push(pc & 0xFF);
+		pc = addr | (Read(pc) << 8);
+		cycles += 6;
+		break;
+	case 0x60:
+		pc = Pull();
+		pc |= Pull() << 8;
+		pc++;
+		cycles += 6;
+		break;
+	case 0x00:
+		pc++;
+		Push(pc >> 8);
+		Push(pc & 0xFF);
+		Push(status | B | U);
+		Flag(I, true);
+		pc = Read16(0xFFFE);
+		cycles += 7;
+		break;
+	case 0x40:
+		status = (Pull() & ~B) | U;
+		pc = Pull();
+		pc |= Pull() << 8;
+		cycles += 6;
+		break;
+
+	default:
+		// Undocumented, leave everything as it was unless they are wanted
+		pc--;
+		return bUndocumented && Undocumented(op);
+	}
+
+	return true;
+}
+
+// SHA, SHX, SHY and TAS AND the value with the high byte of the unindexed
+// address plus one. A carry into the high byte is replaced by that value
+void Ref6502::StoreHigh(uint16_t base, uint8_t index, uint8_t value)
+{
+	uint16_t addr = base + index;
+	value &= (uint8_t)((base >> 8) + 1);
+	if ((base ^ addr) & 0xFF00)
+		addr = (addr & 0x00FF) | (value << 8);
+	Write(addr, value);
+}
+
+// The undocumented opcodes. Most are aaabbb11, which runs the aaabbb10
+// shift or increment and the aaabbb01 ALU instruction together, with the
+// addressing of the 01 group. pc is at the opcode
+bool Ref6502::Undocumented(uint8_t op)
+{
+	uint16_t addr = 0x0000;
+	uint16_t base = 0x0000;
+	bool     bCross = false;
+	uint8_t  m = 0x00;
+	uint8_t  aaa = op >> 5;
+	uint8_t  bbb = (op >> 2) & 0x07;
+
+	if ((op & 0x03) == 0x03 && bbb != 2 && aaa != 4 && aaa != 5)
+	{
+		pc++;
+		switch (bbb)
+		{
+		case 0: addr = Izx();       cycles += 8; break;
+		case 1: addr = Zp();        cycles += 5; break;
+		case 3: addr = Abs();       cycles += 6; break;
+		case 4: addr = Izy(bCross); cycles += 8; break;
+		case 5: addr = Zpx();       cycles += 6; break;
+		case 6: addr = Aby(bCross); cycles += 7; break;
+		case 7: addr = Abx(bCross); cycles += 7; break;
+		}
+
+		m = Read(addr);
+		uint8_t c = status & C;
+		switch (aaa)
+		{
+		case 0: Flag(C, m & 0x80); m = m << 1; break;
+		case 1: Flag(C, m & 0x80); m = (m << 1) | c; break;
+		case 2: Flag(C, m & 0x01); m = m >> 1; break;
+		case 3: Flag(C, m & 0x01); m = (m >> 1) | (c << 7); break;
+		case 6: m--; break;
+		case 7: m++; break;
+		}
+		Write(addr, m);
+
+		switch (aaa)
+		{
+		case 0: a |= m; SetNZ(a); break;
+		case 1: a &= m; SetNZ(a); break;
+		case 2: a ^= m; SetNZ(a); break;
+		case 3: Adc(m); break;
+		case 6: Compare(a, m); break;
+		case 7: Sbc(m); break;
+		}
+		return true;
+	}
+
+	pc++;
+	switch (op)
+	{
+	// SAX and LAX, the 01 and 10 group stores and loads together, with
+	// zp,y in place of zp,x and abs,y in place of abs,x for LAX
+	case 0x83: Write(Izx(), a & x); cycles += 6; break;
+	case 0x87: Write(Zp(), a & x);  cycles += 3; break;
+	case 0x8F: Write(Abs(), a & x); cycles += 4; break;
+	case 0x97: Write(Zpy(), a & x); cycles += 4; break;
+	case 0xA3: a = x = Read(Izx());        SetNZ(a); cycles += 6; break;
+	case 0xA7: a = x = Read(Zp());         SetNZ(a); cycles += 3; break;
+	case 0xAF: a = x = Read(Abs());        SetNZ(a); cycles += 4; break;
+	case 0xB3: a = x = Read(Izy(bCross));  SetNZ(a); cycles += 5 + bCross; break;
+	case 0xB7: a = x = Read(Zpy());        SetNZ(a); cycles += 4; break;
+	case 0xBF: a = x = Read(Aby(bCross));  SetNZ(a); cycles += 4 + bCross; break;
+
+	// Immediates
+	case 0x0B:
+	case 0x2B: a &= Read(pc++); SetNZ(a); Flag(C, a & 0x80); cycles += 2; break;
+	case 0x4B: a &= Read(pc++); Flag(C, a & 0x01); a >>= 1; SetNZ(a); cycles += 2; break;
+	case 0x8B: a = (a | 0xEE) & x & Read(pc++); SetNZ(a); cycles += 2; break;
+	case 0xAB: a = x = (a | 0xEE) & Read(pc++); SetNZ(a); cycles += 2; break;
+	case 0xCB:
+		m = Read(pc++);
+		Flag(C, (a & x) >= m);
+		x = (a & x) - m;
+		SetNZ(x);
+		cycles += 2;
+		break;
+	case 0xEB: Sbc(Read(pc++)); cycles += 2; break;
+
+	// ARR. In decimal mode each digit of A & M is BCD corrected, with C
+	// from the high one, as the adder would for an addition
+	case 0x6B:
+	{
+		uint8_t t = a & Read(pc++);
+		uint8_t c = status & C;
+		a = (t >> 1) | (c << 7);
+		SetNZ(a);
+		if (bDecimal && (status & D))
+		{
+			Flag(V, (t ^ a) & 0x40);
+			uint8_t lo = t & 0x0F, hi = t >> 4;
+			if (lo + (lo & 1) > 5)
+				a = (a & 0xF0) | ((a + 6) & 0x0F);
+			Flag(C, hi + (hi & 1) > 5);
+			if (status & C)
+				a += 0x60;
+		}
+		else
+		{
+			Flag(C, a & 0x40);
+			Flag(V, ((a >> 6) ^ (a >> 5)) & 1);
+		}
+		cycles += 2;
+		break;
+	}
+
+	// Stores ANDed with the address, and LAS
+	case 0x93:
+	{
+		uint8_t zp = Read(pc++);
+		base = Read(zp) | (Read((uint8_t)(zp + 1)) << 8);
+		StoreHigh(base, y, a & x);
+		cycles += 6;
+		break;
+	}
+	case 0x9F: StoreHigh(Abs(), y, a & x); cycles += 5; break;
+	case 0x9E: StoreHigh(Abs(), y, x);     cycles += 5; break;
+	case 0x9C: StoreHigh(Abs(), x, y);     cycles += 5; break;
+	case 0x9B: stkp = a & x; StoreHigh(Abs(), y, stkp); cycles += 5; break;
+	case 0xBB:
+		a = x = stkp = Read(Aby(bCross)) & stkp;
+		SetNZ(a);
+		cycles += 4 + bCross;
+		break;
+
+	// NOPs, of every length
+	case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA:
+		cycles += 2;
+		break;
+	case 0x80: case 0x82: case 0x89: case 0xC2: case 0xE2:
+		pc++;
+		cycles += 2;
+		break;
+	case 0x04: case 0x44: case 0x64:
+		Zp();
+		cycles += 3;
+		break;
+	case 0x14: case 0x34: case 0x54: case 0x74: case 0xD4: case 0xF4:
+		Zpx();
+		cycles += 4;
+		break;
+	case 0x0C:
+		Abs();
+		cycles += 4;
+		break;
+	case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0xDC: case 0xFC:
+		Abx(bCross);
+		cycles += 4 + bCross;
+		break;
+
+	default:
+		// KIL
+		pc--;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <vector>
+
+#include "Bus.h"
+
+// Reference 6502 =====================================================
+// A second, deliberately plain implementation of the documented NMOS
+// 6502 instruction set, written from the data sheet rather than from
+// olc6502, so the two can be run side by side and checked against each
+// other. It decodes opcodes with a switch instead of a translation table,
+// executes a whole instruction per call, and owns its 64KB of memory
+// outright with no bus, devices or debugger.
+//
+// Only what is visible from outside is modelled: registers, the final
+// value of every store, and the cycle count. Dummy reads and the extra
+// write of read-modify-write instructions are not. The undocumented
+// opcodes are only executed if bUndocumented is set, and KIL never is.
+class Ref6502
+{
+public:
+	Ref6502();
+
+	uint8_t  a = 0x00, x = 0x00, y = 0x00;
+	uint8_t  stkp = 0xFD;
+	uint8_t  status = 0x24;
+	uint16_t pc = 0x0000;
+	uint64_t cycles = 0;
+
+	std::array<uint8_t, 64 * 1024> mem;
+
+	// Stores made by the last Step(), in order
+	std::vector<Bus::WRITE> writes;
+
+	// The NMOS 6502 has binary coded decimal arithmetic. The 2A03 in the
+	// NES has the D flag but ignores it
+	bool bDecimal = true;
+
+	// Execute the undocumented opcodes too, other than KIL
+	bool bUndocumented = false;
+
+	// Executes one instruction. Returns false, having done nothing, if the
+	// opcode at pc is not one it executes
+	bool Step();
+
+	enum FLAGS
+	{
+		C = (1 << 0), Z = (1 << 1), I = (1 << 2), D = (1 << 3),
+		B = (1 << 4), U = (1 << 5), V = (1 << 6), N = (1 << 7),
+	};
+
+private:
+	uint8_t  Read(uint16_t addr) { return mem[addr]; }
+	void     Write(uint16_t addr, uint8_t data);
+	uint16_t Read16(uint16_t addr) { return Read(addr) | (Read(addr + 1) << 8); }
+	void     Push(uint8_t data);
+	uint8_t  Pull();
+
+	void     Flag(uint8_t f, bool v) { status = v ? (status | f) : (status & ~f); }
+	void     SetNZ(uint8_t v) { Flag(Z, v == 0x00); Flag(N, v & 0x80); }
+
+	void     Adc(uint8_t m);
+	void     Sbc(uint8_t m);
+	void     Compare(uint8_t r, uint8_t m);
+	void     Branch(bool bTaken);
+	bool     Undocumented(uint8_t op);
+	void     StoreHigh(uint16_t base, uint8_t index, uint8_t value);
+
+	// Operand addresses. The indexed ones note whether a page was crossed
+	uint16_t Zp()  { return Read(pc++); }
+	uint16_t Zpx() { return (Read(pc++) + x) & 0xFF; }
+	uint16_t Zpy() { return (Read(pc++) + y) & 0xFF; }
+	uint16_t Abs() { uint16_t n = Read16(pc); pc += 2; return n; }
+	uint16_t Abx(bool &bCross);
+	uint16_t Aby(bool &bCross);
+	uint16_t Izx();
+	uint16_t Izy(bool &bCross);
+};
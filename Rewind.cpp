@@ -0,0 +1,231 @@
+#include <cstring>
+
+#include "Rewind.h"
+#include "InputJournal.h"
+#include "Bus.h"
+
+
+
+Rewind::Rewind()
+{
+}
+
+Rewind::~Rewind()
+{
+}
+
+void Rewind::Configure(uint64_t nKeyframeCycles, uint64_t nDeltaCycles, size_t nMemoryCap)
+{
+	this->nDeltaCycles    = nDeltaCycles > 0 ? nDeltaCycles : 1;
+	this->nKeyframeCycles = nKeyframeCycles;
+	this->nMemoryCap      = nMemoryCap;
+}
+
+void Rewind::Start()
+{
+	if (nEvent < 0)
+		nEvent = bus->sched.Register([this](uint64_t now) { Checkpoint(now); });
+
+	ring.clear();
+	nBytes = 0;
+	bRecording = true;
+	Checkpoint(bus->cpu.GetClockCount());
+}
+
+void Rewind::Stop()
+{
+	if (nEvent >= 0)
+		bus->sched.Cancel(nEvent);
+
+	ring.clear();
+	nBytes = 0;
+	bRecording = false;
+}
+
+// Runs from the scheduler, so always at an instruction boundary
+void Rewind::Checkpoint(uint64_t now)
+{
+	CHECKPOINT cp;
+	bus->cpu.SaveState(cp.cpu);
+	if (journal != nullptr)
+		cp.journal_pos = journal->Position();
+
+	if (ring.empty() || now - nLastKeyframe >= nKeyframeCycles)
+	{
+		cp.bKeyframe = true;
+		cp.ram.assign(bus->ram.begin(), bus->ram.end());
+		shadow = bus->ram;
+		shadow_gen = bus->page_gen;
+		nLastKeyframe = now;
+	}
+	else
+	{
+		// Only pages whose write generation moved can differ from the
+		// shadow copy. Even then, they may have been written with the
+		// values they already held, in which case nothing is stored
+		for (int p = 0; p < 256; p++)
+		{
+			if (bus->page_gen[p] == shadow_gen[p])
+				continue;
+			shadow_gen[p] = bus->page_gen[p];
+
+			const uint8_t *pRam = &bus->ram[p << 8];
+			uint8_t *pShadow = &shadow[p << 8];
+			uint8_t delta[256];
+			uint8_t diff = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				delta[i] = pRam[i] ^ pShadow[i];
+				diff |= delta[i];
+			}
+
+			if (diff != 0)
+			{
+				cp.pages.push_back((uint8_t)p);
+				cp.ram.insert(cp.ram.end(), delta, delta + 256);
+				memcpy(pShadow, pRam, 256);
+			}
+		}
+	}
+
+	ring.push_back(std::move(cp));
+	nBytes += ring.back().Bytes();
+	Evict();
+
+	bus->sched.Schedule(nEvent, now + nDeltaCycles);
+}
+
+// Drops whole keyframes, with their deltas, from the old end of the ring
+// until it fits. The newest keyframe is always kept.
+void Rewind::Evict()
+{
+	while (nBytes > nMemoryCap)
+	{
+		size_t n = 1;
+		while (n < ring.size() && !ring[n].bKeyframe)
+			n++;
+		if (n == ring.size())
+			break;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			nBytes -= ring.front().Bytes();
+			ring.pop_front();
+		}
+	}
+}
+
+bool Rewind::SeekToInstruction(uint64_t n)
+{
+	if (!bRecording || ring.empty())
+		return false;
+	if (n > bus->cpu.GetInstructionCount() || n < ring.front().cpu.instr_count)
+		return false;
+
+	// The target was reached before now, so it can't take more cycles
+	uint64_t nClockLimit = bus->cpu.GetClockCount();
+
+	// The nearest checkpoint at or before the target, and the keyframe it
+	// is built from. The ring always starts with a keyframe.
+	size_t idx = ring.size() - 1;
+	while (ring[idx].cpu.instr_count > n)
+		idx--;
+	size_t key = idx;
+	while (!ring[key].bKeyframe)
+		key--;
+
+	// Rebuild RAM as it was at that checkpoint
+	memcpy(shadow.data(), ring[key].ram.data(), shadow.size());
+	for (size_t i = key + 1; i <= idx; i++)
+	{
+		const CHECKPOINT &cp = ring[i];
+		for (size_t j = 0; j < cp.pages.size(); j++)
+		{
+			uint8_t *pShadow = &shadow[cp.pages[j] << 8];
+			const uint8_t *pDelta = &cp.ram[j << 8];
+			for (int b = 0; b < 256; b++)
+				pShadow[b] ^= pDelta[b];
+		}
+	}
+
+	// Restore it. Every page counts as written, so that anything else
+	// tracking memory picks up the change
+	bus->ram = shadow;
+	for (auto &g : bus->page_gen)
+		g++;
+	shadow_gen = bus->page_gen;
+	bus->cpu.LoadState(ring[idx].cpu);
+
+	// What comes after is no longer the past of this point
+	while (ring.size() > idx + 1)
+	{
+		nBytes -= ring.back().Bytes();
+		ring.pop_back();
+	}
+	nLastKeyframe = ring[key].cpu.clock_count;
+	bus->sched.Schedule(nEvent, ring[idx].cpu.clock_count + nDeltaCycles);
+
+	// Execute forward to the exact instruction, with the journal injecting
+	// the same external events again. Breakpoints were already dealt with
+	// the first time round, so keep them out of the way
+	if (journal != nullptr)
+		journal->SetPosition(ring[idx].journal_pos);
+
+	// Devices and banks aren't rewound, so the re-execution can go another
+	// way, even into KIL or a WAI that nothing wakes, which only the clock
+	// moves on from. Once it passes the cycle it started from, it gives up
+	// wherever it got to
+	bool bArmed = bus->bp.armed;
+	bool bReached = true;
+	bus->bp.armed = false;
+	while (bus->cpu.GetInstructionCount() < n)
+	{
+		if (bus->cpu.GetClockCount() > nClockLimit)
+		{
+			bReached = false;
+			break;
+		}
+		do
+		{
+			bus->cpu.clock();
+		}
+		while (!bus->cpu.complete());
+	}
+	bus->bp.armed = bArmed;
+
+	// When recording, events from the abandoned future are dropped
+	if (journal != nullptr)
+		journal->Truncate();
+
+	return bReached;
+}
+
+bool Rewind::StepBack()
+{
+	uint64_t n = bus->cpu.GetInstructionCount();
+	return n > 0 && SeekToInstruction(n - 1);
+}
+
+uint64_t Rewind::OldestInstruction() const
+{
+	return ring.empty() ? 0 : ring.front().cpu.instr_count;
+}
+
+Rewind::STATS Rewind::GetStats() const
+{
+	STATS s;
+	s.bytes = nBytes;
+	for (auto &cp : ring)
+	{
+		if (cp.bKeyframe)
+			s.keyframes++;
+		else
+			s.deltas++;
+	}
+
+	if (!ring.empty())
+		s.cycles = bus->cpu.GetClockCount() - ring.front().cpu.clock_count;
+	if (s.cycles > 0)
+		s.bytes_per_second = double(s.bytes) * clock_hz / double(s.cycles);
+	return s;
+}
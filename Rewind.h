@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <vector>
+
+#include "olc6502.h"
+
+class Bus;
+class InputJournal;
+
+// Rewind =============================================================
+// Records checkpoints of the machine as it runs, so execution can be
+// taken back to any earlier instruction. Every "delta" cycles a checkpoint
+// holds the CPU state and, for each page of RAM written since the last
+// checkpoint, the page XORed with its previous contents. Every "keyframe"
+// cycles a checkpoint holds a full copy of RAM instead. Applying deltas
+// in order to a keyframe rebuilds RAM at any later checkpoint, so seeking
+// restores the nearest checkpoint at or before the target and then
+// executes forward to reach the exact instruction.
+//
+// Checkpoints live in a ring with a memory cap. When the cap is reached
+// the oldest keyframe is dropped together with its deltas, which is as
+// far back as they can be rebuilt from.
+//
+// Re-executing only gives the same results if nothing outside the CPU
+// changes the course of the program. External events such as irq() must
+// come through an input journal connected here, which re-injects them
+// at the same cycles while executing forward.
+class Rewind
+{
+public:
+	Rewind();
+	~Rewind();
+
+	void ConnectBus(Bus *n) { bus = n; }
+	void ConnectJournal(InputJournal *n) { journal = n; }
+
+	// How often checkpoints and keyframes are taken, and the most memory
+	// the checkpoints may use. Takes effect from the next checkpoint
+	void Configure(uint64_t nKeyframeCycles, uint64_t nDeltaCycles, size_t nMemoryCap);
+
+	// Starts recording from the current state, which becomes the first
+	// keyframe. Stopping discards everything recorded.
+	void Start();
+	void Stop();
+	bool IsRecording() const { return bRecording; }
+
+	// Puts the machine back to how it was after instruction n had executed.
+	// Returns false if n is in the future or older than the oldest keyframe,
+	// or if re-executing from a checkpoint doesn't get there, which can
+	// happen when devices behave differently the second time. The machine
+	// is then left where re-execution stopped. Anything recorded after the
+	// point reached is forgotten.
+	bool SeekToInstruction(uint64_t n);
+	bool StepBack();
+
+	// The oldest instruction that can still be reached
+	uint64_t OldestInstruction() const;
+
+	// Memory use. The rate is per second of emulated time, at clock_hz
+	struct STATS
+	{
+		size_t   bytes     = 0;
+		size_t   keyframes = 0;
+		size_t   deltas    = 0;
+		uint64_t cycles    = 0;		// Emulated time covered by the ring
+		double   bytes_per_second = 0.0;
+	};
+
+	STATS GetStats() const;
+	double clock_hz = 1000000.0;
+
+private:
+	struct CHECKPOINT
+	{
+		olc6502::STATE cpu;
+		size_t journal_pos = 0;			// Journal events that had taken effect
+		bool bKeyframe = false;
+		std::vector<uint8_t> ram;		// Keyframe: all of RAM. Delta: XORed pages
+		std::vector<uint8_t> pages;		// Delta: which page each 256 bytes of "ram" is
+
+		size_t Bytes() const
+		{
+			return sizeof(CHECKPOINT) + ram.capacity() + pages.capacity()
+				+ cpu.frames.capacity() * sizeof(olc6502::FRAME);
+		}
+	};
+
+	Bus *bus = nullptr;
+	InputJournal *journal = nullptr;
+	int  nEvent = -1;
+	bool bRecording = false;
+
+	uint64_t nKeyframeCycles = 1000000;
+	uint64_t nDeltaCycles    = 10000;
+	size_t   nMemoryCap      = 64 * 1024 * 1024;
+
+	std::deque<CHECKPOINT> ring;
+	size_t   nBytes = 0;
+	uint64_t nLastKeyframe = 0;
+
+	// RAM as it was at the most recent checkpoint, and the page write
+	// generations at that time
+	std::array<uint8_t, 64 * 1024> shadow;
+	std::array<uint32_t, 256> shadow_gen;
+
+	void Checkpoint(uint64_t now);
+	void Evict();
+};
@@ -0,0 +1,63 @@
+#include "Scheduler.h"
+
+
+
+Scheduler::Scheduler()
+{
+}
+
+int Scheduler::Register(HANDLER handler)
+{
+	EVENT e;
+	e.handler = handler;
+	events.push_back(e);
+	return (int)events.size() - 1;
+}
+
+void Scheduler::Schedule(int id, uint64_t when)
+{
+	events[id].when = when;
+	if (when < next)
+		next = when;
+	else
+		Update();
+}
+
+void Scheduler::Cancel(int id)
+{
+	events[id].when = NEVER;
+	Update();
+}
+
+void Scheduler::Dispatch(uint64_t now)
+{
+	// A handler may schedule events of its own, including ones that are
+	// already due, so keep going until nothing is left to do
+	while (next <= now)
+	{
+		// Indexed, and the handler copied, in case a handler registers a
+		// new event and the vector moves
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			if (events[i].when <= now)
+			{
+				events[i].when = NEVER;
+				HANDLER handler = events[i].handler;
+				handler(now);
+			}
+		}
+		Update();
+	}
+}
+
+// There are only ever a handful of events, so a linear search for the
+// earliest beats maintaining a heap
+void Scheduler::Update()
+{
+	next = NEVER;
+	for (auto &e : events)
+	{
+		if (e.when < next)
+			next = e.when;
+	}
+}
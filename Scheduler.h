@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+// Event Scheduler ====================================================
+// Things that need to happen at a particular clock cycle, such as taking
+// a rewind checkpoint or a device timer expiring, register an event here
+// instead of being ticked every cycle. The CPU compares the clock count
+// against "next" at each instruction boundary, and only calls Dispatch()
+// once something is due, so an idle scheduler costs one comparison per
+// instruction however many events are registered.
+class Scheduler
+{
+public:
+	Scheduler();
+
+	// Handlers are given the clock count at which they actually run, which
+	// is the first instruction boundary at or after the requested time
+	typedef std::function<void(uint64_t)> HANDLER;
+
+	static constexpr uint64_t NEVER = UINT64_MAX;
+
+	// Adds an event, initially not scheduled, and returns its id
+	int  Register(HANDLER handler);
+
+	// Sets when an event fires, replacing any previous time. Events are
+	// one-shot, so a periodic event reschedules itself from its handler
+	void Schedule(int id, uint64_t when);
+	void Cancel(int id);
+	uint64_t When(int id) const { return events[id].when; }
+
+	// Clock count of the earliest scheduled event
+	uint64_t next = NEVER;
+
+	// Runs every event that is due at "now"
+	void Dispatch(uint64_t now);
+
+private:
+	struct EVENT
+	{
+		uint64_t when = NEVER;
+		HANDLER  handler;
+	};
+
+	std::vector<EVENT> events;
+
+	void Update();
+};
@@ -0,0 +1,173 @@
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <strings.h>
+#include <fstream>
+#include <iterator>
+
+#include "Symbols.h"
+
+
+
+Symbols::Symbols()
+{
+	Clear();
+}
+
+void Symbols::Clear()
+{
+	index.assign(64 * 1024, 0);
+	pool.assign(1, '\0');
+	nCount = 0;
+}
+
+static bool IsLocal(const char *s)
+{
+	return s[0] == '.' || s[0] == '@';
+}
+
+bool Symbols::Add(uint16_t addr, const std::string &sName)
+{
+	if (sName.empty())
+		return false;
+
+	if (index[addr])
+	{
+		if (!IsLocal(pool.data() + index[addr]) || IsLocal(sName.c_str()))
+			return false;
+	}
+	else
+	{
+		nCount++;
+	}
+
+	// A replaced name is left in the pool, which only costs its bytes
+	index[addr] = (uint32_t)pool.size();
+	pool.insert(pool.end(), sName.begin(), sName.end());
+	pool.push_back('\0');
+	return true;
+}
+
+std::string Symbols::Format(uint16_t addr, int nDigits) const
+{
+	if (const char *s = Name(addr))
+		return s;
+
+	std::string s(nDigits + 1, '$');
+	for (int i = nDigits; i > 0; i--, addr >>= 4)
+		s[i] = "0123456789ABCDEF"[addr & 0xF];
+	return s;
+}
+
+bool Symbols::Load(const std::string &sFile)
+{
+	std::ifstream file(sFile, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	pool.reserve(pool.size() + text.size());
+
+	const char *s = text.data(), *end = s + text.size();
+	while (s < end)
+	{
+		const char *eol = (const char*)memchr(s, '\n', end - s);
+		if (eol == nullptr)
+			eol = end;
+		ParseLine(s, eol);
+		s = eol + 1;
+	}
+	return true;
+}
+
+// A number as $hex, 0xhex or decimal, up to $FFFF, leaving s after it
+static bool ParseNumber(const char *&s, const char *end, uint32_t &n)
+{
+	int base = 10;
+	if (s < end && *s == '$')
+		base = 16, s++;
+	else if (end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		base = 16, s += 2;
+
+	const char *start = s;
+	n = 0;
+	while (s < end && (base == 16 ? isxdigit((unsigned char)*s) : isdigit((unsigned char)*s)))
+	{
+		n = n * base + (isdigit((unsigned char)*s) ? *s - '0' : (toupper((unsigned char)*s) - 'A' + 10));
+		if (n > 0xFFFFFF)
+			return false;
+		s++;
+	}
+	return s > start;
+}
+
+static bool IsNameChar(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '@';
+}
+
+bool Symbols::ParseLine(const char *s, const char *end)
+{
+	auto skip = [&]() { while (s < end && isspace((unsigned char)*s)) s++; };
+	auto word = [&]()
+	{
+		const char *start = s;
+		while (s < end && IsNameChar(*s))
+			s++;
+		return std::string(start, s);
+	};
+
+	skip();
+	if (s == end || *s == ';' || *s == '#')
+		return false;
+
+	uint32_t addr = 0;
+	std::string sName;
+
+	// "al [C:]ADDR .name", the address in hex without a prefix
+	if (end - s > 3 && s[0] == 'a' && s[1] == 'l' && isspace((unsigned char)s[2]))
+	{
+		s += 2;
+		skip();
+		if (end - s > 2 && isalpha((unsigned char)s[0]) && s[1] == ':')
+			s += 2;
+
+		std::string sAddr = word();
+		char *stop = nullptr;
+		addr = (uint32_t)strtoul(sAddr.c_str(), &stop, 16);
+		if (sAddr.empty() || *stop != '\0')
+			return false;
+
+		skip();
+		sName = word();
+
+		// Both write every label with a leading '.', which isn't part of
+		// the name
+		if (sName.size() > 1 && sName[0] == '.')
+			sName.erase(0, 1);
+	}
+	else
+	{
+		// "name = value", "name := value" or "name EQU value"
+		sName = word();
+		if (sName.empty())
+			return false;
+		skip();
+		if (s < end && *s == ':')
+			s++;
+		if (s < end && *s == '=')
+			s++;
+		else if (end - s > 3 && strncasecmp(s, "equ", 3) == 0 && isspace((unsigned char)s[3]))
+			s += 3;
+		else
+			return false;
+
+		skip();
+		if (!ParseNumber(s, end, addr))
+			return false;
+	}
+
+	if (sName.empty() || addr > 0xFFFF)
+		return false;
+	return Add((uint16_t)addr, sName);
+}
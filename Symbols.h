@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Symbol Table =======================================================
+// Names for addresses, read from the label files assemblers and
+// emulators write, for the disassembler, traces and profiles. Every
+// address has a slot in a flat 64K index pointing into one pool of
+// names, so looking one up costs an array access no matter how many
+// symbols there are.
+//
+// Each line of a file can be any of:
+//		al 00C000 .name		ld65 label file (-Ln) or VICE label file,
+//		al C:C000 .name		with or without the VICE memory space prefix
+//		name = $C000		simple lists, and assembler listings of
+//		name EQU $C000		equates. 0x or $ for hex, otherwise decimal
+// Blank lines, comments starting with ; or # and anything else that
+// doesn't parse are skipped.
+//
+// An address only has one name. A global label wins over a local one
+// (starting with . or @), otherwise the first one loaded stays.
+class Symbols
+{
+public:
+	Symbols();
+
+	// Adds the file's symbols to those already loaded. Returns false if
+	// the file couldn't be read
+	bool Load(const std::string &sFile);
+
+	// Returns false if the address already had a name that was kept
+	bool Add(uint16_t addr, const std::string &sName);
+
+	void Clear();
+
+	// The name at addr, or nullptr. Pointers stay valid until the next
+	// Load(), Add() or Clear()
+	const char* Name(uint16_t addr) const
+	{
+		return index[addr] ? pool.data() + index[addr] : nullptr;
+	}
+
+	// The name at addr, or addr as $ and nDigits of hex
+	std::string Format(uint16_t addr, int nDigits = 4) const;
+
+	size_t Count() const { return nCount; }
+
+private:
+	std::vector<uint32_t> index;	// Offset into pool for each address, 0 for none
+	std::vector<char> pool;			// Names, each ending in '\0'. Offset 0 is ""
+	size_t nCount = 0;
+
+	bool ParseLine(const char *s, const char *end);
+};
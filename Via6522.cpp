@@ -0,0 +1,453 @@
+#include <algorithm>
+
+#include "Via6522.h"
+#include "Bus.h"
+
+
+
+Via6522::Via6522()
+{
+}
+
+void Via6522::ConnectBus(Bus *n)
+{
+	bus = n;
+	irq_source = bus->IrqSource();
+
+	// Each fires when its part of the VIA would next interrupt, and just
+	// brings everything up to date, which sets the flag
+	auto handler = [this](uint64_t now)
+	{
+		tick(now);
+		ScheduleEvents();
+	};
+	t1_event = bus->sched.Register(handler);
+	t2_event = bus->sched.Register(handler);
+	sr_event = bus->sched.Register(handler);
+}
+
+void Via6522::reset()
+{
+	// The reset line clears everything but the timers and shift register
+	uint8_t nPortA = PortA(), nPortB = PortB();
+	ora = orb = ddra = ddrb = 0x00;
+	acr = pcr = ifr = ier = 0x00;
+	t1_armed = false;
+	t2_armed = false;
+	t1_expire = t2_expire = Scheduler::NEVER;
+	sr_bits = 0;
+
+	if (on_port_a && PortA() != nPortA)
+		on_port_a(PortA());
+	if (on_port_b && PortB() != nPortB)
+		on_port_b(PortB());
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+void Via6522::tick(uint64_t nClock)
+{
+	nNow = nClock;
+	UpdateTimer1();
+	UpdateTimer2();
+	UpdateShift();
+	UpdateIrq();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// REGISTERS
+
+uint8_t Via6522::peek(uint16_t addr) const
+{
+	switch (addr & 0x0F)
+	{
+	case ORB:    return PortB();
+	case ORA:    return PortA();
+	case ORA_NH: return PortA();
+	case DDRB:   return ddrb;
+	case DDRA:   return ddra;
+	case T1CL:   return Timer1() & 0xFF;
+	case T1CH:   return Timer1() >> 8;
+	case T1LL:   return t1_latch & 0xFF;
+	case T1LH:   return t1_latch >> 8;
+	case T2CL:   return Timer2() & 0xFF;
+	case T2CH:   return Timer2() >> 8;
+	case SR:     return sr;
+	case ACR:    return acr;
+	case PCR:    return pcr;
+	case IFR:    return ifr | ((ifr & ier) ? IFR_IRQ : 0);
+	default:     return ier | 0x80;
+	}
+}
+
+uint8_t Via6522::read(uint16_t addr)
+{
+	uint8_t data = peek(addr);
+
+	// The side effects of reading
+	switch (addr & 0x0F)
+	{
+	case ORB:  ifr &= ~(IFR_CB1 | IFR_CB2); break;
+	case ORA:  ifr &= ~(IFR_CA1 | IFR_CA2); break;
+	case T1CL: ifr &= ~IFR_T1; break;
+	case T2CL: ifr &= ~IFR_T2; break;
+	case SR:   StartShift(); break;
+	default:   return data;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+	return data;
+}
+
+void Via6522::write(uint16_t addr, uint8_t data)
+{
+	switch (addr & 0x0F)
+	{
+	case ORB:
+		ifr &= ~(IFR_CB1 | IFR_CB2);
+		WritePort(orb, data, false);
+		break;
+
+	case ORA:
+		ifr &= ~(IFR_CA1 | IFR_CA2);
+		WritePort(ora, data, true);
+		break;
+
+	case ORA_NH: WritePort(ora, data, true); break;
+	case DDRB:   WritePort(ddrb, data, false); break;
+	case DDRA:   WritePort(ddra, data, true); break;
+
+	case T1CL:
+	case T1LL:
+		t1_latch = (t1_latch & 0xFF00) | data;
+		break;
+
+	case T1CH:
+		// Loads the counter from the latch and starts it
+		t1_latch = (t1_latch & 0x00FF) | (data << 8);
+		t1_value = t1_latch;
+		t1_base  = nNow;
+		t1_expire = nNow + t1_value + 1;
+		t1_armed = true;
+		ifr &= ~IFR_T1;
+		break;
+
+	case T1LH:
+		t1_latch = (t1_latch & 0x00FF) | (data << 8);
+		ifr &= ~IFR_T1;
+		break;
+
+	case T2CL:
+		t2_latch = data;
+		break;
+
+	case T2CH:
+		t2_value = t2_latch | (data << 8);
+		t2_base  = nNow;
+		t2_expire = (acr & 0x20) ? Scheduler::NEVER : nNow + t2_value + 1;
+		t2_armed = true;
+		ifr &= ~IFR_T2;
+		break;
+
+	case SR:
+		sr = data;
+		StartShift();
+		break;
+
+	case ACR:
+		WriteAcr(data);
+		break;
+
+	case PCR:
+		pcr = data;
+		break;
+
+	case IFR:
+		ifr &= ~(data & 0x7F);
+		break;
+
+	case IER:
+		if (data & 0x80)
+			ier |= data & 0x7F;
+		else
+			ier &= ~data;
+		break;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+// As directly as possible, without clearing flags, starting timers or
+// shifting. The timer counters can be set, which takes effect from now
+void Via6522::poke(uint16_t addr, uint8_t data)
+{
+	switch (addr & 0x0F)
+	{
+	case ORB:    orb = data; break;
+	case ORA:    ora = data; break;
+	case ORA_NH: ora = data; break;
+	case DDRB:   ddrb = data; break;
+	case DDRA:   ddra = data; break;
+	case T1CL:   RestartTimer1((Timer1() & 0xFF00) | data); break;
+	case T1CH:   RestartTimer1((Timer1() & 0x00FF) | (data << 8)); break;
+	case T1LL:   t1_latch = (t1_latch & 0xFF00) | data; break;
+	case T1LH:   t1_latch = (t1_latch & 0x00FF) | (data << 8); break;
+	case T2CL:   RestartTimer2((Timer2() & 0xFF00) | data); break;
+	case T2CH:   RestartTimer2((Timer2() & 0x00FF) | (data << 8)); break;
+	case SR:     sr = data; break;
+	case ACR:    WriteAcr(data); break;
+	case PCR:    pcr = data; break;
+	case IFR:    ifr = data & 0x7F; break;
+	default:     ier = data & 0x7F; break;
+	}
+
+	UpdateIrq();
+	ScheduleEvents();
+}
+
+void Via6522::WritePort(uint8_t &reg, uint8_t data, bool bPortA)
+{
+	uint8_t nOld = bPortA ? PortA() : PortB();
+	reg = data;
+	uint8_t nNew = bPortA ? PortA() : PortB();
+
+	auto &on_port = bPortA ? on_port_a : on_port_b;
+	if (on_port && nNew != nOld)
+		on_port(nNew);
+}
+
+// A change of timer mode takes effect from now, carrying on from the
+// count the timer has reached
+void Via6522::WriteAcr(uint8_t data)
+{
+	uint16_t nTimer1 = Timer1(), nTimer2 = Timer2();
+	uint8_t nOldShift = (acr >> 2) & 7;
+	acr = data;
+	RestartTimer1(nTimer1);
+	RestartTimer2(nTimer2);
+
+	// A shift in progress stops if the mode changes. The next access to
+	// SR starts one in the new mode
+	if (((acr >> 2) & 7) != nOldShift)
+		sr_bits = 0;
+}
+
+void Via6522::SetPortA(uint8_t nPins)
+{
+	pins_a = nPins;
+}
+
+void Via6522::SetPortB(uint8_t nPins)
+{
+	pins_b = nPins;
+}
+
+// PCR bit 0 (CA1) or 4 (CB1) picks the rising edge, otherwise falling
+void Via6522::SetCA1(bool bLevel)
+{
+	if (bLevel != bCA1 && bLevel == ((pcr & 0x01) != 0))
+	{
+		ifr |= IFR_CA1;
+		UpdateIrq();
+	}
+	bCA1 = bLevel;
+}
+
+void Via6522::SetCB1(bool bLevel)
+{
+	if (bLevel != bCB1 && bLevel == ((pcr & 0x10) != 0))
+	{
+		ifr |= IFR_CB1;
+		UpdateIrq();
+	}
+	bCB1 = bLevel;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TIMERS
+//
+// A counter's value is worked out from how long ago it was loaded. Each
+// Update function catches up with what has happened since it was last
+// called, which is at most setting the timer's flag once, however many
+// times it has expired meanwhile.
+
+uint16_t Via6522::Timer1() const
+{
+	// Free-running, the cycle between expiring and reloading
+	if (nNow < t1_base)
+		return 0xFFFF;
+
+	return (uint16_t)(t1_value - (nNow - t1_base));
+}
+
+uint16_t Via6522::Timer2() const
+{
+	// Pulse counting holds the count, as nothing pulses PB6
+	if (acr & 0x20)
+		return t2_value;
+
+	uint64_t nElapsed = nNow > t2_base ? nNow - t2_base : 0;
+	return (uint16_t)(t2_value - nElapsed);
+}
+
+void Via6522::RestartTimer1(uint16_t nValue)
+{
+	t1_value = nValue;
+	t1_base  = nNow;
+	t1_expire = (t1_armed || (acr & 0x40)) ? nNow + nValue + 1 : Scheduler::NEVER;
+}
+
+void Via6522::RestartTimer2(uint16_t nValue)
+{
+	t2_value = nValue;
+	t2_base  = nNow;
+	t2_expire = (t2_armed && !(acr & 0x20)) ? nNow + nValue + 1 : Scheduler::NEVER;
+}
+
+void Via6522::UpdateTimer1()
+{
+	if (nNow < t1_expire)
+		return;
+
+	if (t1_armed)
+		ifr |= IFR_T1;
+
+	if (!(acr & 0x40))
+	{
+		// One-shot: no more interrupts, and the counter carries on down
+		// from $FFFF
+		t1_armed  = false;
+		t1_expire = Scheduler::NEVER;
+		return;
+	}
+
+	// Free-running: the counter reloads from the latch the cycle after
+	// reading $FFFF, so it expires every latch + 2 cycles. nLast is the
+	// latest expiry up to now
+	uint64_t nPeriod = (uint64_t)t1_latch + 2;
+	uint64_t nLast = t1_expire + (nNow - t1_expire) / nPeriod * nPeriod;
+	t1_base   = nLast + 1;
+	t1_value  = t1_latch;
+	t1_expire = nLast + nPeriod;
+}
+
+void Via6522::UpdateTimer2()
+{
+	if (nNow < t2_expire)
+		return;
+
+	// Only ever once per load, the counter carrying on down from $FFFF
+	if (t2_armed)
+		ifr |= IFR_T2;
+	t2_armed  = false;
+	t2_expire = Scheduler::NEVER;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SHIFT REGISTER
+//
+// ACR bits 2-4 give the mode:
+//		0		disabled
+//		1, 2	shift in under T2, or every other system clock
+//		3		shift in under CB1
+//		4		shift out under T2, repeating forever without interrupts
+//		5, 6	shift out under T2, or every other system clock
+//		7		shift out under CB1
+// Under T2 each bit takes two of its timeouts, which only use its low
+// latch. Shifting out rotates, so the byte is back in SR when it is done.
+
+void Via6522::StartShift()
+{
+	ifr &= ~IFR_SR;
+
+	uint8_t nMode = (acr >> 2) & 7;
+	switch (nMode)
+	{
+	case 1: case 4: case 5: sr_rate = ((uint32_t)t2_latch + 2) * 2; break;
+	case 2: case 6:         sr_rate = 2; break;
+	default:                sr_rate = 0; break;		// Disabled, or clocked by CB1
+	}
+
+	sr_bits = nMode ? 8 : 0;
+	sr_base = nNow;
+}
+
+void Via6522::UpdateShift()
+{
+	if (sr_bits == 0 || sr_rate == 0 || nNow < sr_base + sr_rate)
+		return;
+
+	uint8_t nMode = (acr >> 2) & 7;
+	uint64_t k = (nNow - sr_base) / sr_rate;
+
+	if (nMode == 4)
+	{
+		// Round and round, with no end
+		int n = (int)(k % 8);
+		sr = (uint8_t)((sr << n) | (sr >> ((8 - n) & 7)));
+		sr_base += k * sr_rate;
+		return;
+	}
+
+	int n = (int)std::min<uint64_t>(k, sr_bits);
+	for (int i = 0; i < n; i++)
+	{
+		if (nMode & 4)
+			sr = (uint8_t)((sr << 1) | (sr >> 7));
+		else
+			sr = (uint8_t)((sr << 1) | (bCB2 ? 1 : 0));
+	}
+	sr_base += n * sr_rate;
+	sr_bits -= n;
+
+	if (sr_bits == 0)
+	{
+		ifr |= IFR_SR;
+		if ((nMode & 4) && on_shift_out)
+			on_shift_out(sr);
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// INTERRUPTS
+
+void Via6522::UpdateIrq()
+{
+	if (bus)
+		bus->SetIrq(irq_source, (ifr & ier & 0x7F) != 0);
+}
+
+// A timer only needs an event if its interrupt is enabled, as its flag
+// is brought up to date whenever it is looked at anyway
+void Via6522::ScheduleEvents()
+{
+	if (!bus)
+		return;
+
+	if ((ier & IFR_T1) && t1_armed && t1_expire != Scheduler::NEVER)
+		bus->sched.Schedule(t1_event, t1_expire);
+	else
+		bus->sched.Cancel(t1_event);
+
+	if ((ier & IFR_T2) && t2_armed && t2_expire != Scheduler::NEVER)
+		bus->sched.Schedule(t2_event, t2_expire);
+	else
+		bus->sched.Cancel(t2_event);
+
+	uint8_t nMode = (acr >> 2) & 7;
+	if ((ier & IFR_SR) && sr_bits && sr_rate && nMode != 4)
+		bus->sched.Schedule(sr_event, sr_base + sr_bits * sr_rate);
+	else
+		bus->sched.Cancel(sr_event);
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+#include "Device.h"
+
+class Bus;
+
+// 6522 VIA ===========================================================
+// The Versatile Interface Adapter, as on Ben Eater's breadboard computer:
+// two 8-bit ports, two 16-bit timers, a shift register and an interrupt
+// flag/enable pair driving the IRQ line. The sixteen registers repeat
+// through whatever range the VIA is attached at, decoded from the low
+// four address bits.
+//
+// Nothing is counted cycle by cycle. Each timer remembers the clock
+// count it was loaded at and the value loaded, and its counter is worked
+// out from the clock whenever it is looked at. The only work a running
+// timer does between accesses is a Scheduler event at the moment it
+// would interrupt, and only if that interrupt is enabled in the IER. The
+// shift register works the same way, a byte at a time.
+//
+// Modelled:
+//		T1		one-shot and free-running, latch reload, IFR bit 6
+//		T2		one-shot interval timer, IFR bit 5. Pulse counting
+//				mode holds the count, as there are no pulses on PB6
+//		SR		shifting in or out under T2 or the system clock, IFR
+//				bit 2. Bits shifted in come from the CB2 input level
+//		Ports	ORA/ORB, DDRA/DDRB, input pins set by the host
+//		CA1/CB1	interrupts on the edge chosen in the PCR
+//
+// Not modelled: PB7 output from T1, the CA2/CB2 handshake and pulse
+// outputs and their interrupts, input latching, and shifting under an
+// external CB1 clock, which never progresses.
+class Via6522 : public Device
+{
+public:
+	Via6522();
+
+	// Takes an IRQ source and registers the timer events. Attach the VIA
+	// to the bus separately, e.g. Attach(&via, 0x6000, 0x600F)
+	void ConnectBus(Bus *n);
+
+	uint8_t read(uint16_t addr) override;
+	void    write(uint16_t addr, uint8_t data) override;
+	uint8_t peek(uint16_t addr) const override;
+	void    poke(uint16_t addr, uint8_t data) override;
+	void    tick(uint64_t nClock) override;
+	void    reset() override;
+
+	enum REGISTER
+	{
+		ORB, ORA, DDRB, DDRA, T1CL, T1CH, T1LL, T1LH,
+		T2CL, T2CH, SR, ACR, PCR, IFR, IER, ORA_NH,
+	};
+
+	enum FLAGS
+	{
+		IFR_CA2 = (1 << 0),
+		IFR_CA1 = (1 << 1),
+		IFR_SR  = (1 << 2),
+		IFR_CB2 = (1 << 3),
+		IFR_CB1 = (1 << 4),
+		IFR_T2  = (1 << 5),
+		IFR_T1  = (1 << 6),
+		IFR_IRQ = (1 << 7),
+	};
+
+	// What the pins of each port are driven to by the outside world. Bits
+	// the DDR makes outputs are driven by the VIA instead. They float
+	// high when nothing is connected
+	void SetPortA(uint8_t nPins);
+	void SetPortB(uint8_t nPins);
+
+	// What the VIA drives onto its ports: output bits from ORA/ORB, and
+	// input bits as the outside world has them
+	uint8_t PortA() const { return (ora & ddra) | (pins_a & ~ddra); }
+	uint8_t PortB() const { return (orb & ddrb) | (pins_b & ~ddrb); }
+
+	// Called with PortA()/PortB() whenever a write to ORx or DDRx changes
+	// it, e.g. to drive an LCD
+	std::function<void(uint8_t)> on_port_a;
+	std::function<void(uint8_t)> on_port_b;
+
+	// Called with each byte shifted out in modes 5 and 6
+	std::function<void(uint8_t)> on_shift_out;
+
+	// Control line inputs
+	void SetCA1(bool bLevel);
+	void SetCB1(bool bLevel);
+	void SetCB2(bool bLevel) { bCB2 = bLevel; }
+
+private:
+	Bus *bus = nullptr;
+	uint32_t irq_source = 0;
+	int t1_event = -1;
+	int t2_event = -1;
+	int sr_event = -1;
+
+	uint64_t nNow = 0;			// Clock count the state is up to
+
+	uint8_t ora = 0x00, orb = 0x00;
+	uint8_t ddra = 0x00, ddrb = 0x00;
+	uint8_t pins_a = 0xFF, pins_b = 0xFF;
+	uint8_t acr = 0x00, pcr = 0x00;
+	uint8_t ifr = 0x00, ier = 0x00;
+	bool bCA1 = true, bCB1 = true, bCB2 = true;
+
+	// Timer 1 was loaded with t1_value at t1_base. It reads $FFFF, and
+	// interrupts if armed, t1_value + 1 cycles later, at t1_expire, and
+	// in free-running mode reloads from the latch one cycle after that
+	uint16_t t1_latch  = 0xFFFF;
+	uint16_t t1_value  = 0xFFFF;
+	uint64_t t1_base   = 0;
+	uint64_t t1_expire = UINT64_MAX;
+	bool     t1_armed  = false;
+
+	// Timer 2 the same, but without a reload
+	uint8_t  t2_latch  = 0xFF;		// Only the low byte is latched
+	uint16_t t2_value  = 0xFFFF;
+	uint64_t t2_base   = 0;
+	uint64_t t2_expire = UINT64_MAX;
+	bool     t2_armed  = false;
+
+	// The shift register has sr_bits left to shift, each taking sr_rate
+	// cycles, the next done at sr_base + sr_rate
+	uint8_t  sr = 0x00;
+	int      sr_bits = 0;
+	uint32_t sr_rate = 0;
+	uint64_t sr_base = 0;
+
+	uint16_t Timer1() const;
+	uint16_t Timer2() const;
+	void RestartTimer1(uint16_t nValue);
+	void RestartTimer2(uint16_t nValue);
+	void StartShift();
+	void WriteAcr(uint8_t data);
+
+	void UpdateTimer1();
+	void UpdateTimer2();
+	void UpdateShift();
+	void UpdateIrq();
+	void ScheduleEvents();
+
+	void WritePort(uint8_t &reg, uint8_t data, bool bPortA);
+};
@@ -0,0 +1,39 @@
+*=$8000
+; counts timer 1 interrupts from a 6522 VIA at $6000, run with --via 6000
+T1CL = $6004
+T1CH = $6005
+ACR  = $600B
+IER  = $600E
+ticks = $00 ; 2 bytes
+
+reset:
+  sei
+  ldx #$ff
+  txs
+  lda #0
+  sta ticks
+  sta ticks+1
+
+  lda #$40      ; timer 1 free-running
+  sta ACR
+  lda #$c0      ; enable the timer 1 interrupt
+  sta IER
+  lda #<9998    ; every 10000 cycles
+  sta T1CL
+  lda #>9998
+  sta T1CH
+  cli
+
+idle:
+  jmp idle
+
+irq:
+  inc ticks
+  bne done
+  inc ticks+1
+done:
+  bit T1CL      ; reading the low counter acknowledges the interrupt
+  rti
+
+*=$FFFC
+.word reset, irq
@@ -86,11 +86,14 @@
 */
 
 #include <cstdint>
+#include <algorithm>
 #include "olc6502.h"
 #include "Bus.h"
+#include "Symbols.h"
 
 // Constructor
-olc6502::olc6502()
+template <typename VARIANT>
+olc6502_t<VARIANT>::olc6502_t()
 {
 	// Assembles the translation table. It's big, it's ugly, but it yields a convenient way
 	// to emulate the 6502. I'm certain there are some "code-golf" strategies to reduce this
@@ -103,29 +106,112 @@ olc6502::olc6502()
 	// or else it will be much much larger :D
 
 	// The table is one big initialiser list of initialiser lists...
-	using a = olc6502;
+	using a = olc6502_t;
 	lookup = 
 	{
-		{ "BRK", &a::BRK, &a::IMM, 7 },{ "ORA", &a::ORA, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::ZP0, 3 },{ "ASL", &a::ASL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHP", &a::PHP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::IMM, 2 },{ "ASL", &a::ASL, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABS, 4 },{ "ASL", &a::ASL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BPL", &a::BPL, &a::REL, 2 },{ "ORA", &a::ORA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ZPX, 4 },{ "ASL", &a::ASL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLC", &a::CLC, &a::IMP, 2 },{ "ORA", &a::ORA, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABX, 4 },{ "ASL", &a::ASL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "JSR", &a::JSR, &a::ABS, 6 },{ "AND", &a::AND, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "BIT", &a::BIT, &a::ZP0, 3 },{ "AND", &a::AND, &a::ZP0, 3 },{ "ROL", &a::ROL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLP", &a::PLP, &a::IMP, 4 },{ "AND", &a::AND, &a::IMM, 2 },{ "ROL", &a::ROL, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "BIT", &a::BIT, &a::ABS, 4 },{ "AND", &a::AND, &a::ABS, 4 },{ "ROL", &a::ROL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BMI", &a::BMI, &a::REL, 2 },{ "AND", &a::AND, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ZPX, 4 },{ "ROL", &a::ROL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEC", &a::SEC, &a::IMP, 2 },{ "AND", &a::AND, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ABX, 4 },{ "ROL", &a::ROL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "RTI", &a::RTI, &a::IMP, 6 },{ "EOR", &a::EOR, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "EOR", &a::EOR, &a::ZP0, 3 },{ "LSR", &a::LSR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHA", &a::PHA, &a::IMP, 3 },{ "EOR", &a::EOR, &a::IMM, 2 },{ "LSR", &a::LSR, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::ABS, 3 },{ "EOR", &a::EOR, &a::ABS, 4 },{ "LSR", &a::LSR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BVC", &a::BVC, &a::REL, 2 },{ "EOR", &a::EOR, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ZPX, 4 },{ "LSR", &a::LSR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLI", &a::CLI, &a::IMP, 2 },{ "EOR", &a::EOR, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ABX, 4 },{ "LSR", &a::LSR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "RTS", &a::RTS, &a::IMP, 6 },{ "ADC", &a::ADC, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ADC", &a::ADC, &a::ZP0, 3 },{ "ROR", &a::ROR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLA", &a::PLA, &a::IMP, 4 },{ "ADC", &a::ADC, &a::IMM, 2 },{ "ROR", &a::ROR, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::IND, 5 },{ "ADC", &a::ADC, &a::ABS, 4 },{ "ROR", &a::ROR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BVS", &a::BVS, &a::REL, 2 },{ "ADC", &a::ADC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ZPX, 4 },{ "ROR", &a::ROR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEI", &a::SEI, &a::IMP, 2 },{ "ADC", &a::ADC, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ABX, 4 },{ "ROR", &a::ROR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "???", &a::NOP, &a::IMP, 2 },{ "STA", &a::STA, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZP0, 3 },{ "STA", &a::STA, &a::ZP0, 3 },{ "STX", &a::STX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "DEY", &a::DEY, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 2 },{ "TXA", &a::TXA, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "STY", &a::STY, &a::ABS, 4 },{ "STA", &a::STA, &a::ABS, 4 },{ "STX", &a::STX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "BCC", &a::BCC, &a::REL, 2 },{ "STA", &a::STA, &a::IZY, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZPX, 4 },{ "STA", &a::STA, &a::ZPX, 4 },{ "STX", &a::STX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "TYA", &a::TYA, &a::IMP, 2 },{ "STA", &a::STA, &a::ABY, 5 },{ "TXS", &a::TXS, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::NOP, &a::IMP, 5 },{ "STA", &a::STA, &a::ABX, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::XXX, &a::IMP, 5 },
-		{ "LDY", &a::LDY, &a::IMM, 2 },{ "LDA", &a::LDA, &a::IZX, 6 },{ "LDX", &a::LDX, &a::IMM, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "LDY", &a::LDY, &a::ZP0, 3 },{ "LDA", &a::LDA, &a::ZP0, 3 },{ "LDX", &a::LDX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "TAY", &a::TAY, &a::IMP, 2 },{ "LDA", &a::LDA, &a::IMM, 2 },{ "TAX", &a::TAX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "LDY", &a::LDY, &a::ABS, 4 },{ "LDA", &a::LDA, &a::ABS, 4 },{ "LDX", &a::LDX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "BCS", &a::BCS, &a::REL, 2 },{ "LDA", &a::LDA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "LDY", &a::LDY, &a::ZPX, 4 },{ "LDA", &a::LDA, &a::ZPX, 4 },{ "LDX", &a::LDX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "CLV", &a::CLV, &a::IMP, 2 },{ "LDA", &a::LDA, &a::ABY, 4 },{ "TSX", &a::TSX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 4 },{ "LDY", &a::LDY, &a::ABX, 4 },{ "LDA", &a::LDA, &a::ABX, 4 },{ "LDX", &a::LDX, &a::ABY, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "CPY", &a::CPY, &a::IMM, 2 },{ "CMP", &a::CMP, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPY", &a::CPY, &a::ZP0, 3 },{ "CMP", &a::CMP, &a::ZP0, 3 },{ "DEC", &a::DEC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INY", &a::INY, &a::IMP, 2 },{ "CMP", &a::CMP, &a::IMM, 2 },{ "DEX", &a::DEX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "CPY", &a::CPY, &a::ABS, 4 },{ "CMP", &a::CMP, &a::ABS, 4 },{ "DEC", &a::DEC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BNE", &a::BNE, &a::REL, 2 },{ "CMP", &a::CMP, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ZPX, 4 },{ "DEC", &a::DEC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLD", &a::CLD, &a::IMP, 2 },{ "CMP", &a::CMP, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ABX, 4 },{ "DEC", &a::DEC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "CPX", &a::CPX, &a::IMM, 2 },{ "SBC", &a::SBC, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPX", &a::CPX, &a::ZP0, 3 },{ "SBC", &a::SBC, &a::ZP0, 3 },{ "INC", &a::INC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INX", &a::INX, &a::IMP, 2 },{ "SBC", &a::SBC, &a::IMM, 2 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::SBC, &a::IMP, 2 },{ "CPX", &a::CPX, &a::ABS, 4 },{ "SBC", &a::SBC, &a::ABS, 4 },{ "INC", &a::INC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BEQ", &a::BEQ, &a::REL, 2 },{ "SBC", &a::SBC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ZPX, 4 },{ "INC", &a::INC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SED", &a::SED, &a::IMP, 2 },{ "SBC", &a::SBC, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ABX, 4 },{ "INC", &a::INC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
+		{ "BRK", &a::BRK, &a::IMM, 7 },{ "ORA", &a::ORA, &a::IZX, 6 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "SLO", &a::SLO, &a::IZX, 8, false },{ "NOP", &a::IGN, &a::ZP0, 3, false },{ "ORA", &a::ORA, &a::ZP0, 3 },{ "ASL", &a::ASL, &a::ZP0, 5 },{ "SLO", &a::SLO, &a::ZP0, 5, false },{ "PHP", &a::PHP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::IMM, 2 },{ "ASL", &a::ASL, &a::IMP, 2 },{ "ANC", &a::ANC, &a::IMM, 2, false },{ "NOP", &a::IGN, &a::ABS, 4, false },{ "ORA", &a::ORA, &a::ABS, 4 },{ "ASL", &a::ASL, &a::ABS, 6 },{ "SLO", &a::SLO, &a::ABS, 6, false },
+		{ "BPL", &a::BPL, &a::REL, 2 },{ "ORA", &a::ORA, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "SLO", &a::SLO, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "ORA", &a::ORA, &a::ZPX, 4 },{ "ASL", &a::ASL, &a::ZPX, 6 },{ "SLO", &a::SLO, &a::ZPX, 6, false },{ "CLC", &a::CLC, &a::IMP, 2 },{ "ORA", &a::ORA, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "SLO", &a::SLO, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "ORA", &a::ORA, &a::ABX, 4 },{ "ASL", &a::ASL, &a::ABX, 7 },{ "SLO", &a::SLO, &a::ABX, 7, false },
+		{ "JSR", &a::JSR, &a::ABS, 6 },{ "AND", &a::AND, &a::IZX, 6 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "RLA", &a::RLA, &a::IZX, 8, false },{ "BIT", &a::BIT, &a::ZP0, 3 },{ "AND", &a::AND, &a::ZP0, 3 },{ "ROL", &a::ROL, &a::ZP0, 5 },{ "RLA", &a::RLA, &a::ZP0, 5, false },{ "PLP", &a::PLP, &a::IMP, 4 },{ "AND", &a::AND, &a::IMM, 2 },{ "ROL", &a::ROL, &a::IMP, 2 },{ "ANC", &a::ANC, &a::IMM, 2, false },{ "BIT", &a::BIT, &a::ABS, 4 },{ "AND", &a::AND, &a::ABS, 4 },{ "ROL", &a::ROL, &a::ABS, 6 },{ "RLA", &a::RLA, &a::ABS, 6, false },
+		{ "BMI", &a::BMI, &a::REL, 2 },{ "AND", &a::AND, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "RLA", &a::RLA, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "AND", &a::AND, &a::ZPX, 4 },{ "ROL", &a::ROL, &a::ZPX, 6 },{ "RLA", &a::RLA, &a::ZPX, 6, false },{ "SEC", &a::SEC, &a::IMP, 2 },{ "AND", &a::AND, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "RLA", &a::RLA, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "AND", &a::AND, &a::ABX, 4 },{ "ROL", &a::ROL, &a::ABX, 7 },{ "RLA", &a::RLA, &a::ABX, 7, false },
+		{ "RTI", &a::RTI, &a::IMP, 6 },{ "EOR", &a::EOR, &a::IZX, 6 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "SRE", &a::SRE, &a::IZX, 8, false },{ "NOP", &a::IGN, &a::ZP0, 3, false },{ "EOR", &a::EOR, &a::ZP0, 3 },{ "LSR", &a::LSR, &a::ZP0, 5 },{ "SRE", &a::SRE, &a::ZP0, 5, false },{ "PHA", &a::PHA, &a::IMP, 3 },{ "EOR", &a::EOR, &a::IMM, 2 },{ "LSR", &a::LSR, &a::IMP, 2 },{ "ALR", &a::ALR, &a::IMM, 2, false },{ "JMP", &a::JMP, &a::ABS, 3 },{ "EOR", &a::EOR, &a::ABS, 4 },{ "LSR", &a::LSR, &a::ABS, 6 },{ "SRE", &a::SRE, &a::ABS, 6, false },
+		{ "BVC", &a::BVC, &a::REL, 2 },{ "EOR", &a::EOR, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "SRE", &a::SRE, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "EOR", &a::EOR, &a::ZPX, 4 },{ "LSR", &a::LSR, &a::ZPX, 6 },{ "SRE", &a::SRE, &a::ZPX, 6, false },{ "CLI", &a::CLI, &a::IMP, 2 },{ "EOR", &a::EOR, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "SRE", &a::SRE, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "EOR", &a::EOR, &a::ABX, 4 },{ "LSR", &a::LSR, &a::ABX, 7 },{ "SRE", &a::SRE, &a::ABX, 7, false },
+		{ "RTS", &a::RTS, &a::IMP, 6 },{ "ADC", &a::ADC, &a::IZX, 6 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "RRA", &a::RRA, &a::IZX, 8, false },{ "NOP", &a::IGN, &a::ZP0, 3, false },{ "ADC", &a::ADC, &a::ZP0, 3 },{ "ROR", &a::ROR, &a::ZP0, 5 },{ "RRA", &a::RRA, &a::ZP0, 5, false },{ "PLA", &a::PLA, &a::IMP, 4 },{ "ADC", &a::ADC, &a::IMM, 2 },{ "ROR", &a::ROR, &a::IMP, 2 },{ "ARR", &a::ARR, &a::IMM, 2, false },{ "JMP", &a::JMP, &a::IND, 5 },{ "ADC", &a::ADC, &a::ABS, 4 },{ "ROR", &a::ROR, &a::ABS, 6 },{ "RRA", &a::RRA, &a::ABS, 6, false },
+		{ "BVS", &a::BVS, &a::REL, 2 },{ "ADC", &a::ADC, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "RRA", &a::RRA, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "ADC", &a::ADC, &a::ZPX, 4 },{ "ROR", &a::ROR, &a::ZPX, 6 },{ "RRA", &a::RRA, &a::ZPX, 6, false },{ "SEI", &a::SEI, &a::IMP, 2 },{ "ADC", &a::ADC, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "RRA", &a::RRA, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "ADC", &a::ADC, &a::ABX, 4 },{ "ROR", &a::ROR, &a::ABX, 7 },{ "RRA", &a::RRA, &a::ABX, 7, false },
+		{ "NOP", &a::NOP, &a::IMM, 2, false },{ "STA", &a::STA, &a::IZX, 6 },{ "NOP", &a::NOP, &a::IMM, 2, false },{ "SAX", &a::SAX, &a::IZX, 6, false },{ "STY", &a::STY, &a::ZP0, 3 },{ "STA", &a::STA, &a::ZP0, 3 },{ "STX", &a::STX, &a::ZP0, 3 },{ "SAX", &a::SAX, &a::ZP0, 3, false },{ "DEY", &a::DEY, &a::IMP, 2 },{ "NOP", &a::NOP, &a::IMM, 2, false },{ "TXA", &a::TXA, &a::IMP, 2 },{ "ANE", &a::ANE, &a::IMM, 2, false },{ "STY", &a::STY, &a::ABS, 4 },{ "STA", &a::STA, &a::ABS, 4 },{ "STX", &a::STX, &a::ABS, 4 },{ "SAX", &a::SAX, &a::ABS, 4, false },
+		{ "BCC", &a::BCC, &a::REL, 2 },{ "STA", &a::STA, &a::IZY, 6 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "SHA", &a::SHA, &a::IZY, 6, false },{ "STY", &a::STY, &a::ZPX, 4 },{ "STA", &a::STA, &a::ZPX, 4 },{ "STX", &a::STX, &a::ZPY, 4 },{ "SAX", &a::SAX, &a::ZPY, 4, false },{ "TYA", &a::TYA, &a::IMP, 2 },{ "STA", &a::STA, &a::ABY, 5 },{ "TXS", &a::TXS, &a::IMP, 2 },{ "TAS", &a::TAS, &a::ABY, 5, false },{ "SHY", &a::SHY, &a::ABX, 5, false },{ "STA", &a::STA, &a::ABX, 5 },{ "SHX", &a::SHX, &a::ABY, 5, false },{ "SHA", &a::SHA, &a::ABY, 5, false },
+		{ "LDY", &a::LDY, &a::IMM, 2 },{ "LDA", &a::LDA, &a::IZX, 6 },{ "LDX", &a::LDX, &a::IMM, 2 },{ "LAX", &a::LAX, &a::IZX, 6, false },{ "LDY", &a::LDY, &a::ZP0, 3 },{ "LDA", &a::LDA, &a::ZP0, 3 },{ "LDX", &a::LDX, &a::ZP0, 3 },{ "LAX", &a::LAX, &a::ZP0, 3, false },{ "TAY", &a::TAY, &a::IMP, 2 },{ "LDA", &a::LDA, &a::IMM, 2 },{ "TAX", &a::TAX, &a::IMP, 2 },{ "LXA", &a::LXA, &a::IMM, 2, false },{ "LDY", &a::LDY, &a::ABS, 4 },{ "LDA", &a::LDA, &a::ABS, 4 },{ "LDX", &a::LDX, &a::ABS, 4 },{ "LAX", &a::LAX, &a::ABS, 4, false },
+		{ "BCS", &a::BCS, &a::REL, 2 },{ "LDA", &a::LDA, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "LAX", &a::LAX, &a::IZY, 5, false },{ "LDY", &a::LDY, &a::ZPX, 4 },{ "LDA", &a::LDA, &a::ZPX, 4 },{ "LDX", &a::LDX, &a::ZPY, 4 },{ "LAX", &a::LAX, &a::ZPY, 4, false },{ "CLV", &a::CLV, &a::IMP, 2 },{ "LDA", &a::LDA, &a::ABY, 4 },{ "TSX", &a::TSX, &a::IMP, 2 },{ "LAS", &a::LAS, &a::ABY, 4, false },{ "LDY", &a::LDY, &a::ABX, 4 },{ "LDA", &a::LDA, &a::ABX, 4 },{ "LDX", &a::LDX, &a::ABY, 4 },{ "LAX", &a::LAX, &a::ABY, 4, false },
+		{ "CPY", &a::CPY, &a::IMM, 2 },{ "CMP", &a::CMP, &a::IZX, 6 },{ "NOP", &a::NOP, &a::IMM, 2, false },{ "DCP", &a::DCP, &a::IZX, 8, false },{ "CPY", &a::CPY, &a::ZP0, 3 },{ "CMP", &a::CMP, &a::ZP0, 3 },{ "DEC", &a::DEC, &a::ZP0, 5 },{ "DCP", &a::DCP, &a::ZP0, 5, false },{ "INY", &a::INY, &a::IMP, 2 },{ "CMP", &a::CMP, &a::IMM, 2 },{ "DEX", &a::DEX, &a::IMP, 2 },{ "SBX", &a::SBX, &a::IMM, 2, false },{ "CPY", &a::CPY, &a::ABS, 4 },{ "CMP", &a::CMP, &a::ABS, 4 },{ "DEC", &a::DEC, &a::ABS, 6 },{ "DCP", &a::DCP, &a::ABS, 6, false },
+		{ "BNE", &a::BNE, &a::REL, 2 },{ "CMP", &a::CMP, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "DCP", &a::DCP, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "CMP", &a::CMP, &a::ZPX, 4 },{ "DEC", &a::DEC, &a::ZPX, 6 },{ "DCP", &a::DCP, &a::ZPX, 6, false },{ "CLD", &a::CLD, &a::IMP, 2 },{ "CMP", &a::CMP, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "DCP", &a::DCP, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "CMP", &a::CMP, &a::ABX, 4 },{ "DEC", &a::DEC, &a::ABX, 7 },{ "DCP", &a::DCP, &a::ABX, 7, false },
+		{ "CPX", &a::CPX, &a::IMM, 2 },{ "SBC", &a::SBC, &a::IZX, 6 },{ "NOP", &a::NOP, &a::IMM, 2, false },{ "ISC", &a::ISC, &a::IZX, 8, false },{ "CPX", &a::CPX, &a::ZP0, 3 },{ "SBC", &a::SBC, &a::ZP0, 3 },{ "INC", &a::INC, &a::ZP0, 5 },{ "ISC", &a::ISC, &a::ZP0, 5, false },{ "INX", &a::INX, &a::IMP, 2 },{ "SBC", &a::SBC, &a::IMM, 2 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "SBC", &a::SBC, &a::IMM, 2, false },{ "CPX", &a::CPX, &a::ABS, 4 },{ "SBC", &a::SBC, &a::ABS, 4 },{ "INC", &a::INC, &a::ABS, 6 },{ "ISC", &a::ISC, &a::ABS, 6, false },
+		{ "BEQ", &a::BEQ, &a::REL, 2 },{ "SBC", &a::SBC, &a::IZY, 5 },{ "KIL", &a::KIL, &a::IMP, 2, false },{ "ISC", &a::ISC, &a::IZY, 8, false },{ "NOP", &a::IGN, &a::ZPX, 4, false },{ "SBC", &a::SBC, &a::ZPX, 4 },{ "INC", &a::INC, &a::ZPX, 6 },{ "ISC", &a::ISC, &a::ZPX, 6, false },{ "SED", &a::SED, &a::IMP, 2 },{ "SBC", &a::SBC, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2, false },{ "ISC", &a::ISC, &a::ABY, 7, false },{ "NOP", &a::IGN, &a::ABX, 4, false },{ "SBC", &a::SBC, &a::ABX, 4 },{ "INC", &a::INC, &a::ABX, 7 },{ "ISC", &a::ISC, &a::ABX, 7, false },
 	};
+
+	// The 65C02's table is the one above with its changes laid over it.
+	// Every opcode the 65C02 doesn't use is a NOP, but they come in a few
+	// lengths and speeds, so they are set first and the new instructions
+	// then take their slots. Like the NMOS extra NOPs, they are reserved
+	// rather than documented
+	if constexpr (VARIANT::bCmos)
+	{
+		for (int op = 0; op < 256; op++)
+		{
+			if ((op & 0x0F) == 0x02 && op != 0xA2)
+				lookup[op] = { "NOP", &a::NOP, &a::IMM, 2, false };
+			else if ((op & 0x07) == 0x03)
+				lookup[op] = { "NOP", &a::NOP, &a::IMP, 1, false };
+		}
+		lookup[0x44] = { "NOP", &a::NOP, &a::ZP0, 3, false };
+		lookup[0x54] = { "NOP", &a::NOP, &a::ZPX, 4, false };
+		lookup[0xD4] = { "NOP", &a::NOP, &a::ZPX, 4, false };
+		lookup[0xF4] = { "NOP", &a::NOP, &a::ZPX, 4, false };
+		lookup[0x5C] = { "NOP", &a::NOP, &a::ABS, 8, false };
+		lookup[0xDC] = { "NOP", &a::NOP, &a::ABS, 4, false };
+		lookup[0xFC] = { "NOP", &a::NOP, &a::ABS, 4, false };
+
+		// (zp) for each of the eight ALU instructions
+		lookup[0x12] = { "ORA", &a::ORA, &a::IZP, 5 };
+		lookup[0x32] = { "AND", &a::AND, &a::IZP, 5 };
+		lookup[0x52] = { "EOR", &a::EOR, &a::IZP, 5 };
+		lookup[0x72] = { "ADC", &a::ADC, &a::IZP, 5 };
+		lookup[0x92] = { "STA", &a::STA, &a::IZP, 5 };
+		lookup[0xB2] = { "LDA", &a::LDA, &a::IZP, 5 };
+		lookup[0xD2] = { "CMP", &a::CMP, &a::IZP, 5 };
+		lookup[0xF2] = { "SBC", &a::SBC, &a::IZP, 5 };
+
+		lookup[0x04] = { "TSB", &a::TSB, &a::ZP0, 5 };
+		lookup[0x0C] = { "TSB", &a::TSB, &a::ABS, 6 };
+		lookup[0x14] = { "TRB", &a::TRB, &a::ZP0, 5 };
+		lookup[0x1C] = { "TRB", &a::TRB, &a::ABS, 6 };
+		lookup[0x1A] = { "INC", &a::INA, &a::IMP, 2 };
+		lookup[0x3A] = { "DEC", &a::DEA, &a::IMP, 2 };
+		lookup[0x34] = { "BIT", &a::BIT, &a::ZPX, 4 };
+		lookup[0x3C] = { "BIT", &a::BIT, &a::ABX, 4 };
+		lookup[0x89] = { "BIT", &a::BIT, &a::IMM, 2 };
+		lookup[0x5A] = { "PHY", &a::PHY, &a::IMP, 3 };
+		lookup[0x7A] = { "PLY", &a::PLY, &a::IMP, 4 };
+		lookup[0xDA] = { "PHX", &a::PHX, &a::IMP, 3 };
+		lookup[0xFA] = { "PLX", &a::PLX, &a::IMP, 4 };
+		lookup[0x64] = { "STZ", &a::STZ, &a::ZP0, 3 };
+		lookup[0x74] = { "STZ", &a::STZ, &a::ZPX, 4 };
+		lookup[0x9C] = { "STZ", &a::STZ, &a::ABS, 4 };
+		lookup[0x9E] = { "STZ", &a::STZ, &a::ABX, 5 };
+		lookup[0x6C] = { "JMP", &a::JMP, &a::IND, 6 };
+		lookup[0x7C] = { "JMP", &a::JMP, &a::IAX, 6 };
+		lookup[0x80] = { "BRA", &a::BRA, &a::REL, 2 };
+		lookup[0xCB] = { "WAI", &a::WAI, &a::IMP, 3 };
+		lookup[0xDB] = { "STP", &a::STP, &a::IMP, 3 };
+
+		// Shifts and rotates with abs,X only take the extra cycle when the
+		// page is crossed, see ASL
+		lookup[0x1E].cycles = 6;
+		lookup[0x3E].cycles = 6;
+		lookup[0x5E].cycles = 6;
+		lookup[0x7E].cycles = 6;
+
+		// The bit instructions fill the x7 and xF columns, with the bit
+		// number in the top three bits of the opcode
+		for (int bit = 0; bit < 8; bit++)
+		{
+			lookup[0x07 + bit * 0x10] = { "RMB" + std::to_string(bit), &a::RMB, &a::ZP0, 5 };
+			lookup[0x87 + bit * 0x10] = { "SMB" + std::to_string(bit), &a::SMB, &a::ZP0, 5 };
+			lookup[0x0F + bit * 0x10] = { "BBR" + std::to_string(bit), &a::BBR, &a::ZPR, 5 };
+			lookup[0x8F + bit * 0x10] = { "BBS" + std::to_string(bit), &a::BBS, &a::ZPR, 5 };
+		}
+	}
+
+	// Branches, jumps, calls and returns end basic blocks, so they are
+	// where coverage is counted
+	for (int op = 0; op < 256; op++)
+	{
+		uint8_t (olc6502_t::*f)(void) = lookup[op].operate;
+		edge_op[op] = lookup[op].addrmode == &a::REL || lookup[op].addrmode == &a::ZPR
+			|| f == &a::JMP || f == &a::JSR || f == &a::RTS || f == &a::RTI || f == &a::BRK;
+	}
 }
 
-olc6502::~olc6502()
+template <typename VARIANT>
+olc6502_t<VARIANT>::~olc6502_t()
 {
 	// Destructor - has nothing to do
 }
@@ -138,20 +224,103 @@ olc6502::~olc6502()
 // BUS CONNECTIVITY
 
 // Reads an 8-bit byte from the bus, located at the specified 16-bit address
-uint8_t olc6502::read(uint16_t a)
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::read(uint16_t a)
+{
+	// Some devices on the bus may change state when they are read from, and
+	// this is intentional under normal circumstances. The disassembler uses
+	// bus->peek() instead, to read the data at an address without changing
+	// the state of the devices on the bus
+	return bus->read(a);
+}
+
+// Writes a byte to the bus at the specified address. Stores to the zero
+// page take its fast path, see below
+template <typename VARIANT>
+void olc6502_t<VARIANT>::write(uint16_t a, uint8_t d)
+{
+	if (a < 0x0100)
+		WriteZP((uint8_t)a, d);
+	else
+		bus->write(a, d);
+}
+
+// Opcodes and their operands come from the page pc is in, through a host
+// pointer kept until pc leaves the page or the bus remaps that page, so
+// straight-line code doesn't look up the page table at all. A device
+// page has no pointer, and while watchpoints are armed every fetch goes
+// through the bus, which is tested on each one as they can be armed
+// between any two
+template <typename VARIANT>
+inline uint8_t olc6502_t<VARIANT>::ReadPC()
+{
+	if ((pc >> 8) != code_page)
+		CodePage();
+	if (code && !bus->bp.armed)
+		return code[pc++ & 0xFF];
+	return read(pc++);
+}
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::CodePage()
+{
+	code_page = pc >> 8;
+	code = bus->page[code_page];
+}
+
+// The stack is page $01, which is almost always plain RAM, so pushes and
+// pulls go straight to the host memory the bus's page table has for it,
+// without a call. That entry is kept current by the bus whenever the page
+// is remapped, and is nullptr with a device in the page, which is reached
+// through the bus as before. So is everything while watchpoints are armed
+// or writes are being logged, which the bus has to see
+template <typename VARIANT>
+inline void olc6502_t<VARIANT>::Push(uint8_t d)
+{
+	uint8_t *p = bus->page[0x01];
+	if (p && !bus->bp.armed && !bus->write_log)
+	{
+		p[stkp] = d;
+		bus->page_gen[0x01]++;
+	}
+	else
+		write(0x0100 + stkp, d);
+	stkp--;
+}
+
+template <typename VARIANT>
+inline uint8_t olc6502_t<VARIANT>::Pull()
+{
+	stkp++;
+	const uint8_t *p = bus->page[0x01];
+	if (p && !bus->bp.armed)
+		return p[stkp];
+	return read(0x0100 + stkp);
+}
+
+// The zero page is the 6502's scratchpad, and nearly as busy as the stack.
+// Operands there and the pointers of the indirect modes are read and
+// written in the same way
+template <typename VARIANT>
+inline uint8_t olc6502_t<VARIANT>::ReadZP(uint8_t a)
 {
-	// In normal operation "read only" is set to false. This may seem odd. Some
-	// devices on the bus may change state when they are read from, and this 
-	// is intentional under normal circumstances. However the disassembler will
-	// want to read the data at an address without changing the state of the
-	// devices on the bus
-	return bus->read(a, false);
+	const uint8_t *p = bus->page[0x00];
+	if (p && !bus->bp.armed)
+		return p[a];
+	return bus->read(a);
 }
 
-// Writes a byte to the bus at the specified address
-void olc6502::write(uint16_t a, uint8_t d)
+template <typename VARIANT>
+inline void olc6502_t<VARIANT>::WriteZP(uint8_t a, uint8_t d)
 {
-	bus->write(a, d);
+	uint8_t *p = bus->page[0x00];
+	if (p && !bus->bp.armed && !bus->write_log)
+	{
+		p[a] = d;
+		bus->page_gen[0x00]++;
+	}
+	else
+		bus->write(a, d);
 }
 
 
@@ -168,7 +337,8 @@ void olc6502::write(uint16_t a, uint8_t d)
 // allows the programmer to jump to a known and programmable location in the
 // memory to start executing from. Typically the programmer would set the value
 // at location 0xFFFC at compile time.
-void olc6502::reset()
+template <typename VARIANT>
+void olc6502_t<VARIANT>::reset()
 {
 	// Get address to set program counter to
 	addr_abs = 0xFFFC;
@@ -190,6 +360,10 @@ void olc6502::reset()
 	addr_abs = 0x0000;
 	fetched = 0x00;
 
+	// Nothing is being called any more, and a stopped 65C02 restarts
+	call_depth = 0;
+	halt = HALT_NONE;
+
 	// Reset takes time
 	cycles = 8;
 }
@@ -208,30 +382,52 @@ void olc6502::reset()
 // has happened, in a similar way to a reset, a programmable address
 // is read form hard coded location 0xFFFE, which is subsequently
 // set to the program counter.
-void olc6502::irq()
+template <typename VARIANT>
+void olc6502_t<VARIANT>::irq()
 {
+	// Only a reset gets a CPU going again after KIL or STP
+	if (halt == HALT_STP)
+		return;
+
+	// A 65C02 waiting after WAI carries on when an IRQ arrives, even with
+	// interrupts disabled, in which case it just continues with the next
+	// instruction
+	if constexpr (VARIANT::bCmos)
+	{
+		if (halt == HALT_WAI)
+			halt = HALT_NONE;
+	}
+
 	// If interrupts are allowed
 	if (GetFlag(I) == 0)
 	{
+		uint16_t ret = pc;
+		uint8_t  sp  = stkp;
+
 		// Push the program counter to the stack. It's 16-bits dont
 		// forget so that takes two pushes
-		write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-		stkp--;
-		write(0x0100 + stkp, pc & 0x00FF);
-		stkp--;
+		Push((pc >> 8) & 0x00FF);
+		Push(pc & 0x00FF);
 
-		// Then Push the status register to the stack
+		// Then Push the status register to the stack. I is set after, so
+		// RTI brings back the interrupts the program had enabled
 		SetFlag(B, 0);
 		SetFlag(U, 1);
+		Push(status);
 		SetFlag(I, 1);
-		write(0x0100 + stkp, status);
-		stkp--;
+
+		// The 65C02 also leaves decimal mode for the handler
+		if constexpr (VARIANT::bCmos)
+			SetFlag(D, 0);
 
 		// Read new program counter location from fixed address
 		addr_abs = 0xFFFE;
 		uint16_t lo = read(addr_abs + 0);
 		uint16_t hi = read(addr_abs + 1);
 		pc = (hi << 8) | lo;
+		PushFrame(FRAME_IRQ, pc, ret, sp);
+		if (coverage)
+			CoverEdge();
 
 		// IRQs take time
 		cycles = 7;
@@ -242,29 +438,46 @@ void olc6502::irq()
 // A Non-Maskable Interrupt cannot be ignored. It behaves in exactly the
 // same way as a regular IRQ, but reads the new program counter address
 // form location 0xFFFA.
-void olc6502::nmi()
+template <typename VARIANT>
+void olc6502_t<VARIANT>::nmi()
 {
-	write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-	stkp--;
-	write(0x0100 + stkp, pc & 0x00FF);
-	stkp--;
+	if (halt == HALT_STP)
+		return;
+
+	if constexpr (VARIANT::bCmos)
+	{
+		if (halt == HALT_WAI)
+			halt = HALT_NONE;
+	}
+
+	uint16_t ret = pc;
+	uint8_t  sp  = stkp;
+
+	Push((pc >> 8) & 0x00FF);
+	Push(pc & 0x00FF);
 
 	SetFlag(B, 0);
 	SetFlag(U, 1);
+	Push(status);
 	SetFlag(I, 1);
-	write(0x0100 + stkp, status);
-	stkp--;
+
+	if constexpr (VARIANT::bCmos)
+		SetFlag(D, 0);
 
 	addr_abs = 0xFFFA;
 	uint16_t lo = read(addr_abs + 0);
 	uint16_t hi = read(addr_abs + 1);
 	pc = (hi << 8) | lo;
+	PushFrame(FRAME_NMI, pc, ret, sp);
+	if (coverage)
+		CoverEdge();
 
 	cycles = 8;
 }
 
 // Perform one clock cycles worth of emulation
-void olc6502::clock()
+template <typename VARIANT>
+void olc6502_t<VARIANT>::clock()
 {
 	// Each instruction requires a variable number of clock cycles to execute.
 	// In my emulation, I only care about the final result and so I perform
@@ -276,22 +489,39 @@ void olc6502::clock()
 	// implement that delay by simply counting down the cycles required by 
 	// the instruction. When it reaches 0, the instruction is complete, and
 	// the next one is ready to be executed.
+	// Anything scheduled on the bus, such as device timers, happens between
+	// instructions. It may raise an interrupt, which then takes its cycles
+	if (cycles == 0 && clock_count >= bus->sched.next)
+		bus->sched.Dispatch(clock_count);
+
 	if (cycles == 0)
 	{
-		// Read next instruction byte. This 8-bit value is used to index
-		// the translation table to get the relevant information about
-		// how to implement the instruction
-		opcode = read(pc);
+		// After KIL, WAI or STP the CPU does nothing but let time pass
+		if (halt != HALT_NONE)
+		{
+			clock_count++;
+			return;
+		}
+
+		// Stop in front of an execution breakpoint. Nothing happens on this
+		// clock, so the CPU stays put until step() or run() resumes it
+		if (bus->bp.armed && bus->bp.CheckExec(pc))
+			return;
 
 #ifdef LOGMODE
 		uint16_t log_pc = pc;
 #endif
+
+		// Read next instruction byte. This 8-bit value is used to index
+		// the translation table to get the relevant information about
+		// how to implement the instruction. Reading it increments the
+		// program counter
+		opcode = ReadPC();
 		
 		// Always set the unused status flag bit to 1
 		SetFlag(U, true);
 		
-		// Increment program counter, we read the opcode byte
-		pc++;
+		instr_count++;
 
 		// Get Starting number of cycles
 		cycles = lookup[opcode].cycles;
@@ -307,6 +537,9 @@ void olc6502::clock()
 		// of cycles this instruction requires before its completed
 		cycles += (additional_cycle1 & additional_cycle2);
 
+		if (coverage && edge_op[opcode])
+			CoverEdge();
+
 		// Always set the unused status flag bit to 1
 		SetFlag(U, true);
 
@@ -317,8 +550,8 @@ void olc6502::clock()
 		if (logfile == nullptr)	logfile = fopen("olc6502.txt", "wt");
 		if (logfile != nullptr)
 		{
-			fprintf(logfile, "%10d:%02d PC:%04X %s A:%02X X:%02X Y:%02X %s%s%s%s%s%s%s%s STKP:%02X\n",
-				clock_count, 0, log_pc, "XXX", a, x, y,	
+			fprintf(logfile, "%10llu:%02d PC:%04X %s A:%02X X:%02X Y:%02X %s%s%s%s%s%s%s%s STKP:%02X\n",
+				(unsigned long long)clock_count, 0, log_pc, "XXX", a, x, y,	
 				GetFlag(N) ? "N" : ".",	GetFlag(V) ? "V" : ".",	GetFlag(U) ? "U" : ".",	
 				GetFlag(B) ? "B" : ".",	GetFlag(D) ? "D" : ".",	GetFlag(I) ? "I" : ".",	
 				GetFlag(Z) ? "Z" : ".",	GetFlag(C) ? "C" : ".",	stkp);
@@ -342,13 +575,15 @@ void olc6502::clock()
 // FLAG FUNCTIONS
 
 // Returns the value of a specific bit of the status register
-uint8_t olc6502::GetFlag(FLAGS6502 f)
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::GetFlag(FLAGS6502 f)
 {
 	return ((status & f) > 0) ? 1 : 0;
 }
 
 // Sets or clears a specific bit of the status register
-void olc6502::SetFlag(FLAGS6502 f, bool v)
+template <typename VARIANT>
+void olc6502_t<VARIANT>::SetFlag(FLAGS6502 f, bool v)
 {
 	if (v)
 		status |= f;
@@ -378,7 +613,8 @@ void olc6502::SetFlag(FLAGS6502 f, bool v)
 // There is no additional data required for this instruction. The instruction
 // does something very simple like like sets a status bit. However, we will
 // target the accumulator, for instructions like PHA
-uint8_t olc6502::IMP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IMP()
 {
 	fetched = a;
 	return 0;
@@ -388,7 +624,8 @@ uint8_t olc6502::IMP()
 // Address Mode: Immediate
 // The instruction expects the next byte to be used as a value, so we'll prep
 // the read address to point to the next byte
-uint8_t olc6502::IMM()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IMM()
 {
 	addr_abs = pc++;	
 	return 0;
@@ -400,10 +637,10 @@ uint8_t olc6502::IMM()
 // To save program bytes, zero page addressing allows you to absolutely address
 // a location in first 0xFF bytes of address range. Clearly this only requires
 // one byte instead of the usual two.
-uint8_t olc6502::ZP0()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ZP0()
 {
-	addr_abs = read(pc);	
-	pc++;
+	addr_abs = ReadPC();
 	addr_abs &= 0x00FF;
 	return 0;
 }
@@ -414,10 +651,10 @@ uint8_t olc6502::ZP0()
 // Fundamentally the same as Zero Page addressing, but the contents of the X Register
 // is added to the supplied single byte address. This is useful for iterating through
 // ranges within the first page.
-uint8_t olc6502::ZPX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ZPX()
 {
-	addr_abs = (read(pc) + x);
-	pc++;
+	addr_abs = (ReadPC() + x);
 	addr_abs &= 0x00FF;
 	return 0;
 }
@@ -425,10 +662,10 @@ uint8_t olc6502::ZPX()
 
 // Address Mode: Zero Page with Y Offset
 // Same as above but uses Y Register for offset
-uint8_t olc6502::ZPY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ZPY()
 {
-	addr_abs = (read(pc) + y);
-	pc++;
+	addr_abs = (ReadPC() + y);
 	addr_abs &= 0x00FF;
 	return 0;
 }
@@ -438,10 +675,10 @@ uint8_t olc6502::ZPY()
 // This address mode is exclusive to branch instructions. The address
 // must reside within -128 to +127 of the branch instruction, i.e.
 // you cant directly branch to any address in the addressable range.
-uint8_t olc6502::REL()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::REL()
 {
-	addr_rel = read(pc);
-	pc++;
+	addr_rel = ReadPC();
 	if (addr_rel & 0x80)
 		addr_rel |= 0xFF00;
 	return 0;
@@ -450,12 +687,11 @@ uint8_t olc6502::REL()
 
 // Address Mode: Absolute 
 // A full 16-bit address is loaded and used
-uint8_t olc6502::ABS()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ABS()
 {
-	uint16_t lo = read(pc);
-	pc++;
-	uint16_t hi = read(pc);
-	pc++;
+	uint16_t lo = ReadPC();
+	uint16_t hi = ReadPC();
 
 	addr_abs = (hi << 8) | lo;
 
@@ -467,12 +703,11 @@ uint8_t olc6502::ABS()
 // Fundamentally the same as absolute addressing, but the contents of the X Register
 // is added to the supplied two byte address. If the resulting address changes
 // the page, an additional clock cycle is required
-uint8_t olc6502::ABX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ABX()
 {
-	uint16_t lo = read(pc);
-	pc++;
-	uint16_t hi = read(pc);
-	pc++;
+	uint16_t lo = ReadPC();
+	uint16_t hi = ReadPC();
 
 	addr_abs = (hi << 8) | lo;
 	addr_abs += x;
@@ -488,12 +723,11 @@ uint8_t olc6502::ABX()
 // Fundamentally the same as absolute addressing, but the contents of the Y Register
 // is added to the supplied two byte address. If the resulting address changes
 // the page, an additional clock cycle is required
-uint8_t olc6502::ABY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ABY()
 {
-	uint16_t lo = read(pc);
-	pc++;
-	uint16_t hi = read(pc);
-	pc++;
+	uint16_t lo = ReadPC();
+	uint16_t hi = ReadPC();
 
 	addr_abs = (hi << 8) | lo;
 	addr_abs += y;
@@ -513,17 +747,16 @@ uint8_t olc6502::ABY()
 // supplied address is 0xFF, then to read the high byte of the actual address
 // we need to cross a page boundary. This doesnt actually work on the chip as 
 // designed, instead it wraps back around in the same page, yielding an 
-// invalid actual address
-uint8_t olc6502::IND()
+// invalid actual address. The 65C02 fixed it, at the cost of a cycle
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IND()
 {
-	uint16_t ptr_lo = read(pc);
-	pc++;
-	uint16_t ptr_hi = read(pc);
-	pc++;
+	uint16_t ptr_lo = ReadPC();
+	uint16_t ptr_hi = ReadPC();
 
 	uint16_t ptr = (ptr_hi << 8) | ptr_lo;
 
-	if (ptr_lo == 0x00FF) // Simulate page boundary hardware bug
+	if (VARIANT::bJmpIndBug && ptr_lo == 0x00FF) // Simulate page boundary hardware bug
 	{
 		addr_abs = (read(ptr & 0xFF00) << 8) | read(ptr + 0);
 	}
@@ -540,13 +773,13 @@ uint8_t olc6502::IND()
 // The supplied 8-bit address is offset by X Register to index
 // a location in page 0x00. The actual 16-bit address is read 
 // from this location
-uint8_t olc6502::IZX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IZX()
 {
-	uint16_t t = read(pc);
-	pc++;
+	uint16_t t = ReadPC();
 
-	uint16_t lo = read((uint16_t)(t + (uint16_t)x) & 0x00FF);
-	uint16_t hi = read((uint16_t)(t + (uint16_t)x + 1) & 0x00FF);
+	uint16_t lo = ReadZP((uint8_t)(t + x));
+	uint16_t hi = ReadZP((uint8_t)(t + x + 1));
 
 	addr_abs = (hi << 8) | lo;
 	
@@ -559,13 +792,13 @@ uint8_t olc6502::IZX()
 // here the actual 16-bit address is read, and the contents of
 // Y Register is added to it to offset it. If the offset causes a
 // change in page then an additional clock cycle is required.
-uint8_t olc6502::IZY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IZY()
 {
-	uint16_t t = read(pc);
-	pc++;
+	uint16_t t = ReadPC();
 
-	uint16_t lo = read(t & 0x00FF);
-	uint16_t hi = read((t + 1) & 0x00FF);
+	uint16_t lo = ReadZP((uint8_t)t);
+	uint16_t hi = ReadZP((uint8_t)(t + 1));
 
 	addr_abs = (hi << 8) | lo;
 	addr_abs += y;
@@ -577,6 +810,50 @@ uint8_t olc6502::IZY()
 }
 
 
+// Address Mode: Zero Page Indirect (65C02)
+// As Indirect Y, but without adding the Y Register
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IZP()
+{
+	uint16_t t = ReadPC();
+
+	uint16_t lo = ReadZP((uint8_t)t);
+	uint16_t hi = ReadZP((uint8_t)(t + 1));
+
+	addr_abs = (hi << 8) | lo;
+	return 0;
+}
+
+
+// Address Mode: Absolute Indexed Indirect (65C02)
+// Only used by JMP, for jump tables. The X Register is added to the
+// supplied 16-bit address, and the target is read from there
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IAX()
+{
+	uint16_t lo = ReadPC();
+	uint16_t hi = ReadPC();
+
+	uint16_t ptr = ((hi << 8) | lo) + x;
+	addr_abs = (read(ptr + 1) << 8) | read(ptr + 0);
+	return 0;
+}
+
+
+// Address Mode: Zero Page and Relative (65C02)
+// BBR and BBS test a bit of a zero page location, and branch on it. The
+// location goes in addr_abs, and the branch offset in addr_rel as REL does
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ZPR()
+{
+	addr_abs = ReadPC();
+	addr_rel = ReadPC();
+	if (addr_rel & 0x80)
+		addr_rel |= 0xFF00;
+	return 0;
+}
+
+
 
 // This function sources the data used by the instruction into 
 // a convenient numeric variable. Some instructions dont have to 
@@ -590,9 +867,19 @@ uint8_t olc6502::IZY()
 // 256, i.e. no far reaching memory fetch is required. "fetched"
 // is a variable global to the CPU, and is set by calling this 
 // function. It also returns it for convenience.
-uint8_t olc6502::fetch()
-{
-	if (!(lookup[opcode].addrmode == &olc6502::IMP))
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::fetch()
+{
+	if (lookup[opcode].addrmode == &olc6502_t::IMP)
+		return fetched;
+
+	// Immediate operands, and any others in the code page, come through
+	// the code page pointer
+	if (addr_abs < 0x0100)
+		fetched = ReadZP((uint8_t)addr_abs);
+	else if ((addr_abs >> 8) == code_page && code && !bus->bp.armed)
+		fetched = code[addr_abs & 0xFF];
+	else
 		fetched = read(addr_abs);
 	return fetched;
 }
@@ -601,6 +888,114 @@ uint8_t olc6502::fetch()
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// BCD TABLES
+
+// Decimal ADC and SBC on the NMOS 6502 each take a few steps of digit
+// adjustment, and the flags come out of different stages of it. Rather
+// than repeat that work on every instruction, every result is worked out
+// once, at startup, for each carry in, accumulator and operand. Each
+// entry holds the new accumulator in its low byte and the N, V, Z and C
+// flags, in their status register positions, in its high byte. That makes
+// decimal mode one lookup, and no slower than binary. The tables take
+// 512KB between them, but a program only touches the few entries its
+// digits use.
+//
+// ADC: Z comes from the binary sum. N and V come from the sum after the
+//      low digit has been adjusted but before the high digit has. C comes
+//      from the fully adjusted sum.
+// SBC: All flags come from the binary difference, as in binary mode. Only
+//      the accumulator is adjusted.
+//
+// Operands that aren't valid BCD give what the NMOS chip gives too.
+//
+// The 65C02 uses the same tables, then fixes N and Z to match the adjusted
+// accumulator, as it does itself with an extra cycle. Its results for
+// operands that aren't valid BCD are not modelled.
+struct BCDTABLES
+{
+	uint16_t adc[2][256][256];
+	uint16_t sbc[2][256][256];
+
+	BCDTABLES()
+	{
+		for (int c = 0; c < 2; c++)
+		{
+			for (int a = 0; a < 256; a++)
+			{
+				for (int m = 0; m < 256; m++)
+				{
+					adc[c][a][m] = Adc(a, m, c);
+					sbc[c][a][m] = Sbc(a, m, c);
+				}
+			}
+		}
+	}
+
+	static uint16_t Pack(int result, bool n, bool v, bool z, bool c)
+	{
+		uint8_t flags = (n ? olc6502::N : 0) | (v ? olc6502::V : 0) | (z ? olc6502::Z : 0) | (c ? olc6502::C : 0);
+		return (uint16_t)((flags << 8) | (result & 0xFF));
+	}
+
+	static uint16_t Adc(int a, int m, int c)
+	{
+		int lo = (a & 0x0F) + (m & 0x0F) + c;
+		if (lo > 0x09)
+			lo += 0x06;
+		int hi = (a >> 4) + (m >> 4) + (lo > 0x0F ? 1 : 0);
+
+		bool z = ((a + m + c) & 0xFF) == 0;
+		bool n = hi & 0x08;
+		bool v = ~(a ^ m) & (a ^ (hi << 4)) & 0x80;
+		if (hi > 0x09)
+			hi += 0x06;
+
+		return Pack((hi << 4) | (lo & 0x0F), n, v, z, hi > 0x0F);
+	}
+
+	static uint16_t Sbc(int a, int m, int c)
+	{
+		int borrow = 1 - c;
+		int diff = a - m - borrow;
+
+		int lo = (a & 0x0F) - (m & 0x0F) - borrow;
+		int hi = (a >> 4) - (m >> 4);
+		if (lo & 0x10)
+		{
+			lo -= 0x06;
+			hi--;
+		}
+		if (hi & 0x10)
+			hi -= 0x06;
+
+		return Pack(((hi & 0x0F) << 4) | (lo & 0x0F), diff & 0x80, (a ^ m) & (a ^ diff) & 0x80,
+			(diff & 0xFF) == 0, diff >= 0);
+	}
+};
+
+static const BCDTABLES bcd_tables;
+
+// Applies a table entry to the accumulator and flags
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::Decimal(uint16_t r)
+{
+	status = (status & ~(N | V | Z | C)) | (r >> 8);
+	a = r & 0x00FF;
+
+	if constexpr (VARIANT::bCmos)
+	{
+		SetFlag(Z, a == 0x00);
+		SetFlag(N, a & 0x80);
+		cycles++;
+	}
+	return 1;
+}
+
+
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // INSTRUCTION IMPLEMENTATIONS
 
@@ -671,10 +1066,23 @@ uint8_t olc6502::fetch()
 //       Positive Number + Positive Number = Positive Result -> OK! No Overflow
 //       Negative Number + Negative Number = Negative Result -> OK! NO Overflow
 
-uint8_t olc6502::ADC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ADC()
 {
 	// Grab the data that we are adding to the accumulator
 	fetch();
+	return AddWithCarry();
+}
+
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::AddWithCarry()
+{
+	// Decimal mode is looked up, see BCD TABLES above
+	if constexpr (VARIANT::bDecimal)
+	{
+		if (GetFlag(D))
+			return Decimal(bcd_tables.adc[GetFlag(C)][a][fetched]);
+	}
 	
 	// Add is performed in 16-bit domain for emulation to capture any
 	// carry bit, which will exist in bit 8 of the 16-bit word
@@ -726,9 +1134,21 @@ uint8_t olc6502::ADC()
 // of M, the data(!) therfore we can simply add, exactly the same way we did 
 // before.
 
-uint8_t olc6502::SBC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SBC()
 {
 	fetch();
+	return SubWithBorrow();
+}
+
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SubWithBorrow()
+{
+	if constexpr (VARIANT::bDecimal)
+	{
+		if (GetFlag(D))
+			return Decimal(bcd_tables.sbc[GetFlag(C)][a][fetched]);
+	}
 	
 	// Operating in 16-bit domain to capture carry out
 	
@@ -758,7 +1178,8 @@ uint8_t olc6502::SBC()
 // Instruction: Bitwise Logic AND
 // Function:    A = A & M
 // Flags Out:   N, Z
-uint8_t olc6502::AND()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::AND()
 {
 	fetch();
 	a = a & fetched;
@@ -771,24 +1192,28 @@ uint8_t olc6502::AND()
 // Instruction: Arithmetic Shift Left
 // Function:    A = C <- (A << 1) <- 0
 // Flags Out:   N, Z, C
-uint8_t olc6502::ASL()
+// The 65C02 only takes an extra cycle with abs,X when the page is crossed,
+// where the NMOS 6502 always takes it. LSR, ROL and ROR do the same
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ASL()
 {
 	fetch();
 	temp = (uint16_t)fetched << 1;
 	SetFlag(C, (temp & 0xFF00) > 0);
 	SetFlag(Z, (temp & 0x00FF) == 0x00);
 	SetFlag(N, temp & 0x80);
-	if (lookup[opcode].addrmode == &olc6502::IMP)
+	if (lookup[opcode].addrmode == &olc6502_t::IMP)
 		a = temp & 0x00FF;
 	else
 		write(addr_abs, temp & 0x00FF);
-	return 0;
+	return VARIANT::bCmos ? 1 : 0;
 }
 
 
 // Instruction: Branch if Carry Clear
 // Function:    if(C == 0) pc = address 
-uint8_t olc6502::BCC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BCC()
 {
 	if (GetFlag(C) == 0)
 	{
@@ -806,7 +1231,8 @@ uint8_t olc6502::BCC()
 
 // Instruction: Branch if Carry Set
 // Function:    if(C == 1) pc = address
-uint8_t olc6502::BCS()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BCS()
 {
 	if (GetFlag(C) == 1)
 	{
@@ -824,7 +1250,8 @@ uint8_t olc6502::BCS()
 
 // Instruction: Branch if Equal
 // Function:    if(Z == 1) pc = address
-uint8_t olc6502::BEQ()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BEQ()
 {
 	if (GetFlag(Z) == 1)
 	{
@@ -839,20 +1266,34 @@ uint8_t olc6502::BEQ()
 	return 0;
 }
 
-uint8_t olc6502::BIT()
+// Instruction: Bit Test
+// Function:    Z <- (A & M) == 0, N <- M7, V <- M6
+// Flags Out:   N, V, Z
+// The 65C02's BIT #imm only sets Z, and its BIT abs,X can take an extra
+// cycle for crossing a page
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BIT()
 {
 	fetch();
 	temp = a & fetched;
 	SetFlag(Z, (temp & 0x00FF) == 0x00);
+
+	if constexpr (VARIANT::bCmos)
+	{
+		if (lookup[opcode].addrmode == &olc6502_t::IMM)
+			return 0;
+	}
+
 	SetFlag(N, fetched & (1 << 7));
 	SetFlag(V, fetched & (1 << 6));
-	return 0;
+	return 1;
 }
 
 
 // Instruction: Branch if Negative
 // Function:    if(N == 1) pc = address
-uint8_t olc6502::BMI()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BMI()
 {
 	if (GetFlag(N) == 1)
 	{
@@ -870,7 +1311,8 @@ uint8_t olc6502::BMI()
 
 // Instruction: Branch if Not Equal
 // Function:    if(Z == 0) pc = address
-uint8_t olc6502::BNE()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BNE()
 {
 	if (GetFlag(Z) == 0)
 	{
@@ -888,7 +1330,8 @@ uint8_t olc6502::BNE()
 
 // Instruction: Branch if Positive
 // Function:    if(N == 0) pc = address
-uint8_t olc6502::BPL()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BPL()
 {
 	if (GetFlag(N) == 0)
 	{
@@ -905,29 +1348,37 @@ uint8_t olc6502::BPL()
 
 // Instruction: Break
 // Function:    Program Sourced Interrupt
-uint8_t olc6502::BRK()
+// The byte after BRK is skipped, so the address pushed is BRK + 2. The IMM
+// address mode has already stepped over it
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BRK()
 {
-	pc++;
+	uint8_t sp = stkp;
+	uint16_t ret = pc;
 	
-	SetFlag(I, 1);
-	write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-	stkp--;
-	write(0x0100 + stkp, pc & 0x00FF);
-	stkp--;
+	Push((pc >> 8) & 0x00FF);
+	Push(pc & 0x00FF);
 
 	SetFlag(B, 1);
-	write(0x0100 + stkp, status);
-	stkp--;
+	Push(status);
 	SetFlag(B, 0);
 
+	// Interrupts are disabled once the old status has been saved, and the
+	// 65C02 leaves decimal mode too
+	SetFlag(I, 1);
+	if constexpr (VARIANT::bCmos)
+		SetFlag(D, 0);
+
 	pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+	PushFrame(FRAME_BRK, pc, ret, sp);
 	return 0;
 }
 
 
 // Instruction: Branch if Overflow Clear
 // Function:    if(V == 0) pc = address
-uint8_t olc6502::BVC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BVC()
 {
 	if (GetFlag(V) == 0)
 	{
@@ -945,7 +1396,8 @@ uint8_t olc6502::BVC()
 
 // Instruction: Branch if Overflow Set
 // Function:    if(V == 1) pc = address
-uint8_t olc6502::BVS()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BVS()
 {
 	if (GetFlag(V) == 1)
 	{
@@ -963,7 +1415,8 @@ uint8_t olc6502::BVS()
 
 // Instruction: Clear Carry Flag
 // Function:    C = 0
-uint8_t olc6502::CLC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CLC()
 {
 	SetFlag(C, false);
 	return 0;
@@ -972,7 +1425,8 @@ uint8_t olc6502::CLC()
 
 // Instruction: Clear Decimal Flag
 // Function:    D = 0
-uint8_t olc6502::CLD()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CLD()
 {
 	SetFlag(D, false);
 	return 0;
@@ -981,7 +1435,8 @@ uint8_t olc6502::CLD()
 
 // Instruction: Disable Interrupts / Clear Interrupt Flag
 // Function:    I = 0
-uint8_t olc6502::CLI()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CLI()
 {
 	SetFlag(I, false);
 	return 0;
@@ -990,7 +1445,8 @@ uint8_t olc6502::CLI()
 
 // Instruction: Clear Overflow Flag
 // Function:    V = 0
-uint8_t olc6502::CLV()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CLV()
 {
 	SetFlag(V, false);
 	return 0;
@@ -999,7 +1455,8 @@ uint8_t olc6502::CLV()
 // Instruction: Compare Accumulator
 // Function:    C <- A >= M      Z <- (A - M) == 0
 // Flags Out:   N, C, Z
-uint8_t olc6502::CMP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CMP()
 {
 	fetch();
 	temp = (uint16_t)a - (uint16_t)fetched;
@@ -1013,7 +1470,8 @@ uint8_t olc6502::CMP()
 // Instruction: Compare X Register
 // Function:    C <- X >= M      Z <- (X - M) == 0
 // Flags Out:   N, C, Z
-uint8_t olc6502::CPX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CPX()
 {
 	fetch();
 	temp = (uint16_t)x - (uint16_t)fetched;
@@ -1027,7 +1485,8 @@ uint8_t olc6502::CPX()
 // Instruction: Compare Y Register
 // Function:    C <- Y >= M      Z <- (Y - M) == 0
 // Flags Out:   N, C, Z
-uint8_t olc6502::CPY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::CPY()
 {
 	fetch();
 	temp = (uint16_t)y - (uint16_t)fetched;
@@ -1041,7 +1500,8 @@ uint8_t olc6502::CPY()
 // Instruction: Decrement Value at Memory Location
 // Function:    M = M - 1
 // Flags Out:   N, Z
-uint8_t olc6502::DEC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::DEC()
 {
 	fetch();
 	temp = fetched - 1;
@@ -1055,7 +1515,8 @@ uint8_t olc6502::DEC()
 // Instruction: Decrement X Register
 // Function:    X = X - 1
 // Flags Out:   N, Z
-uint8_t olc6502::DEX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::DEX()
 {
 	x--;
 	SetFlag(Z, x == 0x00);
@@ -1067,7 +1528,8 @@ uint8_t olc6502::DEX()
 // Instruction: Decrement Y Register
 // Function:    Y = Y - 1
 // Flags Out:   N, Z
-uint8_t olc6502::DEY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::DEY()
 {
 	y--;
 	SetFlag(Z, y == 0x00);
@@ -1079,7 +1541,8 @@ uint8_t olc6502::DEY()
 // Instruction: Bitwise Logic XOR
 // Function:    A = A xor M
 // Flags Out:   N, Z
-uint8_t olc6502::EOR()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::EOR()
 {
 	fetch();
 	a = a ^ fetched;	
@@ -1092,7 +1555,8 @@ uint8_t olc6502::EOR()
 // Instruction: Increment Value at Memory Location
 // Function:    M = M + 1
 // Flags Out:   N, Z
-uint8_t olc6502::INC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::INC()
 {
 	fetch();
 	temp = fetched + 1;
@@ -1106,7 +1570,8 @@ uint8_t olc6502::INC()
 // Instruction: Increment X Register
 // Function:    X = X + 1
 // Flags Out:   N, Z
-uint8_t olc6502::INX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::INX()
 {
 	x++;
 	SetFlag(Z, x == 0x00);
@@ -1118,7 +1583,8 @@ uint8_t olc6502::INX()
 // Instruction: Increment Y Register
 // Function:    Y = Y + 1
 // Flags Out:   N, Z
-uint8_t olc6502::INY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::INY()
 {
 	y++;
 	SetFlag(Z, y == 0x00);
@@ -1129,7 +1595,8 @@ uint8_t olc6502::INY()
 
 // Instruction: Jump To Location
 // Function:    pc = address
-uint8_t olc6502::JMP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::JMP()
 {
 	pc = addr_abs;
 	return 0;
@@ -1138,14 +1605,22 @@ uint8_t olc6502::JMP()
 
 // Instruction: Jump To Sub-Routine
 // Function:    Push current pc to stack, pc = address
-uint8_t olc6502::JSR()
+// The high byte of the address is read from the instruction after the
+// return address has been pushed, which only matters when the push lands
+// on it, i.e. when JSR runs from the stack page
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::JSR()
 {
+	uint8_t sp = stkp;
+	uint16_t ret = pc;
+
 	pc--;
 
-	write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-	stkp--;
-	write(0x0100 + stkp, pc & 0x00FF);
-	stkp--;
+	Push((pc >> 8) & 0x00FF);
+	Push(pc & 0x00FF);
+
+	addr_abs = (addr_abs & 0x00FF) | ((uint16_t)read(pc) << 8);
+	PushFrame(FRAME_JSR, addr_abs, ret, sp);
 
 	pc = addr_abs;
 	return 0;
@@ -1155,7 +1630,8 @@ uint8_t olc6502::JSR()
 // Instruction: Load The Accumulator
 // Function:    A = M
 // Flags Out:   N, Z
-uint8_t olc6502::LDA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LDA()
 {
 	fetch();
 	a = fetched;
@@ -1168,7 +1644,8 @@ uint8_t olc6502::LDA()
 // Instruction: Load The X Register
 // Function:    X = M
 // Flags Out:   N, Z
-uint8_t olc6502::LDX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LDX()
 {
 	fetch();
 	x = fetched;
@@ -1181,7 +1658,8 @@ uint8_t olc6502::LDX()
 // Instruction: Load The Y Register
 // Function:    Y = M
 // Flags Out:   N, Z
-uint8_t olc6502::LDY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LDY()
 {
 	fetch();
 	y = fetched;
@@ -1190,36 +1668,26 @@ uint8_t olc6502::LDY()
 	return 1;
 }
 
-uint8_t olc6502::LSR()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LSR()
 {
 	fetch();
 	SetFlag(C, fetched & 0x0001);
 	temp = fetched >> 1;	
 	SetFlag(Z, (temp & 0x00FF) == 0x0000);
 	SetFlag(N, temp & 0x0080);
-	if (lookup[opcode].addrmode == &olc6502::IMP)
+	if (lookup[opcode].addrmode == &olc6502_t::IMP)
 		a = temp & 0x00FF;
 	else
 		write(addr_abs, temp & 0x00FF);
-	return 0;
+	return VARIANT::bCmos ? 1 : 0;
 }
 
-uint8_t olc6502::NOP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::NOP()
 {
-	// Sadly not all NOPs are equal, Ive added a few here
-	// based on https://wiki.nesdev.com/w/index.php/CPU_unofficial_opcodes
-	// and will add more based on game compatibility, and ultimately
-	// I'd like to cover all illegal opcodes too
-	switch (opcode) {
-	case 0x1C:
-	case 0x3C:
-	case 0x5C:
-	case 0x7C:
-	case 0xDC:
-	case 0xFC:
-		return 1;
-		break;
-	}
+	// Sadly not all NOPs are equal. The unofficial ones that read
+	// memory are IGN, below
 	return 0;
 }
 
@@ -1227,7 +1695,8 @@ uint8_t olc6502::NOP()
 // Instruction: Bitwise Logic OR
 // Function:    A = A | M
 // Flags Out:   N, Z
-uint8_t olc6502::ORA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ORA()
 {
 	fetch();
 	a = a | fetched;
@@ -1239,10 +1708,10 @@ uint8_t olc6502::ORA()
 
 // Instruction: Push Accumulator to Stack
 // Function:    A -> stack
-uint8_t olc6502::PHA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PHA()
 {
-	write(0x0100 + stkp, a);
-	stkp--;
+	Push(a);
 	return 0;
 }
 
@@ -1250,12 +1719,12 @@ uint8_t olc6502::PHA()
 // Instruction: Push Status Register to Stack
 // Function:    status -> stack
 // Note:        Break flag is set to 1 before push
-uint8_t olc6502::PHP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PHP()
 {
-	write(0x0100 + stkp, status | B | U);
+	Push(status | B | U);
 	SetFlag(B, 0);
 	SetFlag(U, 0);
-	stkp--;
 	return 0;
 }
 
@@ -1263,10 +1732,10 @@ uint8_t olc6502::PHP()
 // Instruction: Pop Accumulator off Stack
 // Function:    A <- stack
 // Flags Out:   N, Z
-uint8_t olc6502::PLA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PLA()
 {
-	stkp++;
-	a = read(0x0100 + stkp);
+	a = Pull();
 	SetFlag(Z, a == 0x00);
 	SetFlag(N, a & 0x80);
 	return 0;
@@ -1275,64 +1744,67 @@ uint8_t olc6502::PLA()
 
 // Instruction: Pop Status Register off Stack
 // Function:    Status <- stack
-uint8_t olc6502::PLP()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PLP()
 {
-	stkp++;
-	status = read(0x0100 + stkp);
+	status = Pull();
 	SetFlag(U, 1);
 	return 0;
 }
 
-uint8_t olc6502::ROL()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ROL()
 {
 	fetch();
 	temp = (uint16_t)(fetched << 1) | GetFlag(C);
 	SetFlag(C, temp & 0xFF00);
 	SetFlag(Z, (temp & 0x00FF) == 0x0000);
 	SetFlag(N, temp & 0x0080);
-	if (lookup[opcode].addrmode == &olc6502::IMP)
+	if (lookup[opcode].addrmode == &olc6502_t::IMP)
 		a = temp & 0x00FF;
 	else
 		write(addr_abs, temp & 0x00FF);
-	return 0;
+	return VARIANT::bCmos ? 1 : 0;
 }
 
-uint8_t olc6502::ROR()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ROR()
 {
 	fetch();
 	temp = (uint16_t)(GetFlag(C) << 7) | (fetched >> 1);
 	SetFlag(C, fetched & 0x01);
 	SetFlag(Z, (temp & 0x00FF) == 0x00);
 	SetFlag(N, temp & 0x0080);
-	if (lookup[opcode].addrmode == &olc6502::IMP)
+	if (lookup[opcode].addrmode == &olc6502_t::IMP)
 		a = temp & 0x00FF;
 	else
 		write(addr_abs, temp & 0x00FF);
-	return 0;
+	return VARIANT::bCmos ? 1 : 0;
 }
 
-uint8_t olc6502::RTI()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::RTI()
 {
-	stkp++;
-	status = read(0x0100 + stkp);
+	status = Pull();
 	status &= ~B;
 	status &= ~U;
 
-	stkp++;
-	pc = (uint16_t)read(0x0100 + stkp);
-	stkp++;
-	pc |= (uint16_t)read(0x0100 + stkp) << 8;
+	pc = (uint16_t)Pull();
+	pc |= (uint16_t)Pull() << 8;
+
+	PopFrames(stkp);
 	return 0;
 }
 
-uint8_t olc6502::RTS()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::RTS()
 {
-	stkp++;
-	pc = (uint16_t)read(0x0100 + stkp);
-	stkp++;
-	pc |= (uint16_t)read(0x0100 + stkp) << 8;
+	pc = (uint16_t)Pull();
+	pc |= (uint16_t)Pull() << 8;
 	
 	pc++;
+
+	PopFrames(stkp);
 	return 0;
 }
 
@@ -1341,7 +1813,8 @@ uint8_t olc6502::RTS()
 
 // Instruction: Set Carry Flag
 // Function:    C = 1
-uint8_t olc6502::SEC()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SEC()
 {
 	SetFlag(C, true);
 	return 0;
@@ -1350,7 +1823,8 @@ uint8_t olc6502::SEC()
 
 // Instruction: Set Decimal Flag
 // Function:    D = 1
-uint8_t olc6502::SED()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SED()
 {
 	SetFlag(D, true);
 	return 0;
@@ -1359,7 +1833,8 @@ uint8_t olc6502::SED()
 
 // Instruction: Set Interrupt Flag / Enable Interrupts
 // Function:    I = 1
-uint8_t olc6502::SEI()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SEI()
 {
 	SetFlag(I, true);
 	return 0;
@@ -1368,7 +1843,8 @@ uint8_t olc6502::SEI()
 
 // Instruction: Store Accumulator at Address
 // Function:    M = A
-uint8_t olc6502::STA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::STA()
 {
 	write(addr_abs, a);
 	return 0;
@@ -1377,7 +1853,8 @@ uint8_t olc6502::STA()
 
 // Instruction: Store X Register at Address
 // Function:    M = X
-uint8_t olc6502::STX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::STX()
 {
 	write(addr_abs, x);
 	return 0;
@@ -1386,7 +1863,8 @@ uint8_t olc6502::STX()
 
 // Instruction: Store Y Register at Address
 // Function:    M = Y
-uint8_t olc6502::STY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::STY()
 {
 	write(addr_abs, y);
 	return 0;
@@ -1396,7 +1874,8 @@ uint8_t olc6502::STY()
 // Instruction: Transfer Accumulator to X Register
 // Function:    X = A
 // Flags Out:   N, Z
-uint8_t olc6502::TAX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TAX()
 {
 	x = a;
 	SetFlag(Z, x == 0x00);
@@ -1408,7 +1887,8 @@ uint8_t olc6502::TAX()
 // Instruction: Transfer Accumulator to Y Register
 // Function:    Y = A
 // Flags Out:   N, Z
-uint8_t olc6502::TAY()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TAY()
 {
 	y = a;
 	SetFlag(Z, y == 0x00);
@@ -1420,7 +1900,8 @@ uint8_t olc6502::TAY()
 // Instruction: Transfer Stack Pointer to X Register
 // Function:    X = stack pointer
 // Flags Out:   N, Z
-uint8_t olc6502::TSX()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TSX()
 {
 	x = stkp;
 	SetFlag(Z, x == 0x00);
@@ -1432,7 +1913,8 @@ uint8_t olc6502::TSX()
 // Instruction: Transfer X Register to Accumulator
 // Function:    A = X
 // Flags Out:   N, Z
-uint8_t olc6502::TXA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TXA()
 {
 	a = x;
 	SetFlag(Z, a == 0x00);
@@ -1443,7 +1925,8 @@ uint8_t olc6502::TXA()
 
 // Instruction: Transfer X Register to Stack Pointer
 // Function:    stack pointer = X
-uint8_t olc6502::TXS()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TXS()
 {
 	stkp = x;
 	return 0;
@@ -1453,7 +1936,8 @@ uint8_t olc6502::TXS()
 // Instruction: Transfer Y Register to Accumulator
 // Function:    A = Y
 // Flags Out:   N, Z
-uint8_t olc6502::TYA()
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TYA()
 {
 	a = y;
 	SetFlag(Z, a == 0x00);
@@ -1462,138 +1946,835 @@ uint8_t olc6502::TYA()
 }
 
 
-// This function captures illegal opcodes
-uint8_t olc6502::XXX()
+///////////////////////////////////////////////////////////////////////////////
+// UNOFFICIAL INSTRUCTIONS
+// These are only in the NMOS translation tables. They are what the
+// decoding logic does with the opcodes it wasn't designed for, mostly two
+// instructions enabled at once, and are described after
+// https://www.nesdev.org/wiki/CPU_unofficial_opcodes and "No More Secrets".
+// The read-modify-write ones never take an extra cycle for crossing a
+// page, as their base cycle counts already include it.
+//
+// ANE and LXA depend on analog effects on the real chip. They are modelled
+// with the "magic" constant $EE, as most test suites expect.
+
+// Instruction: AND then Logical Shift Right
+// Function:    A = (A & M) >> 1
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ALR()
 {
+	fetch();
+	a &= fetched;
+	SetFlag(C, a & 0x01);
+	a >>= 1;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
 	return 0;
 }
 
 
+// Instruction: AND with Carry
+// Function:    A = A & M, C = N
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ANC()
+{
+	fetch();
+	a &= fetched;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	SetFlag(C, a & 0x80);
+	return 0;
+}
 
 
-
-///////////////////////////////////////////////////////////////////////////////
-// HELPER FUNCTIONS
-
-bool olc6502::complete()
+// Instruction: AND X with Accumulator (XAA)
+// Function:    A = (A | $EE) & X & M
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ANE()
 {
-	return cycles == 0;
+	fetch();
+	a = (a | 0xEE) & x & fetched;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
 }
 
-// This is the disassembly function. Its workings are not required for emulation.
-// It is merely a convenience function to turn the binary instruction code into
-// human readable form. Its included as part of the emulator because it can take
-// advantage of many of the CPUs internal operations to do this.
-std::map<uint16_t, std::string> olc6502::disassemble(uint16_t nStart, uint16_t nStop)
+
+// Instruction: AND then Rotate Right
+// Function:    A = (A & M) >> 1, with C in at the top
+// Flags Out:   N, Z, C, V
+// C and V come from the adder, which sees bits 6 and 5 of the result. In
+// decimal mode the adder also applies its BCD correction to each digit of
+// the AND, as ADC would
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ARR()
 {
-	uint32_t addr = nStart;
-	uint8_t value = 0x00, lo = 0x00, hi = 0x00;
-	std::map<uint16_t, std::string> mapLines;
-	uint16_t line_addr = 0;
+	fetch();
+	uint8_t t = a & fetched;
+	a = (t >> 1) | (GetFlag(C) << 7);
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
 
-	// A convenient utility to convert variables into
-	// hex strings because "modern C++"'s method with 
-	// streams is atrocious
-	auto hex = [](uint32_t n, uint8_t d)
+	if constexpr (VARIANT::bDecimal)
 	{
-		std::string s(d, '0');
-		for (int i = d - 1; i >= 0; i--, n >>= 4)
-			s[i] = "0123456789ABCDEF"[n & 0xF];
-		return s;
-	};
+		if (GetFlag(D))
+		{
+			SetFlag(V, (t ^ a) & 0x40);
+			if ((t & 0x0F) + (t & 0x01) > 0x05)
+				a = (a & 0xF0) | ((a + 0x06) & 0x0F);
+			SetFlag(C, (t >> 4) + ((t >> 4) & 0x01) > 0x05);
+			if (GetFlag(C))
+				a += 0x60;
+			return 0;
+		}
+	}
 
-	// Starting at the specified address we read an instruction
-	// byte, which in turn yields information from the lookup table
-	// as to how many additional bytes we need to read and what the
-	// addressing mode is. I need this info to assemble human readable
-	// syntax, which is different depending upon the addressing mode
+	SetFlag(C, a & 0x40);
+	SetFlag(V, ((a >> 6) ^ (a >> 5)) & 0x01);
+	return 0;
+}
 
-	// As the instruction is decoded, a std::string is assembled
-	// with the readable output
-	while (addr <= (uint32_t)nStop)
-	{
-		line_addr = addr;
 
-		// Prefix line with instruction address
-		std::string sInst = "$" + hex(addr, 4) + ": ";
+// Instruction: Decrement then Compare
+// Function:    M = M - 1, then CMP M
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::DCP()
+{
+	fetch();
+	fetched--;
+	write(addr_abs, fetched);
+	temp = (uint16_t)a - (uint16_t)fetched;
+	SetFlag(C, a >= fetched);
+	SetFlag(Z, (temp & 0x00FF) == 0x0000);
+	SetFlag(N, temp & 0x0080);
+	return 0;
+}
 
-		// Read instruction, and get its readable name
-		uint8_t opcode = bus->read(addr, true); addr++;
-		sInst += lookup[opcode].name + " ";
 
-		// Get oprands from desired locations, and form the
-		// instruction based upon its addressing mode. These
+// Instruction: Ignore (a NOP with an operand)
+// The operand is read, which matters if it is a device, and abs,X
+// takes an extra cycle for crossing a page
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::IGN()
+{
+	fetch();
+	return 1;
+}
+
+
+// Instruction: Increment then Subtract
+// Function:    M = M + 1, then SBC M
+// Flags Out:   N, Z, C, V
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::ISC()
+{
+	fetch();
+	fetched++;
+	write(addr_abs, fetched);
+	SubWithBorrow();
+	return 0;
+}
+
+
+// Instruction: Jam
+// The CPU locks up, with the clock still running, until reset
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::KIL()
+{
+	halt = HALT_STP;
+	return 0;
+}
+
+
+// Instruction: Load A, X and Stack Pointer
+// Function:    A = X = SP = M & SP
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LAS()
+{
+	fetch();
+	a = x = stkp = fetched & stkp;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 1;
+}
+
+
+// Instruction: Load A and X
+// Function:    A = X = M
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LAX()
+{
+	fetch();
+	a = x = fetched;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 1;
+}
+
+
+// Instruction: Load A and X, Immediate
+// Function:    A = X = (A | $EE) & M
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::LXA()
+{
+	fetch();
+	a = x = (a | 0xEE) & fetched;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Rotate Left then AND
+// Function:    M = C <- (M << 1) <- C, then A = A & M
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::RLA()
+{
+	fetch();
+	temp = (uint16_t)(fetched << 1) | GetFlag(C);
+	SetFlag(C, temp & 0xFF00);
+	write(addr_abs, temp & 0x00FF);
+	a &= temp & 0x00FF;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Rotate Right then Add
+// Function:    M = C -> (M >> 1) -> C, then ADC M
+// Flags Out:   N, Z, C, V
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::RRA()
+{
+	fetch();
+	temp = (uint16_t)(GetFlag(C) << 7) | (fetched >> 1);
+	SetFlag(C, fetched & 0x01);
+	fetched = temp & 0x00FF;
+	write(addr_abs, fetched);
+	AddWithCarry();
+	return 0;
+}
+
+
+// Instruction: Store A AND X
+// Function:    M = A & X
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SAX()
+{
+	write(addr_abs, a & x);
+	return 0;
+}
+
+
+// Instruction: Subtract from A AND X
+// Function:    X = (A & X) - M, without borrow
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SBX()
+{
+	fetch();
+	uint8_t t = a & x;
+	SetFlag(C, t >= fetched);
+	x = t - fetched;
+	SetFlag(Z, x == 0x00);
+	SetFlag(N, x & 0x80);
+	return 0;
+}
+
+
+// Instruction: Store A AND X AND High Byte
+// Function:    M = A & X & (H + 1)
+// SHA, SHX, SHY and TAS store a value ANDed with one more than the high
+// byte of the address before it was indexed. If indexing crossed a page,
+// that value also replaces the high byte of the address written to
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SHA()
+{
+	StoreHigh(a & x, y);
+	return 0;
+}
+
+
+// Instruction: Store X AND High Byte
+// Function:    M = X & (H + 1)
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SHX()
+{
+	StoreHigh(x, y);
+	return 0;
+}
+
+
+// Instruction: Store Y AND High Byte
+// Function:    M = Y & (H + 1)
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SHY()
+{
+	StoreHigh(y, x);
+	return 0;
+}
+
+
+// Instruction: Shift Left then OR
+// Function:    M = C <- (M << 1) <- 0, then A = A | M
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SLO()
+{
+	fetch();
+	temp = (uint16_t)fetched << 1;
+	SetFlag(C, temp & 0xFF00);
+	write(addr_abs, temp & 0x00FF);
+	a |= temp & 0x00FF;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Shift Right then Exclusive OR
+// Function:    M = 0 -> (M >> 1) -> C, then A = A ^ M
+// Flags Out:   N, Z, C
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SRE()
+{
+	fetch();
+	SetFlag(C, fetched & 0x01);
+	temp = fetched >> 1;
+	write(addr_abs, temp & 0x00FF);
+	a ^= temp & 0x00FF;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Transfer A AND X to Stack Pointer, and Store
+// Function:    SP = A & X, M = SP & (H + 1)
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TAS()
+{
+	stkp = a & x;
+	StoreHigh(stkp, y);
+	return 0;
+}
+
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::StoreHigh(uint8_t value, uint8_t index)
+{
+	uint16_t base = addr_abs - index;
+	value &= (base >> 8) + 1;
+	if ((base & 0xFF00) != (addr_abs & 0xFF00))
+		addr_abs = (addr_abs & 0x00FF) | (value << 8);
+	write(addr_abs, value);
+}
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 65C02 INSTRUCTIONS
+// These are only in the 65C02's translation table
+
+// Instruction: Branch on Bit Reset
+// Function:    if(M bit n == 0) pc = address
+// The bit number comes from the top three bits of the opcode
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BBR()
+{
+	fetch();
+	if ((fetched & (1 << ((opcode >> 4) & 0x07))) == 0)
+	{
+		cycles++;
+		addr_abs = pc + addr_rel;
+
+		if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+			cycles++;
+
+		pc = addr_abs;
+	}
+	return 0;
+}
+
+
+// Instruction: Branch on Bit Set
+// Function:    if(M bit n == 1) pc = address
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BBS()
+{
+	fetch();
+	if (fetched & (1 << ((opcode >> 4) & 0x07)))
+	{
+		cycles++;
+		addr_abs = pc + addr_rel;
+
+		if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+			cycles++;
+
+		pc = addr_abs;
+	}
+	return 0;
+}
+
+
+// Instruction: Branch Always
+// Function:    pc = address
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::BRA()
+{
+	cycles++;
+	addr_abs = pc + addr_rel;
+
+	if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+		cycles++;
+
+	pc = addr_abs;
+	return 0;
+}
+
+
+// Instruction: Decrement Accumulator
+// Function:    A = A - 1
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::DEA()
+{
+	a--;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Increment Accumulator
+// Function:    A = A + 1
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::INA()
+{
+	a++;
+	SetFlag(Z, a == 0x00);
+	SetFlag(N, a & 0x80);
+	return 0;
+}
+
+
+// Instruction: Push X Register to Stack
+// Function:    X -> stack
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PHX()
+{
+	Push(x);
+	return 0;
+}
+
+
+// Instruction: Push Y Register to Stack
+// Function:    Y -> stack
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PHY()
+{
+	Push(y);
+	return 0;
+}
+
+
+// Instruction: Pop X Register off Stack
+// Function:    X <- stack
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PLX()
+{
+	x = Pull();
+	SetFlag(Z, x == 0x00);
+	SetFlag(N, x & 0x80);
+	return 0;
+}
+
+
+// Instruction: Pop Y Register off Stack
+// Function:    Y <- stack
+// Flags Out:   N, Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::PLY()
+{
+	y = Pull();
+	SetFlag(Z, y == 0x00);
+	SetFlag(N, y & 0x80);
+	return 0;
+}
+
+
+// Instruction: Reset Memory Bit
+// Function:    M bit n = 0
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::RMB()
+{
+	fetch();
+	write(addr_abs, fetched & ~(1 << ((opcode >> 4) & 0x07)));
+	return 0;
+}
+
+
+// Instruction: Set Memory Bit
+// Function:    M bit n = 1
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::SMB()
+{
+	fetch();
+	write(addr_abs, fetched | (1 << ((opcode >> 4) & 0x07)));
+	return 0;
+}
+
+
+// Instruction: Stop the Clock
+// Function:    Nothing more is executed until reset
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::STP()
+{
+	halt = HALT_STP;
+	return 0;
+}
+
+
+// Instruction: Store Zero at Address
+// Function:    M = 0
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::STZ()
+{
+	write(addr_abs, 0x00);
+	return 0;
+}
+
+
+// Instruction: Test and Reset Bits
+// Function:    M = M & ~A       Z <- (A & M) == 0
+// Flags Out:   Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TRB()
+{
+	fetch();
+	SetFlag(Z, (a & fetched) == 0x00);
+	write(addr_abs, fetched & ~a);
+	return 0;
+}
+
+
+// Instruction: Test and Set Bits
+// Function:    M = M | A        Z <- (A & M) == 0
+// Flags Out:   Z
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::TSB()
+{
+	fetch();
+	SetFlag(Z, (a & fetched) == 0x00);
+	write(addr_abs, fetched | a);
+	return 0;
+}
+
+
+// Instruction: Wait for Interrupt
+// Function:    Nothing more is executed until an IRQ or NMI
+template <typename VARIANT>
+uint8_t olc6502_t<VARIANT>::WAI()
+{
+	halt = HALT_WAI;
+	return 0;
+}
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// HELPER FUNCTIONS
+
+template <typename VARIANT>
+bool olc6502_t<VARIANT>::complete()
+{
+	return cycles == 0;
+}
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::step()
+{
+	bus->bp.Resume(pc);
+	do
+	{
+		clock();
+	} 
+	while (!complete());
+}
+
+template <typename VARIANT>
+bool olc6502_t<VARIANT>::run(uint64_t nCycles)
+{
+	Breakpoints &bp = bus->bp;
+	uint64_t nEnd = clock_count + nCycles;
+
+	bp.Resume(pc);
+	while (clock_count < nEnd)
+	{
+		// Always finish the instruction, so a watchpoint hit part way
+		// through still leaves the CPU at a clean instruction boundary
+		do
+		{
+			clock();
+		} 
+		while (!complete());
+
+		if (bp.hit != Breakpoints::NONE)
+			return true;
+	}
+	return false;
+}
+
+// Records a new call frame. "sp" is the stack pointer before anything was
+// pushed for this call. Any existing frame at or below that level must have
+// been abandoned, since its part of the stack is about to be overwritten,
+// so those are retired first. This is what keeps the frames strictly
+// ordered, and the array from overflowing.
+template <typename VARIANT>
+void olc6502_t<VARIANT>::PushFrame(uint8_t type, uint16_t target, uint16_t ret, uint8_t sp)
+{
+	PopFrames(sp);
+
+	FRAME &f = call_stack[call_depth++];
+	f.target = target;
+	f.ret    = ret;
+	f.stkp   = sp;
+	f.type   = type;
+	f.entry  = clock_count;
+
+	if (!call_profile.empty())
+		call_profile[target].calls++;
+}
+
+// Retires every frame whose stack level has been returned past. After a
+// normal RTS or RTI the stack pointer is back where it was before the call,
+// which retires exactly one frame. A return through an address pushed by
+// the program itself leaves the stack pointer lower, so nothing is retired,
+// and the dispatch is treated as a jump within the current routine.
+template <typename VARIANT>
+void olc6502_t<VARIANT>::PopFrames(uint8_t sp)
+{
+	while (call_depth > 0 && call_stack[call_depth - 1].stkp <= sp)
+	{
+		call_depth--;
+
+		// Credit the routine up to the end of the current instruction. For
+		// recursive routines, the inner calls are counted again by the outer
+		if (!call_profile.empty())
+		{
+			const FRAME &f = call_stack[call_depth];
+			call_profile[f.target].cycles += clock_count + cycles - f.entry;
+		}
+	}
+}
+
+// Fibonacci hashing spreads the 16-bit address over the map
+template <typename VARIANT>
+void olc6502_t<VARIANT>::CoverEdge()
+{
+	uint16_t cur = (uint16_t)(((uint32_t)pc * 0x9E3779B1u) >> (32 - COVERAGE_BITS));
+	coverage[cur ^ coverage_prev]++;
+	coverage_prev = cur >> 1;
+}
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::SaveState(STATE &s)
+{
+	s.a = a; s.x = x; s.y = y;
+	s.stkp = stkp; s.status = status; s.pc = pc;
+	s.cycles = cycles;
+	s.halt = halt;
+	s.clock_count = clock_count;
+	s.instr_count = instr_count;
+	s.frames.assign(call_stack, call_stack + call_depth);
+}
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::LoadState(const STATE &s)
+{
+	a = s.a; x = s.x; y = s.y;
+	stkp = s.stkp; status = s.status; pc = s.pc;
+	cycles = s.cycles;
+	halt = s.halt;
+	clock_count = s.clock_count;
+	instr_count = s.instr_count;
+	call_depth = (uint16_t)s.frames.size();
+	std::copy(s.frames.begin(), s.frames.end(), call_stack);
+}
+
+template <typename VARIANT>
+std::vector<typename olc6502_t<VARIANT>::FRAME> olc6502_t<VARIANT>::backtrace()
+{
+	return std::vector<FRAME>(call_stack, call_stack + call_depth);
+}
+
+template <typename VARIANT>
+void olc6502_t<VARIANT>::EnableProfile(bool bEnable)
+{
+	if (bEnable)
+		call_profile.assign(64 * 1024, PROFILE());
+	else
+		call_profile.clear();
+}
+
+// This is the disassembly function. Its workings are not required for emulation.
+// It is merely a convenience function to turn the binary instruction code into
+// human readable form. Its included as part of the emulator because it can take
+// advantage of many of the CPUs internal operations to do this.
+template <typename VARIANT>
+std::map<uint16_t, std::string> olc6502_t<VARIANT>::disassemble(uint16_t nStart, uint16_t nStop)
+{
+	uint32_t addr = nStart;
+	uint8_t value = 0x00, lo = 0x00, hi = 0x00;
+	std::map<uint16_t, std::string> mapLines;
+	uint16_t line_addr = 0;
+
+	// A convenient utility to convert variables into
+	// hex strings because "modern C++"'s method with 
+	// streams is atrocious
+	auto hex = [](uint32_t n, uint8_t d)
+	{
+		std::string s(d, '0');
+		for (int i = d - 1; i >= 0; i--, n >>= 4)
+			s[i] = "0123456789ABCDEF"[n & 0xF];
+		return s;
+	};
+
+	// Addresses are shown by name when the symbol table has one
+	auto label = [&](uint16_t n, uint8_t d)
+	{
+		const char *sName = symbols ? symbols->Name(n) : nullptr;
+		return sName ? std::string(sName) : "$" + hex(n, d);
+	};
+
+	// Starting at the specified address we read an instruction
+	// byte, which in turn yields information from the lookup table
+	// as to how many additional bytes we need to read and what the
+	// addressing mode is. I need this info to assemble human readable
+	// syntax, which is different depending upon the addressing mode
+
+	// As the instruction is decoded, a std::string is assembled
+	// with the readable output
+	while (addr <= (uint32_t)nStop)
+	{
+		line_addr = addr;
+
+		// Prefix line with instruction address
+		std::string sInst = "$" + hex(addr, 4) + ": ";
+		if (const char *sName = symbols ? symbols->Name(line_addr) : nullptr)
+			sInst += std::string(sName) + ": ";
+
+		// Read instruction, and get its readable name
+		uint8_t opcode = bus->peek(addr); addr++;
+		sInst += lookup[opcode].name + " ";
+
+		// Get oprands from desired locations, and form the
+		// instruction based upon its addressing mode. These
 		// routines mimmick the actual fetch routine of the
 		// 6502 in order to get accurate data as part of the
 		// instruction
-		if (lookup[opcode].addrmode == &olc6502::IMP)
+		if (lookup[opcode].addrmode == &olc6502_t::IMP)
 		{
 			sInst += " {IMP}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::IMM)
+		else if (lookup[opcode].addrmode == &olc6502_t::IMM)
 		{
-			value = bus->read(addr, true); addr++;
+			value = bus->peek(addr); addr++;
 			sInst += "#$" + hex(value, 2) + " {IMM}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ZP0)
+		else if (lookup[opcode].addrmode == &olc6502_t::ZP0)
 		{
-			lo = bus->read(addr, true); addr++;
+			lo = bus->peek(addr); addr++;
 			hi = 0x00;												
-			sInst += "$" + hex(lo, 2) + " {ZP0}";
+			sInst += label(lo, 2) + " {ZP0}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ZPX)
+		else if (lookup[opcode].addrmode == &olc6502_t::ZPX)
 		{
-			lo = bus->read(addr, true); addr++;
+			lo = bus->peek(addr); addr++;
 			hi = 0x00;														
-			sInst += "$" + hex(lo, 2) + ", X {ZPX}";
+			sInst += label(lo, 2) + ", X {ZPX}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ZPY)
+		else if (lookup[opcode].addrmode == &olc6502_t::ZPY)
 		{
-			lo = bus->read(addr, true); addr++;
+			lo = bus->peek(addr); addr++;
 			hi = 0x00;														
-			sInst += "$" + hex(lo, 2) + ", Y {ZPY}";
+			sInst += label(lo, 2) + ", Y {ZPY}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::IZX)
+		else if (lookup[opcode].addrmode == &olc6502_t::IZX)
 		{
-			lo = bus->read(addr, true); addr++;
+			lo = bus->peek(addr); addr++;
 			hi = 0x00;								
-			sInst += "($" + hex(lo, 2) + ", X) {IZX}";
+			sInst += "(" + label(lo, 2) + ", X) {IZX}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::IZY)
+		else if (lookup[opcode].addrmode == &olc6502_t::IZY)
 		{
-			lo = bus->read(addr, true); addr++;
+			lo = bus->peek(addr); addr++;
 			hi = 0x00;								
-			sInst += "($" + hex(lo, 2) + "), Y {IZY}";
+			sInst += "(" + label(lo, 2) + "), Y {IZY}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ABS)
+		else if (lookup[opcode].addrmode == &olc6502_t::ABS)
 		{
-			lo = bus->read(addr, true); addr++;
-			hi = bus->read(addr, true); addr++;
-			sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + " {ABS}";
+			lo = bus->peek(addr); addr++;
+			hi = bus->peek(addr); addr++;
+			sInst += label((uint16_t)(hi << 8) | lo, 4) + " {ABS}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ABX)
+		else if (lookup[opcode].addrmode == &olc6502_t::ABX)
 		{
-			lo = bus->read(addr, true); addr++;
-			hi = bus->read(addr, true); addr++;
-			sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", X {ABX}";
+			lo = bus->peek(addr); addr++;
+			hi = bus->peek(addr); addr++;
+			sInst += label((uint16_t)(hi << 8) | lo, 4) + ", X {ABX}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::ABY)
+		else if (lookup[opcode].addrmode == &olc6502_t::ABY)
 		{
-			lo = bus->read(addr, true); addr++;
-			hi = bus->read(addr, true); addr++;
-			sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", Y {ABY}";
+			lo = bus->peek(addr); addr++;
+			hi = bus->peek(addr); addr++;
+			sInst += label((uint16_t)(hi << 8) | lo, 4) + ", Y {ABY}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::IND)
+		else if (lookup[opcode].addrmode == &olc6502_t::IND)
 		{
-			lo = bus->read(addr, true); addr++;
-			hi = bus->read(addr, true); addr++;
-			sInst += "($" + hex((uint16_t)(hi << 8) | lo, 4) + ") {IND}";
+			lo = bus->peek(addr); addr++;
+			hi = bus->peek(addr); addr++;
+			sInst += "(" + label((uint16_t)(hi << 8) | lo, 4) + ") {IND}";
 		}
-		else if (lookup[opcode].addrmode == &olc6502::REL)
+		else if (lookup[opcode].addrmode == &olc6502_t::REL)
 		{
-			value = bus->read(addr, true); addr++;
+			value = bus->peek(addr); addr++;
 			int8_t rel_value = (int8_t)value; 
-			sInst += "$" + hex(value, 2) + " [$" + hex(addr + rel_value, 4) + "] {REL}";
+			sInst += "$" + hex(value, 2) + " [" + label(addr + rel_value, 4) + "] {REL}";
+		}
+		else if (lookup[opcode].addrmode == &olc6502_t::IZP)
+		{
+			lo = bus->peek(addr); addr++;
+			hi = 0x00;
+			sInst += "(" + label(lo, 2) + ") {IZP}";
+		}
+		else if (lookup[opcode].addrmode == &olc6502_t::IAX)
+		{
+			lo = bus->peek(addr); addr++;
+			hi = bus->peek(addr); addr++;
+			sInst += "(" + label((uint16_t)(hi << 8) | lo, 4) + ", X) {IAX}";
+		}
+		else if (lookup[opcode].addrmode == &olc6502_t::ZPR)
+		{
+			lo = bus->peek(addr); addr++;
+			value = bus->peek(addr); addr++;
+			int8_t rel_value = (int8_t)value;
+			sInst += label(lo, 2) + ", $" + hex(value, 2) + " [" + label(addr + rel_value, 4) + "] {ZPR}";
 		}
 
 		// Add the formed string to a std::map, using the instruction's
@@ -1606,4 +2787,51 @@ std::map<uint16_t, std::string> olc6502::disassemble(uint16_t nStart, uint16_t n
 	return mapLines;
 }
 
+template <typename VARIANT>
+typename olc6502_t<VARIANT>::OPCODEINFO olc6502_t<VARIANT>::GetOpcodeInfo(uint8_t nOpcode) const
+{
+	const INSTRUCTION &ins = lookup[nOpcode];
+	OPCODEINFO info;
+	info.name = ins.name;
+	info.cycles = ins.cycles;
+
+	info.bDocumented = ins.bDocumented;
+
+	// Same order as ADDRMODE
+	static uint8_t (olc6502_t::*const modes[])(void) =
+	{
+		&olc6502_t::IMP, &olc6502_t::IMM, &olc6502_t::ZP0, &olc6502_t::ZPX, &olc6502_t::ZPY, &olc6502_t::REL,
+		&olc6502_t::ABS, &olc6502_t::ABX, &olc6502_t::ABY, &olc6502_t::IND, &olc6502_t::IZX, &olc6502_t::IZY,
+		&olc6502_t::IZP, &olc6502_t::IAX, &olc6502_t::ZPR,
+	};
+	for (uint8_t m = AM_IMP; m <= AM_ZPR; m++)
+	{
+		if (ins.addrmode == modes[m])
+			info.mode = (ADDRMODE)m;
+	}
+
+	if ((info.mode >= AM_ABS && info.mode <= AM_IND) || info.mode == AM_IAX || info.mode == AM_ZPR)
+		info.bytes = 3;
+	else if (info.mode != AM_IMP)
+		info.bytes = 2;
+
+	return info;
+}
+
+template <typename VARIANT>
+const char* olc6502_t<VARIANT>::AddrModeName(ADDRMODE mode)
+{
+	static const char* names[] =
+	{
+		"IMP", "IMM", "ZP0", "ZPX", "ZPY", "REL",
+		"ABS", "ABX", "ABY", "IND", "IZX", "IZY",
+		"IZP", "IAX", "ZPR",
+	};
+	return mode <= AM_ZPR ? names[mode] : "???";
+}
+
+template class olc6502_t<NMOS6502>;
+template class olc6502_t<RP2A03>;
+template class olc6502_t<WDC65C02>;
+
 // End of File - Jx9
@@ -108,14 +108,64 @@
 // Forward declaration of generic communications bus class to
 // prevent circular inclusions
 class Bus;
+class Symbols;
+
+
+// CPU Variants =====================================================
+// The core is a template over one of these. Each says how a member of
+// the family differs from the NMOS original, and as they are all
+// compile time constants the differences are settled when the core is
+// compiled, instead of being tested while it runs:
+//
+//	bDecimal   : ADC and SBC do binary coded decimal arithmetic while D
+//	             is set
+//	bJmpIndBug : JMP ($xxFF) reads the high byte of its target from $xx00
+//	bCmos      : The 65C02 additions - the new instructions and (zp)
+//	             addressing, unused opcodes as NOPs of various lengths,
+//	             D cleared by interrupts, valid N and Z after decimal
+//	             arithmetic, and its own cycle counts
+struct NMOS6502
+{
+	static constexpr const char* name = "NMOS 6502";
+	static constexpr bool bDecimal    = true;
+	static constexpr bool bJmpIndBug  = true;
+	static constexpr bool bCmos       = false;
+};
+
+// The NES's CPU. It is an NMOS 6502 with the decimal circuit cut out, so
+// D can be set and pushed, but does nothing
+struct RP2A03 : NMOS6502
+{
+	static constexpr const char* name = "Ricoh 2A03";
+	static constexpr bool bDecimal    = false;
+};
+
+// The WDC 65C02, with the Rockwell bit instructions and WAI/STP
+struct WDC65C02
+{
+	static constexpr const char* name = "WDC 65C02";
+	static constexpr bool bDecimal    = true;
+	static constexpr bool bJmpIndBug  = false;
+	static constexpr bool bCmos       = true;
+};
+
+// The variant "olc6502" stands for, chosen at build time. The others can
+// still be used by naming olc6502_t<...> directly
+#ifndef OLC6502_VARIANT
+#define OLC6502_VARIANT NMOS6502
+#endif
 
 
 // The 6502 Emulation Class. This is it!
-class olc6502
+template <typename VARIANT>
+class olc6502_t
 {
 public:
-	olc6502();
-	~olc6502();
+	olc6502_t();
+	~olc6502_t();
+
+	typedef VARIANT Variant;
+	static const char* VariantName() { return VARIANT::name; }
 
 public:
 	// CPU Core registers, exposed as public here for ease of access from external
@@ -139,13 +189,140 @@ public:
 	// clocking every cycle
 	bool complete();
 
+	// Executes one whole instruction, stepping over an execution breakpoint
+	// at the current location if there is one
+	void step();
+
+	// Executes whole instructions until at least nCycles clock cycles have
+	// elapsed. Returns true if it stopped early because a breakpoint was hit,
+	// in which case the bus's breakpoints say which one. Execution always
+	// stops at an instruction boundary.
+	bool run(uint64_t nCycles);
+
 	// Link this CPU to a communications bus
 	void ConnectBus(Bus *n) { bus = n; }
 
+	// Called by the bus when entry nPage of its page table changes, so
+	// the CPU stops using a pointer it took from there
+	void PageMapped(uint8_t nPage) { if (nPage == code_page) code_page = NO_PAGE; }
+
 	// Produces a map of strings, with keys equivalent to instruction start locations
 	// in memory, for the specified address range
 	std::map<uint16_t, std::string> disassemble(uint16_t nStart, uint16_t nStop);
 
+	// Names for addresses in the disassembly, if set
+	const Symbols *symbols = nullptr;
+
+	// Addressing modes, named as in the disassembly
+	enum ADDRMODE : uint8_t
+	{
+		AM_IMP, AM_IMM, AM_ZP0, AM_ZPX, AM_ZPY, AM_REL,
+		AM_ABS, AM_ABX, AM_ABY, AM_IND, AM_IZX, AM_IZY,
+		AM_IZP, AM_IAX, AM_ZPR,		// 65C02 only
+	};
+
+	// What the translation table knows about an opcode, for tools that
+	// need to build or describe instructions without executing them
+	struct OPCODEINFO
+	{
+		std::string name;
+		ADDRMODE    mode   = AM_IMP;
+		uint8_t     cycles = 0;		// Base cycle count
+		uint8_t     bytes  = 1;		// Including the opcode
+		bool        bDocumented = false;
+	};
+
+	OPCODEINFO GetOpcodeInfo(uint8_t nOpcode) const;
+	static const char* AddrModeName(ADDRMODE mode);
+
+	// Shadow Call Stack ================================================
+	// The real stack is just bytes, so there is no way to tell a return
+	// address from something pushed by PHA. Alongside it, the core keeps
+	// its own record of subroutine and interrupt frames, updated by JSR,
+	// RTS, BRK, RTI, irq() and nmi(). Each frame remembers the stack
+	// pointer from before it was pushed, and frames are retired by
+	// comparing that against the real stack pointer rather than by
+	// counting returns. This keeps it in step with tricks such as
+	// PHA/PHA/RTS dispatch, PLA/PLA/RTS early exits or TXS resets.
+	enum FRAMETYPE : uint8_t
+	{
+		FRAME_JSR,
+		FRAME_BRK,
+		FRAME_IRQ,
+		FRAME_NMI,
+	};
+
+	struct FRAME
+	{
+		uint16_t target = 0x0000;	// Address of the routine or handler entered
+		uint16_t ret    = 0x0000;	// Address execution resumes at on return
+		uint8_t  stkp   = 0x00;		// Stack pointer before the frame was pushed
+		uint8_t  type   = FRAME_JSR;
+		uint64_t entry  = 0;		// Clock count when the call started
+	};
+
+	// Returns the active frames, outermost first
+	std::vector<FRAME> backtrace();
+
+	// Per-routine profile, indexed by the routine's address. "cycles" is
+	// inclusive, i.e. it contains the time spent in nested calls too, and
+	// is credited when the frame is retired. It needs 1MB, so it is only
+	// allocated when enabled.
+	struct PROFILE
+	{
+		uint64_t calls  = 0;
+		uint64_t cycles = 0;
+	};
+
+	void EnableProfile(bool bEnable);
+	const std::vector<PROFILE>& profile() const { return call_profile; }
+
+	// Edge Coverage ====================================================
+	// For fuzzing. While "coverage" points at COVERAGE_SIZE bytes, every
+	// branch (taken or not), jump, call, return and interrupt counts the
+	// edge from the previous one to where execution goes next. Addresses
+	// are hashed into the map and edges are combined as AFL does, with
+	// the previous location shifted so A->B and B->A are told apart. The
+	// counters wrap. With no map attached the cost is one test per
+	// instruction.
+	static constexpr uint32_t COVERAGE_BITS = 14;
+	static constexpr uint32_t COVERAGE_SIZE = 1 << COVERAGE_BITS;
+	uint8_t *coverage = nullptr;
+
+	// Forgets the previous location, so runs start alike
+	void ResetCoverage() { coverage_prev = 0; }
+
+	// A 65C02 stops after WAI until an interrupt, and after STP until a
+	// reset, as does an NMOS 6502 after KIL. The clock keeps running
+	// while it waits
+	enum HALT : uint8_t
+	{
+		HALT_NONE,
+		HALT_WAI,
+		HALT_STP,	// Or KIL
+	};
+
+	// Everything needed to put the CPU back exactly as it was at an
+	// instruction boundary, for rewinding and comparing
+	struct STATE
+	{
+		uint8_t  a = 0, x = 0, y = 0, stkp = 0, status = 0;
+		uint16_t pc = 0x0000;
+		uint8_t  cycles = 0;
+		uint8_t  halt = HALT_NONE;
+		uint64_t clock_count = 0;
+		uint64_t instr_count = 0;
+		std::vector<FRAME> frames;
+	};
+
+	void SaveState(STATE &s);
+	void LoadState(const STATE &s);
+
+	// Number of clock cycles since power on, and number of instructions
+	// started. These form the timeline used by the scheduler and rewind
+	uint64_t GetClockCount() const { return clock_count; }
+	uint64_t GetInstructionCount() const { return instr_count; }
+
 	// The status register stores 8 flags. Ive enumerated these here for ease
 	// of access. You can access the status register directly since its public.
 	// The bits have different interpretations depending upon the context and 
@@ -155,7 +332,7 @@ public:
 		C = (1 << 0),	// Carry Bit
 		Z = (1 << 1),	// Zero
 		I = (1 << 2),	// Disable Interrupts
-		D = (1 << 3),	// Decimal Mode (unused in this implementation)
+		D = (1 << 3),	// Decimal Mode (ADC and SBC, if the variant has it)
 		B = (1 << 4),	// Break
 		U = (1 << 5),	// Unused
 		V = (1 << 6),	// Overflow
@@ -174,18 +351,66 @@ private:
 	uint16_t addr_rel    = 0x00;   // Represents absolute address following a branch
 	uint8_t  opcode      = 0x00;   // Is the instruction byte
 	uint8_t  cycles      = 0;	   // Counts how many cycles the instruction has remaining
-	uint32_t clock_count = 0;	   // A global accumulation of the number of clocks
+	uint64_t clock_count = 0;	   // A global accumulation of the number of clocks
+	uint64_t instr_count = 0;	   // A global accumulation of the number of instructions
+
+	uint8_t  halt        = HALT_NONE;
+
+	// Shadow call stack storage. Frames always have strictly decreasing
+	// stack pointers, so there can never be more than 256 of them
+	FRAME    call_stack[256];
+	uint16_t call_depth = 0;
+	std::vector<PROFILE> call_profile;
+
+	void PushFrame(uint8_t type, uint16_t target, uint16_t ret, uint8_t sp);
+	void PopFrames(uint8_t sp);
+
+	// Coverage state, and which opcodes end a basic block
+	uint16_t coverage_prev = 0;
+	bool     edge_op[256];
+
+	void CoverEdge();
 
 	// Linkage to the communications bus
 	Bus     *bus = nullptr;
 	uint8_t read(uint16_t a);
 	void    write(uint16_t a, uint8_t d);
 
+	// Push a byte to the stack at stkp and decrement it, or increment it
+	// and pull the byte there, the bus's page table permitting without
+	// going through the bus
+	void    Push(uint8_t d);
+	uint8_t Pull();
+
+	// The zero page's equivalent, for operands and indirect pointers
+	uint8_t ReadZP(uint8_t a);
+	void    WriteZP(uint8_t a, uint8_t d);
+
+	// Reads the byte at pc and increments it, through code, the host
+	// memory behind page code_page until PageMapped() says it has changed
+	static constexpr uint16_t NO_PAGE = 0x100;
+	const uint8_t *code = nullptr;
+	uint16_t code_page = NO_PAGE;
+
+	uint8_t ReadPC();
+	void    CodePage();
+
 	// The read location of data can come from two sources, a memory address, or
 	// its immediately available as part of the instruction. This function decides
 	// depending on address mode of instruction byte
 	uint8_t fetch();
 
+	// The arithmetic of ADC and SBC on "fetched", shared with the
+	// unofficial opcodes that end in an addition or subtraction
+	uint8_t AddWithCarry();
+	uint8_t SubWithBorrow();
+
+	// Decimal mode ADC and SBC, from a BCD table entry
+	uint8_t Decimal(uint16_t r);
+
+	// The store of SHA, SHX, SHY and TAS, see SHA
+	void    StoreHigh(uint8_t value, uint8_t index);
+
 	// This structure and the following vector are used to compile and store
 	// the opcode translation table. The 6502 can effectively have 256
 	// different instructions. Each of these are stored in a table in numerical
@@ -197,13 +422,15 @@ private:
     //						  addressing mechanism used by the instruction
 	//	Cycle Count : An integer that represents the base number of clock cycles the
 	//				  CPU requires to perform the instruction
+	//	Documented : False for the NMOS 6502's unofficial opcodes
 
 	struct INSTRUCTION
 	{
 		std::string name;		
-		uint8_t     (olc6502::*operate )(void) = nullptr;
-		uint8_t     (olc6502::*addrmode)(void) = nullptr;
+		uint8_t     (olc6502_t::*operate )(void) = nullptr;
+		uint8_t     (olc6502_t::*addrmode)(void) = nullptr;
 		uint8_t     cycles = 0;
+		bool        bDocumented = true;
 	};
 
 	std::vector<INSTRUCTION> lookup;
@@ -232,11 +459,16 @@ private:
 	uint8_t ABY();	uint8_t IND();	
 	uint8_t IZX();	uint8_t IZY();
 
+	// 65C02 only: (zp), (abs,X) for JMP, and zp with a relative branch
+	// target for BBR and BBS
+	uint8_t IZP();	uint8_t IAX();
+	uint8_t ZPR();
+
 private: 
 	// Opcodes ======================================================
-	// There are 56 "legitimate" opcodes provided by the 6502 CPU. I
-	// have not modelled "unofficial" opcodes. As each opcode is 
-	// defined by 1 byte, there are potentially 256 possible codes.
+	// There are 56 "legitimate" opcodes provided by the 6502 CPU. As
+	// each opcode is defined by 1 byte, there are potentially 256
+	// possible codes.
 	// Codes are not used in a "switch case" style on a processor,
 	// instead they are repsonisble for switching individual parts of
 	// CPU circuits on and off. The opcodes listed here are official, 
@@ -270,9 +502,22 @@ private:
 	uint8_t STX();	uint8_t STY();	uint8_t TAX();	uint8_t TAY();
 	uint8_t TSX();	uint8_t TXA();	uint8_t TXS();	uint8_t TYA();
 
-	// I capture all "unofficial" opcodes with this function. It is
-	// functionally identical to a NOP
-	uint8_t XXX();
+	// The 65C02's additions. INC A and DEC A are INA and DEA here, as
+	// INC and DEC always write memory
+	uint8_t BBR();	uint8_t BBS();	uint8_t BRA();	uint8_t DEA();
+	uint8_t INA();	uint8_t PHX();	uint8_t PHY();	uint8_t PLX();
+	uint8_t PLY();	uint8_t RMB();	uint8_t SMB();	uint8_t STP();
+	uint8_t STZ();	uint8_t TRB();	uint8_t TSB();	uint8_t WAI();
+
+	// The NMOS 6502's "unofficial" opcodes. Most combine a read-modify-
+	// write instruction with an ALU one, e.g. SLO is ASL then ORA. KIL
+	// jams the CPU until reset, and IGN is a NOP that reads its operand
+	uint8_t ALR();	uint8_t ANC();	uint8_t ANE();	uint8_t ARR();
+	uint8_t DCP();	uint8_t IGN();	uint8_t ISC();	uint8_t KIL();
+	uint8_t LAS();	uint8_t LAX();	uint8_t LXA();	uint8_t RLA();
+	uint8_t RRA();	uint8_t SAX();	uint8_t SBX();	uint8_t SHA();
+	uint8_t SHX();	uint8_t SHY();	uint8_t SLO();	uint8_t SRE();
+	uint8_t TAS();
 
 #ifdef LOGMODE
 private:
@@ -280,4 +525,11 @@ private:
 #endif
 };
 
+// Every variant is compiled once, in olc6502.cpp
+extern template class olc6502_t<NMOS6502>;
+extern template class olc6502_t<RP2A03>;
+extern template class olc6502_t<WDC65C02>;
+
+typedef olc6502_t<OLC6502_VARIANT> olc6502;
+
 // End of File - Jx9